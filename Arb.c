@@ -0,0 +1,365 @@
+/*
+    Hantek 2D72 handheld oscillosope tool for linux
+    Copyright (C) 2021 Luca Oliva
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+
+#include "Arb.h"
+
+enum {
+    OP_CONST,
+    OP_T,
+    OP_ADD,
+    OP_SUB,
+    OP_MUL,
+    OP_DIV,
+    OP_POW,
+    OP_NEG,
+    OP_SIN,
+    OP_COS,
+    OP_TAN,
+    OP_EXP,
+    OP_LOG,
+    OP_SQRT,
+    OP_ABS,
+    OP_TANH,
+    OP_FLOOR,
+    OP_SAW,
+    OP_TRI,
+    OP_SQR
+};
+
+static const struct {
+    const char* name;
+    uint8_t     op;
+} arb_functions[] = {
+    { "sin",   OP_SIN   },
+    { "cos",   OP_COS   },
+    { "tan",   OP_TAN   },
+    { "exp",   OP_EXP   },
+    { "log",   OP_LOG   },
+    { "sqrt",  OP_SQRT  },
+    { "abs",   OP_ABS   },
+    { "tanh",  OP_TANH  },
+    { "floor", OP_FLOOR },
+    { "saw",   OP_SAW   },
+    { "tri",   OP_TRI   },
+    { "sqr",   OP_SQR   },
+};
+
+typedef struct {
+    const char* text;
+    const char* pos;
+    arb_expr_t* expr;
+    int         depth;
+    int         error;
+} arb_parser_t;
+
+static void arb_emit(arb_parser_t* p, uint8_t op, float val) {
+    if ( p->expr->num_ops >= ARB_EXPR_MAX_OPS ) {
+        p->error = 1;
+        return;
+    }
+
+    //Constants and t push, binary operators pop one, functions keep the depth
+    if ( op == OP_CONST || op == OP_T )
+        p->depth++;
+    else if ( op >= OP_ADD && op <= OP_POW )
+        p->depth--;
+
+    if ( p->depth > ARB_EXPR_MAX_DEPTH )
+        p->error = 1;
+
+    p->expr->ops[p->expr->num_ops++] = (arb_op_t){ op, val };
+}
+
+static void arb_skip(arb_parser_t* p) {
+    while ( isspace((unsigned char)*p->pos) )
+        p->pos++;
+}
+
+static void arb_parse_expr(arb_parser_t* p);
+static void arb_parse_unary(arb_parser_t* p);
+
+static void arb_parse_primary(arb_parser_t* p) {
+    arb_skip(p);
+
+    if ( isdigit((unsigned char)*p->pos) || *p->pos == '.' ) {
+        char* end;
+        float val = strtof(p->pos, &end);
+        p->pos = end;
+        arb_emit(p, OP_CONST, val);
+    } else if ( *p->pos == '(' ) {
+        p->pos++;
+        arb_parse_expr(p);
+        arb_skip(p);
+        if ( *p->pos != ')' ) {
+            p->error = 1;
+            return;
+        }
+        p->pos++;
+    } else if ( isalpha((unsigned char)*p->pos) ) {
+        const char* start = p->pos;
+        size_t len;
+
+        while ( isalnum((unsigned char)*p->pos) )
+            p->pos++;
+        len = p->pos-start;
+
+        if ( len == 1 && *start == 't' ) {
+            arb_emit(p, OP_T, 0);
+            return;
+        }
+        if ( len == 2 && !strncmp(start, "pi", 2) ) {
+            arb_emit(p, OP_CONST, M_PI);
+            return;
+        }
+
+        for (size_t i=0;i<sizeof(arb_functions)/sizeof(arb_functions[0]);i++) {
+            if ( strlen(arb_functions[i].name) == len && !strncmp(start, arb_functions[i].name, len) ) {
+                arb_skip(p);
+                if ( *p->pos != '(' ) {
+                    p->error = 1;
+                    return;
+                }
+                p->pos++;
+                arb_parse_expr(p);
+                arb_skip(p);
+                if ( *p->pos != ')' ) {
+                    p->error = 1;
+                    return;
+                }
+                p->pos++;
+                arb_emit(p, arb_functions[i].op, 0);
+                return;
+            }
+        }
+        p->pos = start;
+        p->error = 1;
+    } else {
+        p->error = 1;
+    }
+}
+
+static void arb_parse_power(arb_parser_t* p) {
+    arb_parse_primary(p);
+    arb_skip(p);
+    if ( !p->error && *p->pos == '^' ) {
+        p->pos++;
+        arb_parse_unary(p);
+        arb_emit(p, OP_POW, 0);
+    }
+}
+
+static void arb_parse_unary(arb_parser_t* p) {
+    arb_skip(p);
+    if ( *p->pos == '-' ) {
+        p->pos++;
+        arb_parse_unary(p);
+        arb_emit(p, OP_NEG, 0);
+    } else {
+        arb_parse_power(p);
+    }
+}
+
+static void arb_parse_term(arb_parser_t* p) {
+    arb_parse_unary(p);
+    arb_skip(p);
+    while ( !p->error && (*p->pos == '*' || *p->pos == '/') ) {
+        uint8_t op = *p->pos == '*' ? OP_MUL : OP_DIV;
+        p->pos++;
+        arb_parse_unary(p);
+        arb_emit(p, op, 0);
+        arb_skip(p);
+    }
+}
+
+static void arb_parse_expr(arb_parser_t* p) {
+    arb_parse_term(p);
+    arb_skip(p);
+    while ( !p->error && (*p->pos == '+' || *p->pos == '-') ) {
+        uint8_t op = *p->pos == '+' ? OP_ADD : OP_SUB;
+        p->pos++;
+        arb_parse_term(p);
+        arb_emit(p, op, 0);
+        arb_skip(p);
+    }
+}
+
+int arb_expr_compile(arb_expr_t* expr, const char* text) {
+    arb_parser_t parser = { .text = text, .pos = text, .expr = expr };
+
+    expr->num_ops = 0;
+
+    arb_parse_expr(&parser);
+    arb_skip(&parser);
+    if ( parser.error || *parser.pos != '\0' || parser.depth != 1 ) {
+        fprintf(stderr, "Expression error at column %d: %s\n", (int)(parser.pos-text)+1, text);
+        expr->num_ops = 0;
+        return -1;
+    }
+
+    return 0;
+}
+
+static inline float arb_frac(float x) {
+    return x - floorf(x);
+}
+
+//Every operator is applied to a whole block of points at once, so each
+//loop body is a single branch-free operation the compiler can vectorize.
+static void arb_expr_eval_block(const arb_expr_t* expr, float* out, int first, int n, float dt) {
+    float stack[ARB_EXPR_MAX_DEPTH][ARB_BLOCK];
+    int sp = -1;
+
+    for (int o=0;o<expr->num_ops;o++) {
+        const arb_op_t* op = &expr->ops[o];
+        float* a = stack[sp > 0 ? sp-1 : 0];
+        float* b = stack[sp >= 0 ? sp : 0];
+        int i;
+
+        switch (op->op) {
+            case OP_CONST:
+                b = stack[++sp];
+                for (i=0;i<n;i++) b[i] = op->val;
+                break;
+            case OP_T:
+                b = stack[++sp];
+                for (i=0;i<n;i++) b[i] = (first+i)*dt;
+                break;
+            case OP_ADD:   for (i=0;i<n;i++) a[i] += b[i];        sp--; break;
+            case OP_SUB:   for (i=0;i<n;i++) a[i] -= b[i];        sp--; break;
+            case OP_MUL:   for (i=0;i<n;i++) a[i] *= b[i];        sp--; break;
+            case OP_DIV:   for (i=0;i<n;i++) a[i] /= b[i];        sp--; break;
+            case OP_POW:   for (i=0;i<n;i++) a[i] = powf(a[i], b[i]); sp--; break;
+            case OP_NEG:   for (i=0;i<n;i++) b[i] = -b[i];        break;
+            case OP_SIN:   for (i=0;i<n;i++) b[i] = sinf(b[i]);   break;
+            case OP_COS:   for (i=0;i<n;i++) b[i] = cosf(b[i]);   break;
+            case OP_TAN:   for (i=0;i<n;i++) b[i] = tanf(b[i]);   break;
+            case OP_EXP:   for (i=0;i<n;i++) b[i] = expf(b[i]);   break;
+            case OP_LOG:   for (i=0;i<n;i++) b[i] = logf(b[i]);   break;
+            case OP_SQRT:  for (i=0;i<n;i++) b[i] = sqrtf(b[i]);  break;
+            case OP_ABS:   for (i=0;i<n;i++) b[i] = fabsf(b[i]);  break;
+            case OP_TANH:  for (i=0;i<n;i++) b[i] = tanhf(b[i]);  break;
+            case OP_FLOOR: for (i=0;i<n;i++) b[i] = floorf(b[i]); break;
+            case OP_SAW:   for (i=0;i<n;i++) b[i] = 2*arb_frac(b[i])-1; break;
+            case OP_TRI:   for (i=0;i<n;i++) b[i] = 1-4*fabsf(arb_frac(b[i])-0.5f); break;
+            case OP_SQR:   for (i=0;i<n;i++) b[i] = arb_frac(b[i]) < 0.5f ? 1 : -1; break;
+        }
+    }
+
+    memcpy(out, stack[0], n*sizeof(float));
+}
+
+void arb_expr_eval(const arb_expr_t* expr, float* out, int num_points) {
+    float dt = 1.0f/num_points;
+
+    if ( expr->num_ops == 0 ) {
+        memset(out, 0, num_points*sizeof(float));
+        return;
+    }
+
+    for (int first=0;first<num_points;first+=ARB_BLOCK) {
+        int n = num_points-first < ARB_BLOCK ? num_points-first : ARB_BLOCK;
+        arb_expr_eval_block(expr, out+first, first, n, dt);
+    }
+}
+
+//One point per line; with several columns (e.g. time,value) the last one is used.
+int arb_load_csv(const char* path, float* out, int max_points) {
+    FILE* file = fopen(path, "r");
+    char line[256];
+    int count = 0;
+
+    if ( file == NULL ) {
+        perror(path);
+        return -1;
+    }
+
+    while ( count < max_points && fgets(line, sizeof(line), file) ) {
+        char* field = line;
+        char* sep;
+        char* end;
+        float val;
+
+        while ( (sep = strpbrk(field, ",;\t")) != NULL )
+            field = sep+1;
+
+        val = strtof(field, &end);
+        if ( end == field )
+            continue; //header or empty line
+
+        out[count++] = val;
+    }
+
+    fclose(file);
+    return count;
+}
+
+//Signed 16 bit little endian points
+int arb_load_raw(const char* path, float* out, int max_points) {
+    FILE* file = fopen(path, "rb");
+    uint8_t buffer[4096];
+    int count = 0;
+    size_t len;
+
+    if ( file == NULL ) {
+        perror(path);
+        return -1;
+    }
+
+    while ( count < max_points && (len = fread(buffer, 1, sizeof(buffer), file)) >= 2 ) {
+        for (size_t i=0;i+1<len && count<max_points;i+=2)
+            out[count++] = (int16_t)(buffer[i] | buffer[i+1] << 8)/32768.0f;
+    }
+
+    fclose(file);
+    return count;
+}
+
+//Linear interpolation over one period, wrapping the last point to the first
+void arb_resample(const float* in, int num_in, float* out, int num_out) {
+    for (int i=0;i<num_out;i++) {
+        double pos = (double)i*num_in/num_out;
+        int    idx = (int)pos;
+        float  frac = pos-idx;
+        float  next = in[(idx+1) % num_in];
+
+        out[i] = in[idx] + (next-in[idx])*frac;
+    }
+}
+
+void arb_normalize(float* data, int num_points) {
+    float min = INFINITY, max = -INFINITY;
+
+    for (int i=0;i<num_points;i++) {
+        if ( data[i] < min ) min = data[i];
+        if ( data[i] > max ) max = data[i];
+    }
+
+    if ( !(max > min) ) {
+        memset(data, 0, num_points*sizeof(float));
+        return;
+    }
+
+    for (int i=0;i<num_points;i++)
+        data[i] = 2*(data[i]-min)/(max-min)-1;
+}
@@ -0,0 +1,48 @@
+/*
+    Hantek 2D72 handheld oscillosope tool for linux
+    Copyright (C) 2021 Luca Oliva
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _ARB_H
+#define _ARB_H
+
+#include <stdint.h>
+
+#define ARB_EXPR_MAX_OPS                128
+#define ARB_EXPR_MAX_DEPTH              16
+#define ARB_BLOCK                       256
+
+typedef struct {
+        uint8_t op;
+        float   val;
+} arb_op_t;
+
+//Expression in the phase variable t (0 <= t < 1), compiled to RPN
+typedef struct {
+        arb_op_t ops[ARB_EXPR_MAX_OPS];
+        int      num_ops;
+} arb_expr_t;
+
+int  arb_expr_compile(arb_expr_t* expr, const char* text);
+void arb_expr_eval(const arb_expr_t* expr, float* out, int num_points);
+
+int  arb_load_csv(const char* path, float* out, int max_points);
+int  arb_load_raw(const char* path, float* out, int max_points);
+
+void arb_resample(const float* in, int num_in, float* out, int num_out);
+void arb_normalize(float* data, int num_points);
+
+#endif //_ARB_H
@@ -0,0 +1,151 @@
+/*
+    Hantek 2D72 handheld oscillosope tool for linux
+    Copyright (C) 2021 Luca Oliva
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <math.h>
+
+#include "Autoset.h"
+#include "Scale.h"
+
+#define AUTOSET_RAW_TOP                 (SCALE_RAW_BOTTOM+8*SCALE_RAW_PER_DIV)
+#define AUTOSET_MIN_SWING               6 //raw codes, below is taken as no signal
+#define AUTOSET_MIN_PERIOD              8 //samples
+
+void autoset_measure(const uint8_t* frame, int num_samples, int num_channels, int slot, autoset_meas_t* meas) {
+    int min = 255, max = 0;
+    int mid, hysteresis;
+    int first = -1, last = -1;
+    bool high;
+
+    for (int i=0;i<num_samples;i++) {
+        int v = frame[i*num_channels+slot];
+        if ( v < min ) min = v;
+        if ( v > max ) max = v;
+    }
+
+    meas->min       = min;
+    meas->max       = max;
+    meas->clipped   = min <= SCALE_RAW_BOTTOM || max >= AUTOSET_RAW_TOP;
+    meas->crossings = 0;
+    meas->period    = 0;
+
+    if ( max-min < AUTOSET_MIN_SWING )
+        return;
+
+    //Crossings with hysteresis, so noise on a slow edge counts once
+    mid        = (min+max)/2;
+    hysteresis = (max-min)/8;
+    high       = frame[slot] > mid;
+    for (int i=1;i<num_samples;i++) {
+        int v = frame[i*num_channels+slot];
+
+        if ( high && v < mid-hysteresis ) {
+            high = false;
+        } else if ( !high && v > mid+hysteresis ) {
+            high = true;
+            if ( first < 0 )
+                first = i;
+            last = i;
+            meas->crossings++;
+        }
+    }
+
+    if ( meas->crossings >= 2 )
+        meas->period = (double)(last-first)/(meas->crossings-1);
+}
+
+//Coarsest scale still spanning the swing over AUTOSET_FRAMING divisions
+static int fit_scale(int probe, double swing) {
+    for (int scale=0;scale<SCALE_NUM_VOLT;scale++)
+        if ( scale_volts_per_div(probe, scale)*AUTOSET_FRAMING >= swing )
+            return scale;
+    return SCALE_NUM_VOLT-1;
+}
+
+static double clamp_offset(double offset, double volts_per_div) {
+    return fmax(-4*volts_per_div, fmin(4*volts_per_div, offset));
+}
+
+//One move toward a good framing from what was measured with state. Clipped
+//channels zoom out two steps at a time, others are fitted in one go; then
+//the time base is fitted on the trigger channel once it shows a period.
+bool autoset_step(const autoset_state_t* state, const autoset_meas_t meas[2], autoset_state_t* next) {
+    bool clipped = false;
+    int trigger = -1;
+
+    *next = *state;
+
+    for (int ch=0;ch<2;ch++) {
+        const autoset_meas_t* m = &meas[ch];
+        double volts_per_div = scale_volts_per_div(state->probe[ch], state->scale[ch]);
+        double low, high;
+
+        if ( !state->enable[ch] )
+            continue;
+
+        if ( m->clipped ) {
+            next->scale[ch]  = state->scale[ch]+2 < SCALE_NUM_VOLT ? state->scale[ch]+2 : SCALE_NUM_VOLT-1;
+            next->offset[ch] = 0;
+            clipped = true;
+            continue;
+        }
+        if ( m->max-m->min < AUTOSET_MIN_SWING )
+            continue;
+
+        low  = scale_raw_to_volts(m->min, volts_per_div, state->offset[ch]);
+        high = scale_raw_to_volts(m->max, volts_per_div, state->offset[ch]);
+
+        next->scale[ch]  = fit_scale(state->probe[ch], high-low);
+        next->offset[ch] = clamp_offset(-(low+high)/2, scale_volts_per_div(state->probe[ch], next->scale[ch]));
+
+        //Stay on the trigger source while it shows a signal
+        if ( trigger < 0 || ch == state->trigger_source )
+            trigger = ch;
+    }
+
+    //The vertical framing settles first, a clipped channel cannot be trusted
+    if ( trigger >= 0 && !clipped ) {
+        const autoset_meas_t* m = &meas[trigger];
+        double volts_per_div = scale_volts_per_div(state->probe[trigger], state->scale[trigger]);
+
+        next->trigger_source = trigger;
+        next->trigger_level  = (scale_raw_to_volts(m->min, volts_per_div, state->offset[trigger]) +
+                                scale_raw_to_volts(m->max, volts_per_div, state->offset[trigger]))/2;
+
+        if ( m->crossings < 2 ) {
+            //Slower than the screen: ten times slower per step
+            next->time_scale = state->time_scale+3 < AUTOSET_SLOWEST_TIME ? state->time_scale+3 : AUTOSET_SLOWEST_TIME;
+        } else {
+            double period = m->period/scale_sample_rate(state->time_scale);
+            double wanted = AUTOSET_PERIODS*period*SCALE_SAMPLES_PER_DIV/state->num_samples;
+            int time_scale = 0;
+
+            while ( time_scale < AUTOSET_SLOWEST_TIME && scale_time_per_div(time_scale) < wanted )
+                time_scale++;
+
+            //Too few samples per period to trust the measure: halve and look again
+            if ( m->period < AUTOSET_MIN_PERIOD && time_scale >= state->time_scale )
+                time_scale = state->time_scale > 2 ? state->time_scale-2 : 0;
+            next->time_scale = time_scale;
+        }
+    }
+
+    return next->time_scale != state->time_scale ||
+           next->scale[0] != state->scale[0] || next->scale[1] != state->scale[1] ||
+           fabs(next->offset[0]-state->offset[0]) > scale_volts_per_div(next->probe[0], next->scale[0])/4 ||
+           fabs(next->offset[1]-state->offset[1]) > scale_volts_per_div(next->probe[1], next->scale[1])/4;
+}
@@ -0,0 +1,53 @@
+/*
+    Hantek 2D72 handheld oscillosope tool for linux
+    Copyright (C) 2021 Luca Oliva
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _AUTOSET_H
+#define _AUTOSET_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define AUTOSET_MAX_STEPS               10
+#define AUTOSET_SLOWEST_TIME            19 //10ms/div keeps every capture short
+#define AUTOSET_FRAMING                 6.0 //divisions the signal should span
+#define AUTOSET_PERIODS                 3.0 //periods on screen
+
+typedef struct {
+        int             min;
+        int             max;
+        bool            clipped;
+        int             crossings;      //rising crossings of the mid level
+        double          period;         //in samples, 0 if fewer than two crossings
+} autoset_meas_t;
+
+//The settings auto-setup works on; offsets and trigger level are in volts
+typedef struct {
+        bool            enable[2];
+        int             probe[2];
+        int             scale[2];
+        double          offset[2];
+        int             time_scale;
+        int             trigger_source;
+        double          trigger_level;
+        int             num_samples;
+} autoset_state_t;
+
+void autoset_measure(const uint8_t* frame, int num_samples, int num_channels, int slot, autoset_meas_t* meas);
+bool autoset_step(const autoset_state_t* state, const autoset_meas_t meas[2], autoset_state_t* next);
+
+#endif //_AUTOSET_H
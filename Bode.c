@@ -0,0 +1,121 @@
+/*
+    Hantek 2D72 handheld oscillosope tool for linux
+    Copyright (C) 2021 Luca Oliva
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <math.h>
+#include <string.h>
+
+#include "Bode.h"
+#include "Scale.h"
+
+//Fastest time scale that still fits BODE_MIN_CYCLES periods in the capture
+static int bode_time_scale(double frequency, int num_samples) {
+    for (int ts=0;ts<SCALE_NUM_TIME;ts++)
+        if ( num_samples/scale_sample_rate(ts) >= BODE_MIN_CYCLES/frequency )
+            return ts;
+    return SCALE_NUM_TIME-1;
+}
+
+//Log spaced points, rounded to the 1 Hz resolution of AWG_FREQ.
+//Returns the number of points, duplicates after rounding are dropped.
+int bode_plan(double start, double stop, int num_points, int num_samples, bode_point_t* points) {
+    int count = 0;
+
+    if ( start < 1 ) start = 1;
+    if ( stop < start ) stop = start;
+    if ( num_points > BODE_MAX_POINTS ) num_points = BODE_MAX_POINTS;
+    if ( num_points < 2 ) num_points = 2;
+
+    for (int i=0;i<num_points;i++) {
+        double frequency = round(start*pow(stop/start, (double)i/(num_points-1)));
+
+        if ( count > 0 && points[count-1].frequency == frequency )
+            continue;
+
+        memset(&points[count], 0, sizeof(points[count]));
+        points[count].frequency  = frequency;
+        points[count].time_scale = bode_time_scale(frequency, num_samples);
+        count++;
+    }
+
+    return count;
+}
+
+//Time from setting a point to the first capture that fully reflects it:
+//the stimulus settles, then a whole capture must be acquired at the new time scale
+double bode_settle_time(const bode_point_t* point, int num_samples, double min_settle) {
+    double settle = BODE_SETTLE_CYCLES/point->frequency;
+
+    if ( settle < min_settle )
+        settle = min_settle;
+
+    return settle + num_samples/scale_sample_rate(point->time_scale);
+}
+
+//Single bin DFT at the stimulus frequency on both channels of a two channel
+//frame. A Hann window keeps the leakage low when the capture does not hold
+//an integer number of periods.
+void bode_measure(bode_point_t* point, const uint8_t* frame, int num_samples, const double volts_per_div[2]) {
+    double w = 2*M_PI*point->frequency/scale_sample_rate(point->time_scale);
+    double re[2] = { 0, 0 }, im[2] = { 0, 0 };
+    double mean[2] = { 0, 0 };
+    double window_sum = 0;
+
+    for (int i=0;i<num_samples;i++) {
+        mean[0] += frame[2*i];
+        mean[1] += frame[2*i+1];
+    }
+    mean[0] /= num_samples;
+    mean[1] /= num_samples;
+
+    //Rotate phasors instead of calling sin/cos per sample, one at the
+    //stimulus frequency and one for the window
+    double c = cos(w), s = sin(w);
+    double wc = cos(2*M_PI/(num_samples-1)), ws = sin(2*M_PI/(num_samples-1));
+    double pr = 1, pi = 0;
+    double wr = 1, wi = 0;
+    for (int i=0;i<num_samples;i++) {
+        double window = 0.5-0.5*wr;
+        double x0 = (frame[2*i]-mean[0])*window;
+        double x1 = (frame[2*i+1]-mean[1])*window;
+        double t;
+
+        re[0] += x0*pr; im[0] -= x0*pi;
+        re[1] += x1*pr; im[1] -= x1*pi;
+        window_sum += window;
+
+        t  = pr*c - pi*s;
+        pi = pr*s + pi*c;
+        pr = t;
+
+        t  = wr*wc - wi*ws;
+        wi = wr*ws + wi*wc;
+        wr = t;
+    }
+
+    for (int ch=0;ch<2;ch++)
+        point->amplitude[ch] = 2*hypot(re[ch], im[ch])/window_sum*volts_per_div[ch]/SCALE_RAW_PER_DIV;
+
+    if ( point->amplitude[0] > 0 && point->amplitude[1] > 0 )
+        point->gain_db = 20*log10(point->amplitude[1]/point->amplitude[0]);
+    else
+        point->gain_db = -INFINITY;
+
+    point->phase_deg = (atan2(im[1], re[1]) - atan2(im[0], re[0]))*180/M_PI;
+    if ( point->phase_deg > 180 )   point->phase_deg -= 360;
+    if ( point->phase_deg <= -180 ) point->phase_deg += 360;
+}
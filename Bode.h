@@ -0,0 +1,40 @@
+/*
+    Hantek 2D72 handheld oscillosope tool for linux
+    Copyright (C) 2021 Luca Oliva
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _BODE_H
+#define _BODE_H
+
+#include <stdint.h>
+
+#define BODE_MAX_POINTS                 1000
+#define BODE_MIN_CYCLES                 4
+#define BODE_SETTLE_CYCLES              5
+
+typedef struct {
+        double  frequency;
+        int     time_scale;
+        double  amplitude[2];
+        double  gain_db;
+        double  phase_deg;
+} bode_point_t;
+
+int    bode_plan(double start, double stop, int num_points, int num_samples, bode_point_t* points);
+double bode_settle_time(const bode_point_t* point, int num_samples, double min_settle);
+void   bode_measure(bode_point_t* point, const uint8_t* frame, int num_samples, const double volts_per_div[2]);
+
+#endif //_BODE_H
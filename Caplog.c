@@ -0,0 +1,342 @@
+/*
+    Hantek 2D72 handheld oscillosope tool for linux
+    Copyright (C) 2021 Luca Oliva
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "Caplog.h"
+#include "Codec.h"
+
+static int64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec*1000000 + ts.tv_nsec/1000;
+}
+
+static void* caplog_worker(void* data) {
+    caplog_writer_t* log = data;
+
+    pthread_mutex_lock(&log->lock);
+    for (;;) {
+        caplog_slot_t* slot;
+        int64_t start;
+
+        while ( log->next == log->head && log->running )
+            pthread_cond_wait(&log->cond, &log->lock);
+        if ( log->next == log->head )
+            break;
+
+        slot = &log->slots[log->next++ % CAPLOG_SLOTS];
+        slot->state = CAPLOG_BUSY;
+        pthread_mutex_unlock(&log->lock);
+
+        start = now_us();
+        slot->header.size = codec_encode(slot->frame->data, slot->header.num_samples, slot->header.num_channels, slot->packed);
+        frame_unref(slot->frame);
+        slot->frame = NULL;
+
+        pthread_mutex_lock(&log->lock);
+        log->busy_us += now_us()-start;
+        slot->state = CAPLOG_DONE;
+        pthread_cond_broadcast(&log->cond);
+    }
+    pthread_mutex_unlock(&log->lock);
+
+    return NULL;
+}
+
+static int caplog_index_add(caplog_writer_t* log, uint64_t offset) {
+    if ( log->num_frames == log->cap_frames ) {
+        size_t cap = log->cap_frames ? 2*log->cap_frames : 4096;
+        uint64_t* index = realloc(log->index, cap*sizeof(uint64_t));
+        if ( index == NULL )
+            return -1;
+        log->index      = index;
+        log->cap_frames = cap;
+    }
+
+    log->index[log->num_frames++] = offset;
+    return 0;
+}
+
+static void* caplog_writer(void* data) {
+    caplog_writer_t* log = data;
+
+    pthread_mutex_lock(&log->lock);
+    for (;;) {
+        caplog_slot_t* slot = &log->slots[log->tail % CAPLOG_SLOTS];
+        size_t size;
+
+        while ( (log->tail == log->head || slot->state != CAPLOG_DONE) && (log->running || log->tail != log->head) )
+            pthread_cond_wait(&log->cond, &log->lock);
+        if ( log->tail == log->head )
+            break;
+        pthread_mutex_unlock(&log->lock);
+
+        size = sizeof(caplog_frame_t) + slot->header.size;
+        if ( fwrite(&slot->header, sizeof(caplog_frame_t), 1, log->file) != 1 ||
+             fwrite(slot->packed, 1, slot->header.size, log->file) != slot->header.size )
+            perror("caplog");
+
+        pthread_mutex_lock(&log->lock);
+        caplog_index_add(log, log->offset);
+        log->offset       += size;
+        log->raw_bytes    += (size_t)slot->header.num_samples*slot->header.num_channels;
+        log->packed_bytes += size;
+        slot->state = CAPLOG_FREE;
+        log->tail++;
+    }
+    pthread_mutex_unlock(&log->lock);
+
+    return NULL;
+}
+
+int caplog_open(caplog_writer_t* log, const char* path, int num_workers) {
+    memset(log, 0, sizeof(*log));
+
+    if ( num_workers < 1 )
+        num_workers = 1;
+    if ( num_workers > CAPLOG_MAX_THREADS )
+        num_workers = CAPLOG_MAX_THREADS;
+
+    log->slots = calloc(CAPLOG_SLOTS, sizeof(caplog_slot_t));
+    if ( log->slots == NULL )
+        return -1;
+
+    log->file = fopen(path, "wb");
+    if ( log->file == NULL ) {
+        perror(path);
+        free(log->slots);
+        return -1;
+    }
+    setvbuf(log->file, NULL, _IOFBF, 1 << 20);
+
+    fwrite(CAPLOG_MAGIC, 1, strlen(CAPLOG_MAGIC), log->file);
+    log->offset   = strlen(CAPLOG_MAGIC);
+    log->running  = true;
+    log->start_us = now_us();
+
+    pthread_mutex_init(&log->lock, NULL);
+    pthread_cond_init(&log->cond, NULL);
+
+    if ( pthread_create(&log->writer, NULL, caplog_writer, log) ) {
+        perror("caplog");
+        pthread_cond_destroy(&log->cond);
+        pthread_mutex_destroy(&log->lock);
+        fclose(log->file);
+        free(log->slots);
+        log->file  = NULL;
+        log->slots = NULL;
+        return -1;
+    }
+
+    //Whatever started is stopped again, leaving an empty but valid log
+    for (log->num_workers=0;log->num_workers<num_workers;log->num_workers++) {
+        if ( pthread_create(&log->workers[log->num_workers], NULL, caplog_worker, log) ) {
+            perror("caplog");
+            caplog_close(log);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+//Called by the acquisition thread, takes a reference to the frame and
+//returns at once
+bool caplog_push(caplog_writer_t* log, frame_t* frame) {
+    caplog_slot_t* slot;
+    size_t size = (size_t)frame->num_samples*frame->num_channels;
+
+    if ( size > CAPLOG_MAX_FRAME )
+        return false;
+
+    pthread_mutex_lock(&log->lock);
+    if ( log->head-log->tail >= CAPLOG_SLOTS ) {
+        log->dropped++;
+        pthread_mutex_unlock(&log->lock);
+        return false;
+    }
+    slot = &log->slots[log->head % CAPLOG_SLOTS];
+    pthread_mutex_unlock(&log->lock);
+
+    //The slot is ours until head moves past it
+    slot->frame               = frame_ref(frame);
+    slot->header.num_samples  = frame->num_samples;
+    slot->header.num_channels = frame->num_channels;
+    slot->header.enable       = frame->config.channel_enable[0] | frame->config.channel_enable[1] << 1;
+    slot->header.time_us      = frame->time_us;
+    slot->header.time_scale   = frame->config.time_scale;
+    for (int ch=0;ch<2;ch++) {
+        slot->header.probe[ch]  = frame->config.channel_probe[ch];
+        slot->header.scale[ch]  = frame->config.channel_scale[ch];
+        slot->header.offset[ch] = frame->config.channel_offset[ch];
+    }
+
+    pthread_mutex_lock(&log->lock);
+    slot->state = CAPLOG_FILLED;
+    log->head++;
+    pthread_cond_broadcast(&log->cond);
+    pthread_mutex_unlock(&log->lock);
+
+    return true;
+}
+
+void caplog_stats(caplog_writer_t* log, caplog_stats_t* stats) {
+    int64_t elapsed;
+
+    pthread_mutex_lock(&log->lock);
+    elapsed = now_us()-log->start_us;
+    stats->frames      = log->num_frames;
+    stats->dropped     = log->dropped;
+    stats->ratio       = log->packed_bytes ? (double)log->raw_bytes/log->packed_bytes : 0;
+    stats->thread_mbps = log->busy_us ? (double)log->raw_bytes/log->busy_us : 0;
+    stats->wall_mbps   = elapsed ? (double)log->raw_bytes/elapsed : 0;
+    pthread_mutex_unlock(&log->lock);
+}
+
+//Drains the queue, then appends the index and the trailer
+int caplog_close(caplog_writer_t* log) {
+    caplog_trailer_t trailer;
+    int status = 0;
+
+    if ( log->file == NULL )
+        return -1;
+
+    pthread_mutex_lock(&log->lock);
+    log->running = false;
+    pthread_cond_broadcast(&log->cond);
+    pthread_mutex_unlock(&log->lock);
+
+    for (int i=0;i<log->num_workers;i++)
+        pthread_join(log->workers[i], NULL);
+    pthread_join(log->writer, NULL);
+
+    trailer.index_offset = log->offset;
+    trailer.num_frames   = log->num_frames;
+    memcpy(trailer.magic, CAPLOG_INDEX_MAGIC, sizeof(trailer.magic));
+
+    if ( fwrite(log->index, sizeof(uint64_t), log->num_frames, log->file) != log->num_frames ||
+         fwrite(&trailer, sizeof(trailer), 1, log->file) != 1 )
+        status = -1;
+    if ( fclose(log->file) )
+        status = -1;
+
+    pthread_cond_destroy(&log->cond);
+    pthread_mutex_destroy(&log->lock);
+    free(log->slots);
+    free(log->index);
+    log->file  = NULL;
+    log->slots = NULL;
+    log->index = NULL;
+
+    return status;
+}
+
+//Without a trailer (the run was not closed) the index is rebuilt by
+//walking the frame headers
+static int caplog_reader_scan(caplog_reader_t* reader) {
+    caplog_frame_t header;
+    uint64_t offset = strlen(CAPLOG_MAGIC);
+    uint64_t end;
+    size_t cap = 0;
+
+    fseek(reader->file, 0, SEEK_END);
+    end = ftell(reader->file);
+
+    //A frame cut short by the end of the file is left out
+    fseek(reader->file, offset, SEEK_SET);
+    while ( fread(&header, sizeof(header), 1, reader->file) == 1 &&
+            header.size <= sizeof(reader->packed) &&
+            offset+sizeof(header)+header.size <= end &&
+            fseek(reader->file, header.size, SEEK_CUR) == 0 ) {
+        if ( reader->num_frames == cap ) {
+            uint64_t* index;
+            cap = cap ? 2*cap : 4096;
+            index = realloc(reader->index, cap*sizeof(uint64_t));
+            if ( index == NULL )
+                return -1;
+            reader->index = index;
+        }
+        reader->index[reader->num_frames++] = offset;
+        offset += sizeof(header)+header.size;
+    }
+
+    return 0;
+}
+
+int caplog_reader_open(caplog_reader_t* reader, const char* path) {
+    caplog_trailer_t trailer;
+    char magic[8];
+
+    reader->index      = NULL;
+    reader->num_frames = 0;
+
+    reader->file = fopen(path, "rb");
+    if ( reader->file == NULL ) {
+        perror(path);
+        return -1;
+    }
+
+    if ( fread(magic, sizeof(magic), 1, reader->file) != 1 || memcmp(magic, CAPLOG_MAGIC, sizeof(magic)) ) {
+        fprintf(stderr, "%s: not a capture log.\n", path);
+        fclose(reader->file);
+        return -1;
+    }
+
+    if ( fseek(reader->file, -(long)sizeof(trailer), SEEK_END) == 0 &&
+         fread(&trailer, sizeof(trailer), 1, reader->file) == 1 &&
+         !memcmp(trailer.magic, CAPLOG_INDEX_MAGIC, sizeof(trailer.magic)) ) {
+        reader->index = malloc(trailer.num_frames*sizeof(uint64_t));
+        if ( reader->index && fseek(reader->file, trailer.index_offset, SEEK_SET) == 0 &&
+             fread(reader->index, sizeof(uint64_t), trailer.num_frames, reader->file) == trailer.num_frames ) {
+            reader->num_frames = trailer.num_frames;
+            return 0;
+        }
+        free(reader->index);
+        reader->index = NULL;
+    }
+
+    return caplog_reader_scan(reader);
+}
+
+//Random access: one seek, one read and one decode per frame
+int caplog_reader_read(caplog_reader_t* reader, size_t index, caplog_frame_t* header, uint8_t* frame) {
+    if ( index >= reader->num_frames )
+        return -1;
+
+    if ( fseek(reader->file, reader->index[index], SEEK_SET) ||
+         fread(header, sizeof(*header), 1, reader->file) != 1 )
+        return -1;
+
+    if ( header->size > sizeof(reader->packed) || (size_t)header->num_samples*header->num_channels > CAPLOG_MAX_FRAME ||
+         fread(reader->packed, 1, header->size, reader->file) != header->size )
+        return -1;
+
+    return codec_decode(reader->packed, header->size, frame, header->num_samples, header->num_channels);
+}
+
+void caplog_reader_close(caplog_reader_t* reader) {
+    if ( reader->file )
+        fclose(reader->file);
+    free(reader->index);
+    reader->file       = NULL;
+    reader->index      = NULL;
+    reader->num_frames = 0;
+}
@@ -0,0 +1,123 @@
+/*
+    Hantek 2D72 handheld oscillosope tool for linux
+    Copyright (C) 2021 Luca Oliva
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _CAPLOG_H
+#define _CAPLOG_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <pthread.h>
+
+#include "Frame.h"
+
+#define CAPLOG_MAGIC                    "HCAPLOG2"
+#define CAPLOG_INDEX_MAGIC              "HCAPIDX1"
+#define CAPLOG_SLOTS                    64
+#define CAPLOG_MAX_THREADS              8
+#define CAPLOG_MAX_FRAME                6000
+
+//On disk every frame is a header followed by codec_encode() output. An index
+//of frame offsets and a trailer are appended on close. The header carries
+//the settings needed to turn the codes back into volts and seconds.
+typedef struct  __attribute__((packed)) {
+        uint32_t        size;
+        uint16_t        num_samples;
+        uint8_t         num_channels;
+        uint8_t         enable;
+        int64_t         time_us;
+        uint8_t         probe[2];
+        uint8_t         scale[2];
+        float           offset[2];
+        uint8_t         time_scale;
+} caplog_frame_t;
+
+typedef struct  __attribute__((packed)) {
+        uint64_t        index_offset;
+        uint64_t        num_frames;
+        char            magic[8];
+} caplog_trailer_t;
+
+enum {
+    CAPLOG_FREE,
+    CAPLOG_FILLED,
+    CAPLOG_BUSY,
+    CAPLOG_DONE
+};
+
+typedef struct {
+        int             state;
+        caplog_frame_t  header;
+        frame_t*        frame;
+        uint8_t         packed[CAPLOG_MAX_FRAME+64];
+} caplog_slot_t;
+
+//Frames are compressed by a pool of workers in any order and written in
+//arrival order by a single writer. A full ring drops the frame instead of
+//stalling acquisition; the count is kept in dropped.
+typedef struct {
+        FILE*           file;
+        caplog_slot_t*  slots;
+        uint64_t        head;
+        uint64_t        next;
+        uint64_t        tail;
+        bool            running;
+        pthread_mutex_t lock;
+        pthread_cond_t  cond;
+        pthread_t       workers[CAPLOG_MAX_THREADS];
+        int             num_workers;
+        pthread_t       writer;
+
+        uint64_t*       index;
+        size_t          num_frames;
+        size_t          cap_frames;
+        uint64_t        offset;
+
+        uint64_t        raw_bytes;
+        uint64_t        packed_bytes;
+        int64_t         busy_us;
+        int64_t         start_us;
+        uint64_t        dropped;
+} caplog_writer_t;
+
+typedef struct {
+        uint64_t        frames;
+        uint64_t        dropped;
+        double          ratio;
+        double          thread_mbps;    //per worker, while compressing
+        double          wall_mbps;      //raw data logged per second of run
+} caplog_stats_t;
+
+typedef struct {
+        FILE*           file;
+        uint64_t*       index;
+        size_t          num_frames;
+        uint8_t         packed[CAPLOG_MAX_FRAME+64];
+} caplog_reader_t;
+
+int  caplog_open(caplog_writer_t* log, const char* path, int num_workers);
+bool caplog_push(caplog_writer_t* log, frame_t* frame);
+void caplog_stats(caplog_writer_t* log, caplog_stats_t* stats);
+int  caplog_close(caplog_writer_t* log);
+
+int  caplog_reader_open(caplog_reader_t* reader, const char* path);
+int  caplog_reader_read(caplog_reader_t* reader, size_t index, caplog_frame_t* header, uint8_t* frame);
+void caplog_reader_close(caplog_reader_t* reader);
+
+#endif //_CAPLOG_H
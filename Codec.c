@@ -0,0 +1,233 @@
+/*
+    Hantek 2D72 handheld oscillosope tool for linux
+    Copyright (C) 2021 Luca Oliva
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+
+#include "Codec.h"
+
+//Partition codes, 4 bits each: 0..7 Rice parameter, then
+#define CODEC_RAW                       8
+#define CODEC_ZERO                      9
+
+typedef struct {
+        uint8_t*        out;
+        size_t          pos;
+        uint64_t        acc;
+        int             bits;
+} bit_writer_t;
+
+typedef struct {
+        const uint8_t*  in;
+        size_t          length;
+        size_t          pos;
+        uint64_t        acc;
+        int             bits;
+} bit_reader_t;
+
+static inline void put_bits(bit_writer_t* bw, uint32_t value, int n) {
+    bw->acc   = bw->acc << n | value;
+    bw->bits += n;
+    while ( bw->bits >= 8 ) {
+        bw->bits -= 8;
+        bw->out[bw->pos++] = bw->acc >> bw->bits;
+    }
+}
+
+static inline void put_rice(bit_writer_t* bw, uint32_t value, int k) {
+    uint32_t q = value >> k;
+
+    //Quotient in unary, the terminating 1 and the remainder in one go
+    if ( q+1+k <= 32 ) {
+        put_bits(bw, (1u << k) | (value & ((1u << k)-1)), q+1+k);
+        return;
+    }
+
+    while ( q >= 32 ) {
+        put_bits(bw, 0, 32);
+        q -= 32;
+    }
+    put_bits(bw, 1, q+1);
+    if ( k )
+        put_bits(bw, value & ((1u << k)-1), k);
+}
+
+//The accumulator is kept MSB aligned, bytes past the end read as zero
+static inline void refill(bit_reader_t* br) {
+    while ( br->bits <= 56 ) {
+        uint64_t byte = br->pos < br->length ? br->in[br->pos] : 0;
+        br->acc  |= byte << (56-br->bits);
+        br->bits += 8;
+        br->pos++;
+    }
+}
+
+static inline uint32_t get_bits(bit_reader_t* br, int n) {
+    uint32_t value;
+
+    if ( n == 0 )
+        return 0;
+    refill(br);
+    value = br->acc >> (64-n);
+    br->acc <<= n;
+    br->bits -= n;
+    return value;
+}
+
+static inline int get_rice(bit_reader_t* br, int k, uint32_t* value) {
+    uint32_t q = 0;
+    int zeros;
+
+    refill(br);
+    while ( br->acc == 0 ) {
+        q += br->bits;
+        br->bits = 0;
+        if ( br->pos > br->length+8 )
+            return -1;
+        refill(br);
+    }
+
+    zeros = __builtin_clzll(br->acc);
+    q += zeros;
+    br->acc <<= zeros+1;
+    br->bits -= zeros+1;
+
+    *value = q << k | get_bits(br, k);
+    return 0;
+}
+
+static inline uint8_t zigzag(uint8_t delta) {
+    return (uint8_t)(delta << 1) ^ (uint8_t)((int8_t)delta >> 7);
+}
+
+static inline uint8_t unzigzag(uint32_t value) {
+    return (value >> 1) ^ -(value & 1);
+}
+
+size_t codec_bound(int num_samples, int num_channels) {
+    int partitions = (num_samples+CODEC_PARTITION-1)/CODEC_PARTITION;
+    return (size_t)num_channels*(1 + num_samples + partitions) + 8;
+}
+
+static void encode_channel(bit_writer_t* bw, const uint8_t* frame, int num_samples, int num_channels) {
+    uint8_t prev = frame[0];
+    uint8_t z[CODEC_PARTITION];
+
+    put_bits(bw, prev, 8);
+
+    for (int first=0;first<num_samples;first+=CODEC_PARTITION) {
+        int count = num_samples-first < CODEC_PARTITION ? num_samples-first : CODEC_PARTITION;
+        uint32_t sum = 0, best = 8*count;
+        int code = CODEC_RAW, guess = 0;
+
+        for (int i=0;i<count;i++) {
+            uint8_t cur = frame[(size_t)(first+i)*num_channels];
+            z[i] = zigzag(cur-prev);
+            sum += z[i];
+            prev = cur;
+        }
+
+        if ( sum == 0 ) {
+            put_bits(bw, CODEC_ZERO, 4);
+            continue;
+        }
+
+        //The mean gives the parameter to within one, the exact cost settles it
+        while ( guess < 7 && (uint32_t)count << (guess+1) <= sum )
+            guess++;
+        for (int k=guess>0?guess-1:0;k<=guess+1 && k<8;k++) {
+            uint32_t cost = count*(1+k);
+            for (int i=0;i<count;i++)
+                cost += z[i] >> k;
+            if ( cost < best ) {
+                best = cost;
+                code = k;
+            }
+        }
+
+        put_bits(bw, code, 4);
+        if ( code == CODEC_RAW ) {
+            for (int i=0;i<count;i++)
+                put_bits(bw, z[i], 8);
+        } else {
+            for (int i=0;i<count;i++)
+                put_rice(bw, z[i], code);
+        }
+    }
+}
+
+//Returns the encoded size, out must hold codec_bound() bytes
+size_t codec_encode(const uint8_t* frame, int num_samples, int num_channels, uint8_t* out) {
+    bit_writer_t bw = { out, 0, 0, 0 };
+
+    if ( num_samples <= 0 )
+        return 0;
+
+    for (int ch=0;ch<num_channels;ch++)
+        encode_channel(&bw, frame+ch, num_samples, num_channels);
+
+    if ( bw.bits )
+        put_bits(&bw, 0, 8-bw.bits);
+
+    return bw.pos;
+}
+
+static int decode_channel(bit_reader_t* br, uint8_t* frame, int num_samples, int num_channels) {
+    uint8_t prev = get_bits(br, 8);
+
+    for (int first=0;first<num_samples;first+=CODEC_PARTITION) {
+        int count = num_samples-first < CODEC_PARTITION ? num_samples-first : CODEC_PARTITION;
+        uint8_t* dst = frame+(size_t)first*num_channels;
+        int code = get_bits(br, 4);
+
+        if ( code == CODEC_ZERO ) {
+            for (int i=0;i<count;i++)
+                dst[(size_t)i*num_channels] = prev;
+        } else if ( code == CODEC_RAW ) {
+            for (int i=0;i<count;i++) {
+                prev += unzigzag(get_bits(br, 8));
+                dst[(size_t)i*num_channels] = prev;
+            }
+        } else if ( code < 8 ) {
+            for (int i=0;i<count;i++) {
+                uint32_t value;
+                if ( get_rice(br, code, &value) || value > 0xFF )
+                    return -1;
+                prev += unzigzag(value);
+                dst[(size_t)i*num_channels] = prev;
+            }
+        } else {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+int codec_decode(const uint8_t* in, size_t length, uint8_t* frame, int num_samples, int num_channels) {
+    bit_reader_t br = { in, length, 0, 0, 0 };
+
+    for (int ch=0;ch<num_channels;ch++)
+        if ( decode_channel(&br, frame+ch, num_samples, num_channels) )
+            return -1;
+
+    //Bytes actually consumed must fit in the input
+    if ( br.pos - br.bits/8 > length )
+        return -1;
+
+    return 0;
+}
@@ -0,0 +1,34 @@
+/*
+    Hantek 2D72 handheld oscillosope tool for linux
+    Copyright (C) 2021 Luca Oliva
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _CODEC_H
+#define _CODEC_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+//Lossless frame codec: each channel is delta coded, then the zigzagged
+//deltas are Rice coded in partitions of CODEC_PARTITION samples with the
+//best parameter for each partition.
+#define CODEC_PARTITION                 256
+
+size_t codec_bound(int num_samples, int num_channels);
+size_t codec_encode(const uint8_t* frame, int num_samples, int num_channels, uint8_t* out);
+int    codec_decode(const uint8_t* in, size_t length, uint8_t* frame, int num_samples, int num_channels);
+
+#endif //_CODEC_H
@@ -0,0 +1,142 @@
+/*
+    Hantek 2D72 handheld oscillosope tool for linux
+    Copyright (C) 2021 Luca Oliva
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "Config.h"
+
+static void* config_flusher(void* data) {
+    config_store_t* store = data;
+
+    pthread_mutex_lock(&store->lock);
+    for (;;) {
+        struct timespec deadline;
+        config_t config;
+
+        while ( !store->dirty && store->running )
+            pthread_cond_wait(&store->cond, &store->lock);
+        if ( !store->dirty )
+            break;
+
+        //Let a burst of changes settle into one write
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += CONFIG_FLUSH_MS/1000;
+        deadline.tv_nsec += (CONFIG_FLUSH_MS%1000)*1000000L;
+        if ( deadline.tv_nsec >= 1000000000 ) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000;
+        }
+        while ( store->running && pthread_cond_timedwait(&store->cond, &store->lock, &deadline) == 0 )
+            ;
+
+        store->dirty = false;
+        pthread_mutex_unlock(&store->lock);
+
+        config_read(store, &config);
+        if ( store->fd >= 0 && pwrite(store->fd, &config, sizeof(config), 0) != sizeof(config) )
+            perror("config");
+
+        pthread_mutex_lock(&store->lock);
+    }
+    pthread_mutex_unlock(&store->lock);
+
+    return NULL;
+}
+
+//Loads path into working, or defaults when it holds no complete config. On
+//failure to open the file settings still work, they are just not kept.
+int config_open(config_store_t* store, const char* path, const config_t* defaults, config_t* working) {
+    int status = 0;
+
+    memset(store, 0, sizeof(*store));
+    store->current = *defaults;
+
+    store->fd = open(path, O_RDWR | O_CREAT, 0666);
+    if ( store->fd < 0 ) {
+        perror(path);
+        status = -1;
+    } else if ( pread(store->fd, &store->current, sizeof(config_t), 0) != sizeof(config_t) ) {
+        store->current = *defaults;
+        store->dirty   = true;
+    }
+    *working = store->current;
+
+    store->running = true;
+    pthread_mutex_init(&store->lock, NULL);
+    pthread_cond_init(&store->cond, NULL);
+    if ( pthread_create(&store->flusher, NULL, config_flusher, store) ) {
+        perror("config");
+        store->running = false;
+        if ( store->fd >= 0 )
+            close(store->fd);
+        store->fd = -1;
+        status = -1;
+    }
+
+    return status;
+}
+
+//Only one thread may publish. The sequence is odd while the copy is being
+//replaced, which readers notice and retry.
+void config_publish(config_store_t* store, const config_t* config) {
+    unsigned int sequence = store->sequence;
+
+    __atomic_store_n(&store->sequence, sequence+1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(&store->current, config, sizeof(config_t));
+    __atomic_store_n(&store->sequence, sequence+2, __ATOMIC_RELEASE);
+
+    pthread_mutex_lock(&store->lock);
+    store->dirty = true;
+    pthread_cond_signal(&store->cond);
+    pthread_mutex_unlock(&store->lock);
+}
+
+//A consistent copy of the last published config, without taking a lock
+unsigned int config_read(const config_store_t* store, config_t* config) {
+    unsigned int sequence;
+
+    do {
+        while ( (sequence = __atomic_load_n(&store->sequence, __ATOMIC_ACQUIRE)) & 1 )
+            ;
+        memcpy(config, &store->current, sizeof(config_t));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while ( sequence != __atomic_load_n(&store->sequence, __ATOMIC_RELAXED) );
+
+    return sequence/2;
+}
+
+//Writes out what is still pending. Without a flusher there is no file.
+void config_close(config_store_t* store) {
+    if ( store->running ) {
+        pthread_mutex_lock(&store->lock);
+        store->running = false;
+        pthread_cond_signal(&store->cond);
+        pthread_mutex_unlock(&store->lock);
+        pthread_join(store->flusher, NULL);
+    }
+
+    pthread_cond_destroy(&store->cond);
+    pthread_mutex_destroy(&store->lock);
+    if ( store->fd >= 0 )
+        close(store->fd);
+}
@@ -0,0 +1,76 @@
+/*
+    Hantek 2D72 handheld oscillosope tool for linux
+    Copyright (C) 2021 Luca Oliva
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _CONFIG_H
+#define _CONFIG_H
+
+#include <stdbool.h>
+#include <pthread.h>
+
+#define CONFIG_FLUSH_MS                 1000
+
+typedef struct {
+        bool    channel_enable[2];
+        int     channel_coupling[2];
+        int     channel_probe[2];
+        int     channel_scale[2];
+        float   channel_offset[2];
+        bool    channel_bwlimit[2];
+
+        int     time_scale;
+        float   time_offset;
+
+        int     trigger_source;
+        int     trigger_slope;
+        int     trigger_mode;
+        float   trigger_level;                        
+
+        int     awg_type;
+        float   awg_frequency;
+        float   awg_amplitude;
+        float   awg_offset;
+        float   awg_squareduty;
+        float   awg_rampduty;
+        float   awg_trapriseduty;
+        float   awg_traphighduty;
+        float   awg_trapfallduty;
+
+        int     num_samples;
+} config_t;
+
+//The settings as last published by the GTK thread. Any thread may take a
+//copy through the seqlock; the file is rewritten in the background at most
+//once per CONFIG_FLUSH_MS.
+typedef struct {
+        unsigned int    sequence;
+        config_t        current;
+
+        int             fd;
+        bool            dirty;
+        bool            running;
+        pthread_t       flusher;
+        pthread_mutex_t lock;
+        pthread_cond_t  cond;
+} config_store_t;
+
+int          config_open(config_store_t* store, const char* path, const config_t* defaults, config_t* working);
+void         config_publish(config_store_t* store, const config_t* config);
+unsigned int config_read(const config_store_t* store, config_t* config);
+void         config_close(config_store_t* store);
+
+#endif //_CONFIG_H
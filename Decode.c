@@ -0,0 +1,261 @@
+/*
+    Hantek 2D72 handheld oscillosope tool for linux
+    Copyright (C) 2021 Luca Oliva
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "Decode.h"
+
+enum {
+    UART_IDLE,
+    UART_START,
+    UART_DATA,
+    UART_STOP,
+    UART_BREAK
+};
+
+enum {
+    I2C_IDLE,
+    I2C_ADDRESS,
+    I2C_DATA
+};
+
+void decoder_init(decoder_t* decoder) {
+    memset(decoder, 0, sizeof(*decoder));
+
+    decoder->protocol        = DECODE_NONE;
+    decoder->samples_per_bit = 10;
+    decoder->spi_bits        = 8;
+    decoder->spi_timeout     = 1000;
+
+    decoder_set_threshold(decoder, 0, 130, 6);
+    decoder_set_threshold(decoder, 1, 130, 6);
+}
+
+void decoder_free(decoder_t* decoder) {
+    free(decoder->anns);
+    decoder->anns     = NULL;
+    decoder->num_anns = 0;
+    decoder->cap_anns = 0;
+}
+
+void decoder_reset(decoder_t* decoder) {
+    decoder->position = 0;
+    decoder->state    = 0;
+    decoder->bit      = 0;
+    decoder->shift    = 0;
+    decoder->num_anns = 0;
+}
+
+void decoder_set_threshold(decoder_t* decoder, int ch, int threshold, int hysteresis) {
+    for (int raw=0;raw<256;raw++) {
+        decoder->lut[ch][0][raw] = raw >= threshold+hysteresis;
+        decoder->lut[ch][1][raw] = raw >  threshold-hysteresis;
+    }
+}
+
+static void decoder_add(decoder_t* decoder, size_t start, size_t end, uint16_t value, uint8_t type, uint8_t flags) {
+    if ( decoder->num_anns == decoder->cap_anns ) {
+        size_t cap = decoder->cap_anns ? 2*decoder->cap_anns : 256;
+        decode_ann_t* anns = realloc(decoder->anns, cap*sizeof(decode_ann_t));
+        if ( anns == NULL )
+            return;
+        decoder->anns     = anns;
+        decoder->cap_anns = cap;
+    }
+
+    decoder->anns[decoder->num_anns++] = (decode_ann_t){ start, end, value, type, flags };
+}
+
+//8N1, sampled in the middle of each bit
+static void decode_uart(decoder_t* d, const uint8_t* const data[2], size_t length) {
+    int ch = d->uart_channel;
+    const uint8_t* in = data[ch];
+    const uint8_t (*lut)[256] = d->lut[ch];
+    double spb = d->samples_per_bit;
+    uint8_t level = d->level[ch];
+
+    for (size_t i=d->position;i<length;i++) {
+        uint8_t prev = level;
+        level = lut[level][in[i]];
+
+        switch (d->state) {
+            case UART_IDLE:
+                if ( prev && !level ) {
+                    d->start = i;
+                    d->next  = i + spb/2;
+                    d->state = UART_START;
+                }
+                break;
+            case UART_START:
+                if ( i >= d->next ) {
+                    if ( level ) {
+                        d->state = UART_IDLE;
+                    } else {
+                        d->next += spb;
+                        d->bit   = 0;
+                        d->shift = 0;
+                        d->state = UART_DATA;
+                    }
+                }
+                break;
+            case UART_DATA:
+                if ( i >= d->next ) {
+                    d->shift |= level << d->bit;
+                    d->next  += spb;
+                    if ( ++d->bit == 8 )
+                        d->state = UART_STOP;
+                }
+                break;
+            case UART_STOP:
+                if ( i >= d->next ) {
+                    decoder_add(d, d->start, i + spb/2, d->shift, ANN_DATA, level ? 0 : ANN_FLAG_ERROR);
+                    d->state = level ? UART_IDLE : UART_BREAK;
+                }
+                break;
+            case UART_BREAK:
+                if ( level )
+                    d->state = UART_IDLE;
+                break;
+        }
+    }
+
+    d->level[ch] = level;
+}
+
+static void decode_i2c(decoder_t* d, const uint8_t* const data[2], size_t length) {
+    uint8_t scl = d->level[0], sda = d->level[1];
+
+    for (size_t i=d->position;i<length;i++) {
+        uint8_t prev_scl = scl, prev_sda = sda;
+        scl = d->lut[0][scl][data[0][i]];
+        sda = d->lut[1][sda][data[1][i]];
+
+        if ( prev_scl && scl ) {
+            if ( prev_sda && !sda ) {
+                decoder_add(d, i, i, 0, ANN_START, 0);
+                d->state = I2C_ADDRESS;
+                d->bit   = 0;
+                d->shift = 0;
+            } else if ( !prev_sda && sda && d->state != I2C_IDLE ) {
+                decoder_add(d, i, i, 0, ANN_STOP, 0);
+                d->state = I2C_IDLE;
+            }
+        } else if ( !prev_scl && scl && d->state != I2C_IDLE ) {
+            if ( d->bit == 0 )
+                d->start = i;
+
+            if ( d->bit < 8 ) {
+                d->shift = d->shift << 1 | sda;
+                d->bit++;
+            } else {
+                uint8_t flags = sda ? ANN_FLAG_NACK : 0;
+
+                if ( d->state == I2C_ADDRESS ) {
+                    if ( d->shift & 1 )
+                        flags |= ANN_FLAG_READ;
+                    decoder_add(d, d->start, i, d->shift >> 1, ANN_ADDRESS, flags);
+                } else {
+                    decoder_add(d, d->start, i, d->shift, ANN_DATA, flags);
+                }
+
+                d->state = I2C_DATA;
+                d->bit   = 0;
+                d->shift = 0;
+            }
+        }
+    }
+
+    d->level[0] = scl;
+    d->level[1] = sda;
+}
+
+//Without a chip select, words are framed by spi_bits and resynchronised
+//when the clock stays idle longer than spi_timeout samples
+static void decode_spi(decoder_t* d, const uint8_t* const data[2], size_t length) {
+    uint8_t clk = d->level[0], dat = d->level[1];
+
+    for (size_t i=d->position;i<length;i++) {
+        uint8_t prev_clk = clk;
+        clk = d->lut[0][clk][data[0][i]];
+        dat = d->lut[1][dat][data[1][i]];
+
+        if ( prev_clk == clk || clk == d->spi_falling )
+            continue;
+
+        if ( d->bit > 0 && i - d->last_edge > d->spi_timeout )
+            d->bit = 0;
+        if ( d->bit == 0 ) {
+            d->start = i;
+            d->shift = 0;
+        }
+
+        d->shift     = d->shift << 1 | dat;
+        d->last_edge = i;
+
+        if ( ++d->bit == d->spi_bits ) {
+            decoder_add(d, d->start, i, d->shift, ANN_DATA, 0);
+            d->bit = 0;
+        }
+    }
+
+    d->level[0] = clk;
+    d->level[1] = dat;
+}
+
+//Decodes the samples appended since the previous call
+void decoder_run(decoder_t* decoder, const uint8_t* ch1, const uint8_t* ch2, size_t length) {
+    const uint8_t* const data[2] = { ch1, ch2 };
+
+    if ( decoder->position >= length )
+        return;
+
+    if ( decoder->position == 0 ) {
+        decoder->level[0] = decoder->lut[0][1][ch1[0]];
+        decoder->level[1] = decoder->lut[1][1][ch2[0]];
+    }
+
+    switch (decoder->protocol) {
+        case DECODE_UART:
+            decode_uart(decoder, data, length);
+            break;
+        case DECODE_I2C:
+            decode_i2c(decoder, data, length);
+            break;
+        case DECODE_SPI:
+            decode_spi(decoder, data, length);
+            break;
+    }
+
+    decoder->position = length;
+}
+
+//Index of the first annotation ending at or after sample
+size_t decoder_find(const decoder_t* decoder, size_t sample) {
+    size_t lo = 0, hi = decoder->num_anns;
+
+    while ( lo < hi ) {
+        size_t mid = (lo+hi)/2;
+        if ( decoder->anns[mid].end < sample )
+            lo = mid+1;
+        else
+            hi = mid;
+    }
+
+    return lo;
+}
@@ -0,0 +1,89 @@
+/*
+    Hantek 2D72 handheld oscillosope tool for linux
+    Copyright (C) 2021 Luca Oliva
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _DECODE_H
+#define _DECODE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+enum {
+    DECODE_NONE,
+    DECODE_UART,
+    DECODE_I2C,
+    DECODE_SPI
+};
+
+enum {
+    ANN_DATA,
+    ANN_ADDRESS,
+    ANN_START,
+    ANN_STOP
+};
+
+#define ANN_FLAG_NACK                   0x01
+#define ANN_FLAG_ERROR                  0x02
+#define ANN_FLAG_READ                   0x04
+
+typedef struct {
+        size_t   start;
+        size_t   end;
+        uint16_t value;
+        uint8_t  type;
+        uint8_t  flags;
+} decode_ann_t;
+
+//Decoders keep their state between calls and only look at samples from
+//position onwards. UART reads uart_channel, I2C is SCL=CH1 SDA=CH2,
+//SPI is CLK=CH1 DATA=CH2 MSB first.
+typedef struct {
+        int             protocol;
+
+        //lut[ch][level][raw] is the next logic level, thresholds with hysteresis
+        uint8_t         lut[2][2][256];
+
+        double          samples_per_bit;
+        int             uart_channel;
+        int             spi_bits;
+        int             spi_falling;
+        size_t          spi_timeout;
+
+        size_t          position;
+        uint8_t         level[2];
+        int             state;
+        int             bit;
+        uint16_t        shift;
+        size_t          start;
+        double          next;
+        size_t          last_edge;
+
+        decode_ann_t*   anns;
+        size_t          num_anns;
+        size_t          cap_anns;
+} decoder_t;
+
+void   decoder_init(decoder_t* decoder);
+void   decoder_free(decoder_t* decoder);
+void   decoder_reset(decoder_t* decoder);
+void   decoder_set_threshold(decoder_t* decoder, int ch, int threshold, int hysteresis);
+
+void   decoder_run(decoder_t* decoder, const uint8_t* ch1, const uint8_t* ch2, size_t length);
+size_t decoder_find(const decoder_t* decoder, size_t sample);
+
+#endif //_DECODE_H
@@ -0,0 +1,395 @@
+/*
+    Hantek 2D72 handheld oscillosope tool for linux
+    Copyright (C) 2021 Luca Oliva
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "Derived.h"
+#include "Scale.h"
+
+#define DERIVED_FIR_BLOCK               4096
+
+void derived_init(derived_t* derived) {
+    memset(derived, 0, sizeof(*derived));
+    derived->generation = 1;
+}
+
+void derived_free(derived_t* derived) {
+    for (int i=0;i<DERIVED_SOURCES;i++) {
+        free(derived->channels[i].data);
+        for (int k=0;k<DERIVED_LEVELS;k++) {
+            free(derived->channels[i].levels[k]);
+            derived->channels[i].levels[k] = NULL;
+        }
+        derived->channels[i].data     = NULL;
+        derived->channels[i].capacity = 0;
+        derived->channels[i].valid    = 0;
+    }
+}
+
+//Anything that changes samples already seen starts every cache over
+void derived_set_input(derived_t* derived, const uint8_t* ch1, const uint8_t* ch2, size_t length, unsigned int generation,
+                       double sample_rate, const double volts_per_div[2], const double offset[2]) {
+    float lut[2][256];
+
+    for (int ch=0;ch<2;ch++)
+        for (int raw=0;raw<256;raw++)
+            lut[ch][raw] = scale_raw_to_volts(raw, volts_per_div[ch], offset[ch]);
+
+    if ( generation != derived->input_generation || length < derived->length ||
+         sample_rate != derived->sample_rate || memcmp(lut, derived->lut, sizeof(lut)) ) {
+        memcpy(derived->lut, lut, sizeof(lut));
+        derived->input_generation = generation;
+        derived->sample_rate      = sample_rate;
+        derived->generation++;
+    }
+
+    derived->raw[0] = ch1;
+    derived->raw[1] = ch2;
+    derived->length = length;
+}
+
+int derived_configure(derived_t* derived, int index, int op, int src_a, int src_b,
+                      int filter, double f1, double f2, int size) {
+    derived_channel_t* channel;
+
+    if ( index < 0 || index >= DERIVED_MAX )
+        return -1;
+    channel = &derived->channels[2+index];
+
+    //Only earlier sources, so there can be no loops
+    if ( src_a < 0 || src_a >= 2+index || src_b < 0 || src_b >= 2+index )
+        return -1;
+
+    channel->op     = op;
+    channel->src[0] = src_a;
+    channel->src[1] = src_b;
+    channel->filter = filter;
+    channel->f1     = f1;
+    channel->f2     = f2;
+    channel->size   = size;
+
+    derived->generation++;
+    return 0;
+}
+
+//Windowed sinc, Hamming window
+static void design_lowpass_taps(double fc, int num_taps, double* h) {
+    int m = num_taps/2;
+    double sum = 0;
+
+    for (int n=0;n<num_taps;n++) {
+        double x = n-m;
+        double w = 0.54 - 0.46*cos(2*M_PI*n/(num_taps-1));
+        h[n] = (x == 0 ? 2*fc : sin(2*M_PI*fc*x)/(M_PI*x))*w;
+        sum += h[n];
+    }
+    for (int n=0;n<num_taps;n++)
+        h[n] /= sum;
+}
+
+static void design_fir(derived_channel_t* channel, double sample_rate) {
+    double lo[DERIVED_MAX_TAPS], hi[DERIVED_MAX_TAPS];
+    int num_taps = channel->size | 1;
+    double f1 = fmin(fmax(channel->f1/sample_rate, 1e-6), 0.499);
+    double f2 = fmin(fmax(channel->f2/sample_rate, 1e-6), 0.499);
+
+    if ( num_taps > DERIVED_MAX_TAPS )
+        num_taps = DERIVED_MAX_TAPS;
+    if ( num_taps < 3 )
+        num_taps = 3;
+
+    design_lowpass_taps(f1, num_taps, lo);
+    design_lowpass_taps(f2, num_taps, hi);
+
+    for (int n=0;n<num_taps;n++) {
+        double delta = n == num_taps/2;
+        switch (channel->filter) {
+            case FILTER_LOWPASS:  channel->taps[n] = lo[n];         break;
+            case FILTER_HIGHPASS: channel->taps[n] = delta - lo[n]; break;
+            default:              channel->taps[n] = hi[n] - lo[n]; break;
+        }
+    }
+    channel->num_taps = num_taps;
+}
+
+//RBJ cookbook sections with Butterworth Q values
+static void add_butterworth(derived_channel_t* channel, bool highpass, double f, int order) {
+    double w0 = 2*M_PI*fmin(fmax(f, 1e-6), 0.499);
+    double c = cos(w0);
+
+    for (int k=0;k<order/2 && channel->num_stages<DERIVED_MAX_STAGES;k++) {
+        biquad_t* s = &channel->stages[channel->num_stages++];
+        double q = 1/(2*cos((2*k+1)*M_PI/(2*order)));
+        double alpha = sin(w0)/(2*q);
+        double a0 = 1+alpha;
+
+        memset(s, 0, sizeof(*s));
+        s->b1 = (highpass ? -(1+c) : 1-c)/a0;
+        s->b0 = s->b2 = (highpass ? (1+c) : (1-c))/2/a0;
+        s->a1 = -2*c/a0;
+        s->a2 = (1-alpha)/a0;
+    }
+}
+
+static void design_iir(derived_channel_t* channel, double sample_rate) {
+    int order = (channel->size+1) & ~1;
+
+    if ( order < 2 )
+        order = 2;
+    if ( order > DERIVED_MAX_ORDER )
+        order = DERIVED_MAX_ORDER;
+
+    channel->num_stages = 0;
+    switch (channel->filter) {
+        case FILTER_LOWPASS:
+            add_butterworth(channel, false, channel->f1/sample_rate, order);
+            break;
+        case FILTER_HIGHPASS:
+            add_butterworth(channel, true, channel->f1/sample_rate, order);
+            break;
+        default:
+            add_butterworth(channel, true, channel->f1/sample_rate, order);
+            add_butterworth(channel, false, channel->f2/sample_rate, order);
+            break;
+    }
+}
+
+static int reserve(derived_channel_t* channel, size_t length) {
+    if ( length > channel->capacity ) {
+        size_t capacity = channel->capacity ? channel->capacity : 4096;
+        float* data;
+
+        while ( capacity < length )
+            capacity *= 2;
+        data = realloc(channel->data, capacity*sizeof(float));
+        if ( data == NULL )
+            return -1;
+        channel->data = data;
+
+        for (int k=0;k<DERIVED_LEVELS && (capacity >> (k+DERIVED_SPAN_SHIFT)) > 0;k++) {
+            derived_span_t* level = realloc(channel->levels[k], (capacity >> (k+DERIVED_SPAN_SHIFT))*sizeof(derived_span_t));
+            if ( level == NULL )
+                return -1;
+            channel->levels[k] = level;
+        }
+        channel->capacity = capacity;
+    }
+    return 0;
+}
+
+static inline void span_merge(derived_span_t* span, derived_span_t other) {
+    span->min = fminf(span->min, other.min);
+    span->max = fmaxf(span->max, other.max);
+}
+
+//Buckets touched by [first, last) are rebuilt, so the cost follows the new
+//samples like the output itself
+static void index_update(derived_channel_t* channel, size_t first, size_t last) {
+    const float* y = channel->data;
+
+    for (size_t b=first >> DERIVED_SPAN_SHIFT;b<(last >> DERIVED_SPAN_SHIFT);b++) {
+        derived_span_t span = { INFINITY, -INFINITY };
+
+        for (size_t i=b << DERIVED_SPAN_SHIFT;i<(b+1) << DERIVED_SPAN_SHIFT;i++) {
+            span.min = fminf(span.min, y[i]);
+            span.max = fmaxf(span.max, y[i]);
+        }
+        channel->levels[0][b] = span;
+    }
+
+    for (int k=1;k<DERIVED_LEVELS && (last >> (k+DERIVED_SPAN_SHIFT)) > 0;k++) {
+        derived_span_t* level = channel->levels[k];
+        derived_span_t* below = channel->levels[k-1];
+
+        for (size_t b=first >> (k+DERIVED_SPAN_SHIFT);b<(last >> (k+DERIVED_SPAN_SHIFT));b++) {
+            derived_span_t span = below[2*b];
+            span_merge(&span, below[2*b+1]);
+            level[b] = span;
+        }
+    }
+}
+
+//y[i] = sum h[k] x[i-k], one tap at a time over a block so the inner loop
+//is a plain multiply-add over contiguous floats
+static void fir_run(const float* restrict h, int num_taps, const float* restrict x, float* restrict y, size_t first, size_t last) {
+    for (size_t start=first;start<last;start+=DERIVED_FIR_BLOCK) {
+        size_t end = last-start < DERIVED_FIR_BLOCK ? last : start+DERIVED_FIR_BLOCK;
+
+        for (size_t i=start;i<end;i++)
+            y[i] = 0;
+
+        for (int k=0;k<num_taps;k++) {
+            const float hk = h[k];
+            size_t from = start > (size_t)k ? start : (size_t)k;
+            const float* restrict xs = x-k;
+
+            for (size_t i=from;i<end;i++)
+                y[i] += hk*xs[i];
+        }
+    }
+}
+
+static void iir_run(biquad_t* stages, int num_stages, const float* restrict x, float* restrict y, size_t first, size_t last) {
+    for (size_t i=first;i<last;i++)
+        y[i] = x[i];
+
+    //The recursion is serial in time, stages are run one after the other
+    for (int k=0;k<num_stages;k++) {
+        biquad_t s = stages[k];
+
+        for (size_t i=first;i<last;i++) {
+            double in  = y[i];
+            double out = s.b0*in + s.b1*s.x1 + s.b2*s.x2 - s.a1*s.y1 - s.a2*s.y2;
+            s.x2 = s.x1;
+            s.x1 = in;
+            s.y2 = s.y1;
+            s.y1 = out;
+            y[i] = out;
+        }
+        stages[k] = s;
+    }
+}
+
+static const float* derived_update(derived_t* derived, int source) {
+    derived_channel_t* channel = &derived->channels[source];
+    const float* restrict a = NULL;
+    const float* restrict b = NULL;
+    float* restrict y;
+    size_t first, start, last = derived->length;
+
+    if ( source >= 2 ) {
+        if ( channel->op == DERIVED_OFF )
+            return NULL;
+        a = derived_update(derived, channel->src[0]);
+        b = derived_update(derived, channel->src[1]);
+        if ( a == NULL || (b == NULL && channel->op <= DERIVED_MUL) )
+            return NULL;
+    }
+
+    if ( channel->generation != derived->generation ) {
+        channel->generation = derived->generation;
+        channel->valid      = 0;
+
+        if ( channel->op == DERIVED_FIR )
+            design_fir(channel, derived->sample_rate);
+        else if ( channel->op == DERIVED_IIR )
+            design_iir(channel, derived->sample_rate);
+    }
+
+    if ( reserve(channel, last) )
+        return NULL;
+
+    y = channel->data;
+    first = channel->valid;
+    start = first;
+
+    if ( source < 2 ) {
+        const uint8_t* raw = derived->raw[source];
+        const float* lut = derived->lut[source];
+        for (size_t i=first;i<last;i++)
+            y[i] = lut[raw[i]];
+    } else {
+        switch (channel->op) {
+            case DERIVED_ADD:
+                for (size_t i=first;i<last;i++)
+                    y[i] = a[i] + b[i];
+                break;
+            case DERIVED_SUB:
+                for (size_t i=first;i<last;i++)
+                    y[i] = a[i] - b[i];
+                break;
+            case DERIVED_MUL:
+                for (size_t i=first;i<last;i++)
+                    y[i] = a[i] * b[i];
+                break;
+            case DERIVED_INVERT:
+                for (size_t i=first;i<last;i++)
+                    y[i] = -a[i];
+                break;
+            case DERIVED_INTEGRATE: {
+                float dt = 1/derived->sample_rate;
+                float sum = first ? y[first-1] : 0;
+                for (size_t i=first;i<last;i++) {
+                    sum += a[i]*dt;
+                    y[i] = sum;
+                }
+                break;
+            }
+            case DERIVED_DIFFERENTIATE: {
+                float fs = derived->sample_rate;
+                if ( first == 0 && last > 0 )
+                    y[first++] = 0;
+                for (size_t i=first;i<last;i++)
+                    y[i] = (a[i]-a[i-1])*fs;
+                break;
+            }
+            case DERIVED_FIR:
+                fir_run(channel->taps, channel->num_taps, a, y, first, last);
+                break;
+            case DERIVED_IIR:
+                iir_run(channel->stages, channel->num_stages, a, y, first, last);
+                break;
+        }
+    }
+
+    index_update(channel, start, last);
+    channel->valid = last;
+    return y;
+}
+
+//Samples of a source up to the input length, computed only now and only
+//for what is not cached yet; NULL for a channel that is off
+const float* derived_get(derived_t* derived, int source) {
+    if ( source < 0 || source >= DERIVED_SOURCES || derived->length == 0 )
+        return NULL;
+
+    return derived_update(derived, source);
+}
+
+//Min/max of a source over [first, last) of what derived_get computed,
+//from the largest aligned buckets available and single samples at the
+//ends. Empty ranges come back with min > max.
+derived_span_t derived_range(const derived_t* derived, int source, size_t first, size_t last) {
+    const derived_channel_t* channel = &derived->channels[source];
+    derived_span_t span = { INFINITY, -INFINITY };
+
+    if ( last > channel->valid )
+        last = channel->valid;
+
+    while ( first < last ) {
+        int k = -1;
+
+        while ( k+1 < DERIVED_LEVELS &&
+                (first & (((size_t)1 << (k+1+DERIVED_SPAN_SHIFT))-1)) == 0 &&
+                first + ((size_t)1 << (k+1+DERIVED_SPAN_SHIFT)) <= last )
+            k++;
+
+        if ( k < 0 ) {
+            span.min = fminf(span.min, channel->data[first]);
+            span.max = fmaxf(span.max, channel->data[first]);
+            first++;
+        } else {
+            span_merge(&span, channel->levels[k][first >> (k+DERIVED_SPAN_SHIFT)]);
+            first += (size_t)1 << (k+DERIVED_SPAN_SHIFT);
+        }
+    }
+
+    return span;
+}
@@ -0,0 +1,106 @@
+/*
+    Hantek 2D72 handheld oscillosope tool for linux
+    Copyright (C) 2021 Luca Oliva
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _DERIVED_H
+#define _DERIVED_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define DERIVED_MAX                     4
+#define DERIVED_SOURCES                 (2+DERIVED_MAX)
+#define DERIVED_MAX_TAPS                255
+#define DERIVED_MAX_ORDER               8
+#define DERIVED_MAX_STAGES              DERIVED_MAX_ORDER
+#define DERIVED_SPAN_SHIFT              4       //finest min/max level: 16 samples
+#define DERIVED_LEVELS                  24
+
+enum {
+    DERIVED_OFF,
+    DERIVED_ADD,
+    DERIVED_SUB,
+    DERIVED_MUL,
+    DERIVED_INVERT,
+    DERIVED_INTEGRATE,
+    DERIVED_DIFFERENTIATE,
+    DERIVED_FIR,
+    DERIVED_IIR
+};
+
+enum {
+    FILTER_LOWPASS,
+    FILTER_HIGHPASS,
+    FILTER_BANDPASS
+};
+
+typedef struct {
+        double          b0, b1, b2, a1, a2;
+        double          x1, x2, y1, y2;
+} biquad_t;
+
+typedef struct {
+        float           min;
+        float           max;
+} derived_span_t;
+
+//Sources 0 and 1 are CH1 and CH2 in volts, 2.. the math channels. A math
+//channel may only use sources before it. Every channel caches its output
+//up to valid samples; all operations are causal, so a longer record only
+//costs the new samples. levels[k] is a min/max pyramid over the output with
+//one span every 2^(k+DERIVED_SPAN_SHIFT) samples, complete buckets only.
+typedef struct {
+        int             op;
+        int             src[2];
+        int             filter;
+        double          f1, f2;
+        int             size;
+
+        float           taps[DERIVED_MAX_TAPS];
+        int             num_taps;
+        biquad_t        stages[DERIVED_MAX_STAGES];
+        int             num_stages;
+
+        float*          data;
+        derived_span_t* levels[DERIVED_LEVELS];
+        size_t          capacity;
+        size_t          valid;
+        unsigned int    generation;
+} derived_channel_t;
+
+typedef struct {
+        derived_channel_t channels[DERIVED_SOURCES];
+
+        const uint8_t*  raw[2];
+        size_t          length;
+        float           lut[2][256];
+        double          sample_rate;
+        unsigned int    input_generation;
+        unsigned int    generation;
+} derived_t;
+
+void         derived_init(derived_t* derived);
+void         derived_free(derived_t* derived);
+void         derived_set_input(derived_t* derived, const uint8_t* ch1, const uint8_t* ch2, size_t length, unsigned int generation,
+                               double sample_rate, const double volts_per_div[2], const double offset[2]);
+int          derived_configure(derived_t* derived, int index, int op, int src_a, int src_b,
+                               int filter, double f1, double f2, int size);
+const float* derived_get(derived_t* derived, int source);
+derived_span_t derived_range(const derived_t* derived, int source, size_t first, size_t last);
+
+#endif //_DERIVED_H
@@ -0,0 +1,366 @@
+/*
+    Hantek 2D72 handheld oscillosope tool for linux
+    Copyright (C) 2021 Luca Oliva
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "Export.h"
+#include "Scale.h"
+
+#define EXPORT_BLOCK                    1024
+#define WAV_HEADER_SIZE                 58
+
+static uint32_t crc_table[256];
+
+static void crc_init(void) {
+    if ( crc_table[1] )
+        return;
+
+    for (uint32_t n=0;n<256;n++) {
+        uint32_t c = n;
+        for (int k=0;k<8;k++)
+            c = c & 1 ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+        crc_table[n] = c;
+    }
+}
+
+static uint32_t crc_update(uint32_t crc, const uint8_t* data, size_t length) {
+    for (size_t i=0;i<length;i++)
+        crc = crc_table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return crc;
+}
+
+static inline void put16(uint8_t* p, uint16_t v) {
+    p[0] = v;
+    p[1] = v >> 8;
+}
+
+static inline void put32(uint8_t* p, uint32_t v) {
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
+
+static int export_flush(export_t* export) {
+    if ( export->fill == 0 )
+        return 0;
+
+    if ( fwrite(export->buffer, 1, export->fill, export->file) != export->fill ) {
+        perror("export");
+        return -1;
+    }
+
+    export->written += export->fill;
+    export->fill = 0;
+    return 0;
+}
+
+static int export_put(export_t* export, const void* data, size_t length) {
+    if ( export->fill+length > EXPORT_BUFFER && export_flush(export) )
+        return -1;
+
+    //Bigger than the whole buffer: straight to the file
+    if ( length > EXPORT_BUFFER ) {
+        if ( fwrite(data, 1, length, export->file) != length )
+            return -1;
+        export->written += length;
+        return 0;
+    }
+
+    memcpy(export->buffer+export->fill, data, length);
+    export->fill += length;
+    return 0;
+}
+
+static inline uint32_t export_offset(const export_t* export) {
+    return export->written + export->fill;
+}
+
+//Stored zip entries with a data descriptor, so sizes and crc are written
+//after the data and nothing has to be known in advance
+static int zip_begin(export_t* export, const char* name) {
+    export_entry_t* entries = realloc(export->entries, (export->num_entries+1)*sizeof(export_entry_t));
+    export_entry_t* entry;
+    uint8_t header[30];
+
+    if ( entries == NULL )
+        return -1;
+    export->entries = entries;
+    entry = &entries[export->num_entries++];
+
+    snprintf(entry->name, sizeof(entry->name), "%s", name);
+    entry->offset = export_offset(export);
+
+    memset(header, 0, sizeof(header));
+    put32(header,    0x04034b50);
+    put16(header+4,  20);
+    put16(header+6,  0x0008);
+    put16(header+12, 0x0021);
+    put16(header+26, strlen(entry->name));
+
+    export->crc = 0xFFFFFFFF;
+    if ( export_put(export, header, sizeof(header)) || export_put(export, entry->name, strlen(entry->name)) )
+        return -1;
+
+    entry->size = export_offset(export);
+    return 0;
+}
+
+static int zip_data(export_t* export, const void* data, size_t length) {
+    export->crc = crc_update(export->crc, data, length);
+    return export_put(export, data, length);
+}
+
+static int zip_end(export_t* export) {
+    export_entry_t* entry = &export->entries[export->num_entries-1];
+    uint8_t descriptor[16];
+
+    entry->crc  = ~export->crc;
+    entry->size = export_offset(export)-entry->size;
+
+    put32(descriptor,    0x08074b50);
+    put32(descriptor+4,  entry->crc);
+    put32(descriptor+8,  entry->size);
+    put32(descriptor+12, entry->size);
+    return export_put(export, descriptor, sizeof(descriptor));
+}
+
+static int zip_finish(export_t* export) {
+    uint32_t start = export_offset(export);
+    uint8_t header[46];
+    uint8_t end[22];
+
+    for (int i=0;i<export->num_entries;i++) {
+        const export_entry_t* entry = &export->entries[i];
+
+        memset(header, 0, sizeof(header));
+        put32(header,    0x02014b50);
+        put16(header+4,  20);
+        put16(header+6,  20);
+        put16(header+8,  0x0008);
+        put16(header+14, 0x0021);
+        put32(header+16, entry->crc);
+        put32(header+20, entry->size);
+        put32(header+24, entry->size);
+        put16(header+28, strlen(entry->name));
+        put32(header+42, entry->offset);
+        if ( export_put(export, header, sizeof(header)) || export_put(export, entry->name, strlen(entry->name)) )
+            return -1;
+    }
+
+    memset(end, 0, sizeof(end));
+    put32(end,    0x06054b50);
+    put16(end+8,  export->num_entries);
+    put16(end+10, export->num_entries);
+    put32(end+12, export_offset(export)-start);
+    put32(end+16, start);
+    return export_put(export, end, sizeof(end));
+}
+
+static int zip_text(export_t* export, const char* name, const char* text) {
+    if ( zip_begin(export, name) || zip_data(export, text, strlen(text)) )
+        return -1;
+    return zip_end(export);
+}
+
+static int wav_header(export_t* export) {
+    uint8_t header[WAV_HEADER_SIZE];
+    uint32_t rate = export->sample_rate < 1 ? 1 : export->sample_rate > UINT32_MAX ? UINT32_MAX : (uint32_t)export->sample_rate;
+    uint32_t block = 4*export->num_channels;
+    uint64_t data = export->num_samples*block;
+
+    if ( data > UINT32_MAX-WAV_HEADER_SIZE )
+        data = UINT32_MAX-WAV_HEADER_SIZE;
+
+    memcpy(header, "RIFF", 4);
+    put32(header+4,  WAV_HEADER_SIZE-8+data);
+    memcpy(header+8, "WAVEfmt ", 8);
+    put32(header+16, 18);
+    put16(header+20, 3); //IEEE float
+    put16(header+22, export->num_channels);
+    put32(header+24, rate);
+    put32(header+28, (uint64_t)rate*block > UINT32_MAX ? UINT32_MAX : rate*block);
+    put16(header+32, block);
+    put16(header+34, 32);
+    put16(header+36, 0);
+    memcpy(header+38, "fact", 4);
+    put32(header+42, 4);
+    put32(header+46, export->num_samples > UINT32_MAX ? UINT32_MAX : export->num_samples);
+    memcpy(header+50, "data", 4);
+    put32(header+54, data);
+
+    return export_put(export, header, sizeof(header));
+}
+
+int export_open(export_t* export, const char* path, int format, double sample_rate,
+                const bool enable[2], const double volts_per_div[2], const double offset[2]) {
+    int status = -1;
+
+    memset(export, 0, sizeof(*export));
+    export->format      = format;
+    export->sample_rate = sample_rate;
+
+    for (int ch=0;ch<2;ch++) {
+        if ( !enable[ch] )
+            continue;
+        export->channels[export->num_channels++] = ch;
+        for (int raw=0;raw<256;raw++)
+            export->volts[ch][raw] = scale_raw_to_volts(raw, volts_per_div[ch], offset[ch]);
+    }
+
+    if ( export->num_channels == 0 )
+        return -1;
+
+    export->file = fopen(path, "wb");
+    if ( export->file == NULL ) {
+        perror(path);
+        return -1;
+    }
+    //All writes go through our own buffer
+    setvbuf(export->file, NULL, _IONBF, 0);
+
+    export->buffer = malloc(EXPORT_BUFFER);
+    if ( export->buffer == NULL ) {
+        fclose(export->file);
+        export->file = NULL;
+        return -1;
+    }
+
+    crc_init();
+
+    switch (format) {
+        case EXPORT_CSV: {
+            char line[64];
+            int len = snprintf(line, sizeof(line), "time");
+            for (int c=0;c<export->num_channels;c++)
+                len += snprintf(line+len, sizeof(line)-len, ",CH%d", export->channels[c]+1);
+            len += snprintf(line+len, sizeof(line)-len, "\n");
+            status = export_put(export, line, len);
+            break;
+        }
+        case EXPORT_WAV:
+            status = wav_header(export);
+            break;
+        case EXPORT_SR:
+            status = zip_text(export, "version", "2");
+            break;
+    }
+
+    if ( status ) {
+        fclose(export->file);
+        free(export->buffer);
+        export->file   = NULL;
+        export->buffer = NULL;
+    }
+    return status;
+}
+
+//Samples of CH1 and CH2 are read every stride bytes: 2 for an interleaved
+//capture frame, 1 for the planar record. Disabled channels may be NULL.
+int export_write(export_t* export, const uint8_t* ch1, const uint8_t* ch2, size_t stride, size_t num_samples) {
+    const uint8_t* src[2] = { ch1, ch2 };
+    float block[EXPORT_BLOCK*2];
+    int status = 0;
+
+    switch (export->format) {
+        case EXPORT_CSV: {
+            char line[96];
+            for (size_t i=0;i<num_samples && !status;i++) {
+                int len = snprintf(line, sizeof(line), "%.9g", (export->num_samples+i)/export->sample_rate);
+                for (int c=0;c<export->num_channels;c++) {
+                    int ch = export->channels[c];
+                    len += snprintf(line+len, sizeof(line)-len, ",%.5g", export->volts[ch][src[ch][i*stride]]);
+                }
+                line[len++] = '\n';
+                status = export_put(export, line, len);
+            }
+            break;
+        }
+        case EXPORT_WAV:
+            for (size_t first=0;first<num_samples && !status;first+=EXPORT_BLOCK) {
+                size_t n = num_samples-first < EXPORT_BLOCK ? num_samples-first : EXPORT_BLOCK;
+                for (size_t i=0;i<n;i++)
+                    for (int c=0;c<export->num_channels;c++) {
+                        int ch = export->channels[c];
+                        block[i*export->num_channels+c] = export->volts[ch][src[ch][(first+i)*stride]];
+                    }
+                status = export_put(export, block, n*export->num_channels*sizeof(float));
+            }
+            break;
+        case EXPORT_SR:
+            //One analog-1-<channel>-<chunk> entry per channel per call
+            export->num_chunks++;
+            for (int c=0;c<export->num_channels && !status;c++) {
+                int ch = export->channels[c];
+                char name[32];
+
+                snprintf(name, sizeof(name), "analog-1-%d-%d", c+1, export->num_chunks);
+                status = zip_begin(export, name);
+                for (size_t first=0;first<num_samples && !status;first+=EXPORT_BLOCK) {
+                    size_t n = num_samples-first < EXPORT_BLOCK ? num_samples-first : EXPORT_BLOCK;
+                    for (size_t i=0;i<n;i++)
+                        block[i] = export->volts[ch][src[ch][(first+i)*stride]];
+                    status = zip_data(export, block, n*sizeof(float));
+                }
+                if ( !status )
+                    status = zip_end(export);
+            }
+            break;
+    }
+
+    export->num_samples += num_samples;
+    return status;
+}
+
+int export_close(export_t* export) {
+    int status = 0;
+
+    if ( export->format == EXPORT_SR ) {
+        char metadata[256];
+        int len = snprintf(metadata, sizeof(metadata),
+                           "[global]\nsigrok version=0.5.2\n\n[device 1]\nsamplerate=%llu\ntotal analog=%d\n",
+                           (unsigned long long)(export->sample_rate < 1 ? 1 : llround(export->sample_rate)), export->num_channels);
+        for (int c=0;c<export->num_channels;c++)
+            len += snprintf(metadata+len, sizeof(metadata)-len, "analog%d=CH%d\n", c+1, export->channels[c]+1);
+
+        status |= zip_text(export, "metadata", metadata);
+        status |= zip_finish(export);
+    }
+
+    status |= export_flush(export);
+
+    if ( export->format == EXPORT_WAV ) {
+        //Sizes are only known now
+        fseek(export->file, 0, SEEK_SET);
+        export->written = 0;
+        status |= wav_header(export);
+        status |= export_flush(export);
+    }
+
+    if ( fclose(export->file) )
+        status = -1;
+
+    free(export->buffer);
+    free(export->entries);
+    export->buffer  = NULL;
+    export->entries = NULL;
+
+    return status ? -1 : 0;
+}
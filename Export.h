@@ -0,0 +1,68 @@
+/*
+    Hantek 2D72 handheld oscillosope tool for linux
+    Copyright (C) 2021 Luca Oliva
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _EXPORT_H
+#define _EXPORT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#define EXPORT_BUFFER                   (1 << 20)
+
+enum {
+    EXPORT_CSV,
+    EXPORT_WAV,
+    EXPORT_SR
+};
+
+typedef struct {
+        char     name[32];
+        uint32_t crc;
+        uint32_t size;
+        uint32_t offset;
+} export_entry_t;
+
+//Streaming writer: samples are converted to volts through a per channel
+//lookup table and go through one large buffer before reaching the file.
+typedef struct {
+        int             format;
+        FILE*           file;
+        double          sample_rate;
+        int             num_channels;
+        int             channels[2];
+        float           volts[2][256];
+        uint64_t        num_samples;
+
+        uint8_t*        buffer;
+        size_t          fill;
+        uint64_t        written;
+
+        export_entry_t* entries;
+        int             num_entries;
+        int             num_chunks;
+        uint32_t        crc;
+} export_t;
+
+int  export_open(export_t* export, const char* path, int format, double sample_rate,
+                 const bool enable[2], const double volts_per_div[2], const double offset[2]);
+int  export_write(export_t* export, const uint8_t* ch1, const uint8_t* ch2, size_t stride, size_t num_samples);
+int  export_close(export_t* export);
+
+#endif //_EXPORT_H
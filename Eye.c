@@ -0,0 +1,228 @@
+/*
+    Hantek 2D72 handheld oscillosope tool for linux
+    Copyright (C) 2021 Luca Oliva
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "Eye.h"
+
+void eye_hist_clear(eye_hist_t* hist) {
+    memset(hist, 0, sizeof(*hist));
+}
+
+//Adds the segment from (x0, v0) to (x1, v1), x in columns, one hit per column
+static void eye_segment(eye_hist_t* hist, double x0, double v0, double x1, double v1) {
+    int c0 = (int)ceil(x0), c1 = (int)floor(x1);
+
+    for (int c=c0;c<=c1;c++) {
+        int col = c % EYE_COLUMNS;
+        int row = lround(v0 + (v1-v0)*(c-x0)/(x1-x0));
+        if ( col < 0 )
+            col += EYE_COLUMNS;
+        hist->bins[EYE_ROWS-1-row][col]++;
+    }
+}
+
+//Clock recovery: the first crossing of the decision level anchors the
+//clock, each following one moves the anchor to the expected edge nearest to
+//it plus gain times the timing error, and the period by a fraction of that.
+//Positions count unit intervals from the first crossing; the expected edges
+//fall at 0.5 and 1.5 UI of the window so the eye is centered.
+void eye_fold(const eye_params_t* params, const uint8_t* samples, size_t stride, size_t num_samples, eye_hist_t* hist) {
+    const double cols_per_ui = (double)EYE_COLUMNS/EYE_UIS;
+    double period = params->ui;
+    double anchor = -1, base = 0;
+    double prev_x = 0;
+    int thr = params->threshold;
+    int level;
+
+    if ( num_samples < 2 || period <= 1 )
+        return;
+
+    level = samples[0] >= thr;
+
+    for (size_t i=1;i<num_samples;i++) {
+        int v0 = samples[(i-1)*stride], v1 = samples[i*stride];
+        double x;
+
+        if ( (level && v1 < thr-EYE_HYSTERESIS) || (!level && v1 >= thr+EYE_HYSTERESIS) ) {
+            //Crossing time, interpolated between the two samples
+            double t = v1 != v0 ? i-1 + (double)(thr-v0)/(v1-v0) : i;
+            if ( t < i-1 || t > i )
+                t = i;
+            level = !level;
+
+            if ( anchor < 0 ) {
+                anchor = t;
+                prev_x = (i-1-anchor)/period;
+            } else {
+                double k = round((t-anchor)/period);
+                double err = t - (anchor + k*period);
+                anchor += k*period + params->gain*err;
+                base   += k;
+                if ( k >= 1 )
+                    period += params->gain*params->gain/4*err/k;
+            }
+        }
+
+        if ( anchor < 0 )
+            continue;
+
+        x = base + (i-anchor)/period;
+        if ( x > prev_x ) {
+            double shift = floor((prev_x+0.5)/EYE_UIS)*EYE_UIS;
+            eye_segment(hist, (prev_x+0.5-shift)*cols_per_ui, v0, (x+0.5-shift)*cols_per_ui, v1);
+        }
+        prev_x = x;
+    }
+
+    if ( anchor >= 0 )
+        hist->uis += prev_x;
+}
+
+static void* eye_worker(void* data) {
+    eye_worker_t* worker = data;
+    eye_acc_t* acc = worker->acc;
+    frame_t* frame;
+    int slot;
+
+    pthread_mutex_lock(&acc->lock);
+    for (;;) {
+        while ( acc->head == acc->tail && acc->running )
+            pthread_cond_wait(&acc->cond, &acc->lock);
+        if ( acc->head == acc->tail )
+            break;
+
+        frame = acc->frames[acc->tail % EYE_SLOTS];
+        slot  = acc->channels[acc->tail % EYE_SLOTS];
+        acc->tail++;
+        pthread_mutex_unlock(&acc->lock);
+
+        pthread_mutex_lock(&worker->lock);
+        eye_fold(&acc->params, frame->data+slot, frame->num_channels, frame->num_samples, &worker->hist);
+        pthread_mutex_unlock(&worker->lock);
+        frame_unref(frame);
+
+        pthread_mutex_lock(&acc->lock);
+    }
+    pthread_mutex_unlock(&acc->lock);
+
+    return NULL;
+}
+
+int eye_start(eye_acc_t* acc, const eye_params_t* params, int num_workers) {
+    if ( num_workers < 1 )
+        num_workers = 1;
+    if ( num_workers > EYE_MAX_WORKERS )
+        num_workers = EYE_MAX_WORKERS;
+
+    eye_free(acc);
+    acc->workers = calloc(num_workers, sizeof(eye_worker_t));
+    if ( acc->workers == NULL )
+        return -1;
+
+    acc->params  = *params;
+    acc->head    = 0;
+    acc->tail    = 0;
+    acc->dropped = 0;
+    acc->running = true;
+    pthread_mutex_init(&acc->lock, NULL);
+    pthread_cond_init(&acc->cond, NULL);
+
+    for (acc->num_workers=0;acc->num_workers<num_workers;acc->num_workers++) {
+        eye_worker_t* worker = &acc->workers[acc->num_workers];
+        worker->acc = acc;
+        pthread_mutex_init(&worker->lock, NULL);
+        if ( pthread_create(&worker->thread, NULL, eye_worker, worker) ) {
+            perror("eye");
+            pthread_mutex_destroy(&worker->lock);
+            eye_free(acc);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+//Queues one channel of an interleaved frame by reference. A full queue
+//drops the frame.
+bool eye_push(eye_acc_t* acc, frame_t* frame, int slot) {
+    pthread_mutex_lock(&acc->lock);
+    if ( acc->head-acc->tail >= EYE_SLOTS ) {
+        acc->dropped++;
+        pthread_mutex_unlock(&acc->lock);
+        return false;
+    }
+
+    acc->frames[acc->head % EYE_SLOTS]   = frame_ref(frame);
+    acc->channels[acc->head % EYE_SLOTS] = slot;
+    acc->head++;
+
+    pthread_cond_signal(&acc->cond);
+    pthread_mutex_unlock(&acc->lock);
+
+    return true;
+}
+
+void eye_snapshot(eye_acc_t* acc, eye_hist_t* out) {
+    uint32_t* dst = &out->bins[0][0];
+
+    eye_hist_clear(out);
+    for (int w=0;w<acc->num_workers;w++) {
+        eye_worker_t* worker = &acc->workers[w];
+        const uint32_t* src = &worker->hist.bins[0][0];
+
+        pthread_mutex_lock(&worker->lock);
+        for (int i=0;i<EYE_ROWS*EYE_COLUMNS;i++)
+            dst[i] += src[i];
+        out->uis += worker->hist.uis;
+        pthread_mutex_unlock(&worker->lock);
+    }
+}
+
+//Folds what is still queued, then joins the workers. The histograms stay
+//readable until eye_free.
+void eye_stop(eye_acc_t* acc) {
+    if ( acc->workers == NULL || !acc->running )
+        return;
+
+    pthread_mutex_lock(&acc->lock);
+    acc->running = false;
+    pthread_cond_broadcast(&acc->cond);
+    pthread_mutex_unlock(&acc->lock);
+
+    for (int i=0;i<acc->num_workers;i++)
+        pthread_join(acc->workers[i].thread, NULL);
+}
+
+void eye_free(eye_acc_t* acc) {
+    if ( acc->workers == NULL )
+        return;
+
+    eye_stop(acc);
+    for (int i=0;i<acc->num_workers;i++)
+        pthread_mutex_destroy(&acc->workers[i].lock);
+    pthread_cond_destroy(&acc->cond);
+    pthread_mutex_destroy(&acc->lock);
+
+    free(acc->workers);
+    acc->workers     = NULL;
+    acc->num_workers = 0;
+}
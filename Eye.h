@@ -0,0 +1,82 @@
+/*
+    Hantek 2D72 handheld oscillosope tool for linux
+    Copyright (C) 2021 Luca Oliva
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _EYE_H
+#define _EYE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <pthread.h>
+
+#include "Frame.h"
+
+#define EYE_COLUMNS                     256
+#define EYE_ROWS                        256
+#define EYE_UIS                         2
+#define EYE_MAX_WORKERS                 8
+#define EYE_SLOTS                       32
+#define EYE_HYSTERESIS                  3
+
+typedef struct {
+        double          ui;             //samples per unit interval
+        int             threshold;      //raw code of the decision level
+        double          gain;           //clock recovery loop gain, 0..1
+} eye_params_t;
+
+//Hits per raw code (row) and position across EYE_UIS unit intervals (column)
+typedef struct {
+        uint32_t        bins[EYE_ROWS][EYE_COLUMNS];
+        double          uis;
+} eye_hist_t;
+
+typedef struct eye_acc eye_acc_t;
+
+typedef struct {
+        eye_acc_t*      acc;
+        pthread_t       thread;
+        pthread_mutex_t lock;
+        eye_hist_t      hist;
+} eye_worker_t;
+
+//Frames are queued by the acquisition thread and folded by a pool of
+//workers, each into its own histogram; a snapshot sums them.
+struct eye_acc {
+        eye_params_t    params;
+        frame_t*        frames[EYE_SLOTS];
+        int             channels[EYE_SLOTS];
+        uint64_t        head;
+        uint64_t        tail;
+        bool            running;
+        uint64_t        dropped;
+        pthread_mutex_t lock;
+        pthread_cond_t  cond;
+        eye_worker_t*   workers;
+        int             num_workers;
+};
+
+void eye_hist_clear(eye_hist_t* hist);
+void eye_fold(const eye_params_t* params, const uint8_t* samples, size_t stride, size_t num_samples, eye_hist_t* hist);
+
+int  eye_start(eye_acc_t* acc, const eye_params_t* params, int num_workers);
+bool eye_push(eye_acc_t* acc, frame_t* frame, int slot);
+void eye_snapshot(eye_acc_t* acc, eye_hist_t* out);
+void eye_stop(eye_acc_t* acc);
+void eye_free(eye_acc_t* acc);
+
+#endif //_EYE_H
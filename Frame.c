@@ -0,0 +1,105 @@
+/*
+    Hantek 2D72 handheld oscillosope tool for linux
+    Copyright (C) 2021 Luca Oliva
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "Frame.h"
+
+int frame_pool_init(frame_pool_t* pool, int size) {
+    pool->frames = aligned_alloc(64, size*sizeof(frame_t));
+    if ( pool->frames == NULL ) {
+        perror("frame_pool");
+        return -1;
+    }
+
+    pool->size   = size;
+    pool->in_use = 0;
+    pool->free   = NULL;
+    for (int i=size-1;i>=0;i--) {
+        pool->frames[i].pool      = pool;
+        pool->frames[i].refs      = 0;
+        pool->frames[i].next_free = pool->free;
+        pool->free = &pool->frames[i];
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+
+    return 0;
+}
+
+void frame_pool_free(frame_pool_t* pool) {
+    if ( pool->frames == NULL )
+        return;
+
+    if ( pool->in_use )
+        fprintf(stderr, "[%d] Frames still referenced.\n", pool->in_use);
+
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->frames);
+    pool->frames = NULL;
+}
+
+int frame_pool_in_use(frame_pool_t* pool) {
+    int in_use;
+
+    pthread_mutex_lock(&pool->lock);
+    in_use = pool->in_use;
+    pthread_mutex_unlock(&pool->lock);
+
+    return in_use;
+}
+
+//A frame with one reference owned by the caller, or NULL when every frame
+//is still held somewhere
+frame_t* frame_acquire(frame_pool_t* pool) {
+    frame_t* frame;
+
+    pthread_mutex_lock(&pool->lock);
+    frame = pool->free;
+    if ( frame ) {
+        pool->free = frame->next_free;
+        pool->in_use++;
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    if ( frame ) {
+        frame->refs         = 1;
+        frame->num_samples  = 0;
+        frame->num_channels = 0;
+    }
+    return frame;
+}
+
+frame_t* frame_ref(frame_t* frame) {
+    __atomic_add_fetch(&frame->refs, 1, __ATOMIC_RELAXED);
+    return frame;
+}
+
+void frame_unref(frame_t* frame) {
+    frame_pool_t* pool;
+
+    if ( frame == NULL || __atomic_sub_fetch(&frame->refs, 1, __ATOMIC_ACQ_REL) > 0 )
+        return;
+
+    pool = frame->pool;
+    pthread_mutex_lock(&pool->lock);
+    frame->next_free = pool->free;
+    pool->free = frame;
+    pool->in_use--;
+    pthread_mutex_unlock(&pool->lock);
+}
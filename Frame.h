@@ -0,0 +1,71 @@
+/*
+    Hantek 2D72 handheld oscillosope tool for linux
+    Copyright (C) 2021 Luca Oliva
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _FRAME_H
+#define _FRAME_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#include "Config.h"
+
+#define FRAME_CAPACITY                  6000
+#define FRAME_POOL_SIZE                 256
+
+typedef struct frame_pool frame_pool_t;
+
+//One interleaved capture with the settings it was taken with. Whoever holds
+//a reference may read it; the last frame_unref gives it back to the pool.
+typedef struct frame {
+        frame_pool_t*   pool;
+        struct frame*   next_free;
+        int             refs;
+
+        int64_t         time_us;        //capture done
+        int64_t         request_us;     //capture asked for, the slot time when scheduled
+        config_t        config;
+        int             num_samples;
+        int             num_channels;
+        uint8_t         data[FRAME_CAPACITY] __attribute__((aligned(64)));
+} frame_t;
+
+//All frames are allocated once; taking and returning one only moves a
+//pointer on the free list
+struct frame_pool {
+        frame_t*        frames;
+        frame_t*        free;
+        int             size;
+        int             in_use;
+        pthread_mutex_t lock;
+};
+
+int      frame_pool_init(frame_pool_t* pool, int size);
+void     frame_pool_free(frame_pool_t* pool);
+int      frame_pool_in_use(frame_pool_t* pool);
+
+frame_t* frame_acquire(frame_pool_t* pool);
+frame_t* frame_ref(frame_t* frame);
+void     frame_unref(frame_t* frame);
+
+//Sample i of the channel in slot of the interleaved data
+static inline uint8_t frame_sample(const frame_t* frame, int i, int slot) {
+    return frame->data[i*frame->num_channels+slot];
+}
+
+#endif //_FRAME_H
@@ -112,26 +112,219 @@ cleanup:
     return res;
 }
 
+//Every bulk transfer goes through here, so a session can be recorded and
+//replayed later without the device
+int usb_bulk(unsigned char endpoint, unsigned char* data, int length, int* actual, unsigned int timeout) {
+    int transferred = 0;
+    int res;
+
+    if ( usb_trace.mode == USBTRACE_REPLAY ) {
+        if ( usbtrace_replay(&usb_trace, endpoint, data, length, &transferred, &res) )
+            return LIBUSB_ERROR_IO;
+    } else {
+        res = libusb_bulk_transfer(handle, endpoint, data, length, &transferred, timeout);
+        if ( usb_trace.mode == USBTRACE_RECORD )
+            usbtrace_record(&usb_trace, endpoint, data, endpoint & LIBUSB_ENDPOINT_IN ? transferred : length, res);
+    }
+
+    if ( actual )
+        *actual = transferred;
+    return res;
+}
+
+int send_setting(uint16_t func, uint8_t cmd, uint32_t val) {
+    Hantek_command_t command;
+
+    command.idx     = 0x00;
+    command.boh     = 0x0A;
+    command.func    = func;
+    command.cmd     = cmd;
+    command.val32   = val;
+    command.last    = 0;
+    return usb_bulk(LIBUSB_ENDPOINT_OUT | 2, (unsigned char*)&command, sizeof(command), NULL, 0);
+}
+
+//Waits at most wait_ms for the first packet, then as long as it takes for
+//the rest. first_us, when not NULL, gets the arrival time of the first packet;
+//roll, when not NULL, gets every packet as soon as it is in. With a stop
+//flag, later packets are waited for in slices of wait_ms, checking the flag
+//in between, and for at most packet_ms each.
+static int capture_frame_stream(uint8_t* buffer, int num_samples, int num_channels, unsigned int wait_ms,
+                                unsigned int packet_ms, int* stop, gint64* first_us, roll_t* roll) {
+    Hantek_command_t command;
+    int total = num_samples*num_channels;
+    int count = 0;
+    int res;
+
+    while(count < total) {
+        gint64 deadline = g_get_monotonic_time() + (gint64)packet_ms*1000;
+        int length, actual_length;
+
+        do {
+            if ( stop && g_atomic_int_get(stop) )
+                return LIBUSB_ERROR_INTERRUPTED;
+
+            command.idx     = 0;
+            command.boh     = 0x0A;
+            command.func    = FUNC_SCOPE_CAPTURE;
+            command.cmd     = SCOPE_START_RECV;
+            command.size[0] = total/2;
+            command.size[1] = total/2;
+            res = usb_bulk(LIBUSB_ENDPOINT_OUT | 2, (unsigned char*)&command, sizeof(command), NULL, 0);
+            if ( res != LIBUSB_SUCCESS )
+                return res;
+
+            length = (total-count)<64?(total-count):64;
+            res = usb_bulk(LIBUSB_ENDPOINT_IN | 1, &(buffer[count]), length, &actual_length, count && !stop ? 0 : wait_ms);
+        } while ( res == LIBUSB_ERROR_TIMEOUT && count && stop && g_get_monotonic_time() < deadline );
+        if ( res != LIBUSB_SUCCESS )
+            return res;
+        if ( count == 0 && first_us )
+            *first_us = g_get_monotonic_time();
+        if ( roll )
+            roll_push(roll, &(buffer[count]), actual_length);
+        count+=actual_length;
+    }
+
+    return 0;
+}
+
+//Time one 64 byte packet takes to fill at time_scale, plus margin_ms
+static unsigned int capture_packet_ms(int time_scale, int num_channels, unsigned int margin_ms) {
+    if ( num_channels == 0 )
+        return margin_ms;
+    return margin_ms + ceil(1000.0*64/num_channels/scale_sample_rate(time_scale));
+}
+
+int capture_frame_timed(uint8_t* buffer, int num_samples, int num_channels, unsigned int wait_ms, gint64* first_us) {
+    return capture_frame_stream(buffer, num_samples, num_channels, wait_ms, 0, NULL, first_us, NULL);
+}
+
+int capture_frame(uint8_t* buffer, int num_samples, int num_channels) {
+    return capture_frame_timed(buffer, num_samples, num_channels, 0, NULL);
+}
+
+//Asks for the frame again every CAPTURE_WAIT until it triggers or stop is
+//set; one that stops arriving midway is given up and asked for again
+static int capture_frame_stoppable(uint8_t* buffer, int num_samples, int num_channels, int time_scale, int* stop) {
+    unsigned int packet_ms = capture_packet_ms(time_scale, num_channels, CAPTURE_WAIT);
+    int res;
+
+    do
+        res = capture_frame_stream(buffer, num_samples, num_channels, CAPTURE_WAIT, packet_ms, stop, NULL, NULL);
+    while ( res == LIBUSB_ERROR_TIMEOUT && !g_atomic_int_get(stop) );
+
+    return res;
+}
+
+//Captures into a frame of the pool, stamped with the settings it was taken
+//with and the times it was asked for and done. The caller owns the only
+//reference; NULL on failure, or once stop is set when there is one.
+frame_t* capture_pooled(int* stop) {
+    frame_t* frame = frame_acquire(&frame_pool);
+    int res;
+
+    if ( frame == NULL ) {
+        fprintf(stderr, "[%d] No free frame.\n", frame_pool_in_use(&frame_pool));
+        return NULL;
+    }
+
+    config_read(&config_store, &frame->config);
+    frame->num_samples  = frame->config.num_samples;
+    frame->num_channels = frame->config.channel_enable[0]+frame->config.channel_enable[1];
+
+    frame->request_us = g_get_monotonic_time();
+    if ( stop )
+        res = capture_frame_stoppable(frame->data, frame->num_samples, frame->num_channels, frame->config.time_scale, stop);
+    else
+        res = capture_frame(frame->data, frame->num_samples, frame->num_channels);
+    if ( res != 0 ) {
+        if ( !stop || !g_atomic_int_get(stop) )
+            fprintf(stderr, "[%d] Capture failed.\n", res);
+        frame_unref(frame);
+        return NULL;
+    }
+    frame->time_us = g_get_monotonic_time();
+    periodic_rates_note(&capture_rates, frame->num_samples, frame->num_channels, frame->time_us-frame->request_us);
+
+    return frame;
+}
+
+//True while any worker owns the capture endpoints; their commands and
+//replies would interleave with a second acquisition
+static bool acquisition_busy(void) {
+    return bode_worker || export_worker || segment_worker || caplog_worker || mask_worker ||
+           eye_capture_worker || run_worker || autoset_worker || roll_worker;
+}
+
+void on_caplog_stop(GtkButton *button, gpointer user_data);
+void on_mask_stop(GtkButton *button, gpointer user_data);
+void on_eye_stop(GtkButton *button, gpointer user_data);
+void on_run_stop(GtkButton *button, gpointer user_data);
+void on_roll_stop(GtkButton *button, gpointer user_data);
+void on_trend_stop(GtkButton *button, gpointer user_data);
+static void trend_frame(const frame_t* frame);
+static void xcorr_frame(const frame_t* frame);
+static void cursor_update(void);
+
 int main(int argc, char *argv[]) {
     libusb_device *device = NULL;
+    const char* trace_path = NULL;
+    int trace_mode = USBTRACE_OFF;
+    bool trace_fast = false;
     int status = 0;
-    int cfg_fd;
 
     GtkBuilder      *builder;
     GtkWidget       *window;
 
     libusb_init(NULL);
 
-    status = find_device(VENDOR, PRODUCT, &device, &handle);
-    if(status != 0) {
-        fprintf(stderr, "[%d] Failed to find device.\n", status);
+    //--record FILE traces every transfer, --replay FILE serves a trace in
+    //place of the device, --fast replays without the recorded delays
+    for (int i=1;i<argc;i++) {
+        if ( !strcmp(argv[i], "--fast") ) {
+            trace_fast = true;
+        } else if ( i+1 < argc && !strcmp(argv[i], "--record") ) {
+            trace_mode = USBTRACE_RECORD;
+            trace_path = argv[++i];
+        } else if ( i+1 < argc && !strcmp(argv[i], "--replay") ) {
+            trace_mode = USBTRACE_REPLAY;
+            trace_path = argv[++i];
+        }
+    }
+
+    status = frame_pool_init(&frame_pool, FRAME_POOL_SIZE);
+    if ( status != 0 )
         goto cleanup;
+
+    if ( trace_mode != USBTRACE_OFF ) {
+        status = usbtrace_open(&usb_trace, trace_path, trace_mode, trace_fast);
+        if ( status != 0 )
+            goto cleanup;
     }
 
-    claim_interfaces(device, handle);
+    if ( trace_mode != USBTRACE_REPLAY ) {
+        status = find_device(VENDOR, PRODUCT, &device, &handle);
+        if(status != 0) {
+            fprintf(stderr, "[%d] Failed to find device.\n", status);
+            goto cleanup;
+        }
+
+        claim_interfaces(device, handle);
+    }
 
     gtk_init(&argc, &argv);
 
+    record_init(&capture_record);
+    decoder_init(&capture_decoder);
+    derived_init(&math);
+    g_mutex_init(&record_lock);
+    g_mutex_init(&run_log_lock);
+    trend_init(&trend_store);
+    xy_init(&xy_view);
+    xcorr_init(&xcorr_engine);
+    periodic_rates_init(&capture_rates);
+
     builder = gtk_builder_new_from_file("Hantek.glade");
 
     window = GTK_WIDGET(gtk_builder_get_object(builder,"window_main"));
@@ -186,7 +379,105 @@ int main(int argc, char *argv[]) {
     awg_traphighduty_spinbutton     = GTK_SPIN_BUTTON(gtk_builder_get_object(builder,   "awg_traphighduty_spinbutton"));
     awg_trapfallduty_spinbutton     = GTK_SPIN_BUTTON(gtk_builder_get_object(builder,   "awg_trapfallduty_spinbutton"));
 
+    arb_expression_entry            = GTK_ENTRY(gtk_builder_get_object(builder,         "arb_expression_entry"));
+    arb_file_chooser                = GTK_FILE_CHOOSER(gtk_builder_get_object(builder,  "arb_file_chooser"));
+    arb_status_label                = GTK_LABEL(gtk_builder_get_object(builder,         "arb_status_label"));
+    arb_drawing_area                = GTK_WIDGET(gtk_builder_get_object(builder,        "arb_drawing_area"));
+
+    bode_start_spinbutton           = GTK_SPIN_BUTTON(gtk_builder_get_object(builder,   "bode_start_spinbutton"));
+    bode_stop_spinbutton            = GTK_SPIN_BUTTON(gtk_builder_get_object(builder,   "bode_stop_spinbutton"));
+    bode_points_spinbutton          = GTK_SPIN_BUTTON(gtk_builder_get_object(builder,   "bode_points_spinbutton"));
+    bode_settle_spinbutton          = GTK_SPIN_BUTTON(gtk_builder_get_object(builder,   "bode_settle_spinbutton"));
+    bode_run_button                 = GTK_BUTTON(gtk_builder_get_object(builder,        "bode_run_button"));
+    bode_progressbar                = GTK_PROGRESS_BAR(gtk_builder_get_object(builder,  "bode_progressbar"));
+    bode_status_label               = GTK_LABEL(gtk_builder_get_object(builder,         "bode_status_label"));
+    bode_drawing_area               = GTK_WIDGET(gtk_builder_get_object(builder,        "bode_drawing_area"));
+
+    decode_protocol_combobox        = GTK_COMBO_BOX(gtk_builder_get_object(builder,     "decode_protocol_combobox"));
+    decode_uart_channel_combobox    = GTK_COMBO_BOX(gtk_builder_get_object(builder,     "decode_uart_channel_combobox"));
+    decode_baud_spinbutton          = GTK_SPIN_BUTTON(gtk_builder_get_object(builder,   "decode_baud_spinbutton"));
+    decode_spi_bits_spinbutton      = GTK_SPIN_BUTTON(gtk_builder_get_object(builder,   "decode_spi_bits_spinbutton"));
+    decode_spi_edge_combobox        = GTK_COMBO_BOX(gtk_builder_get_object(builder,     "decode_spi_edge_combobox"));
+    decode_threshold_spinbutton_ch1 = GTK_SPIN_BUTTON(gtk_builder_get_object(builder,   "decode_threshold_spinbutton_ch1"));
+    decode_threshold_spinbutton_ch2 = GTK_SPIN_BUTTON(gtk_builder_get_object(builder,   "decode_threshold_spinbutton_ch2"));
+
+    export_format_combobox          = GTK_COMBO_BOX(gtk_builder_get_object(builder,     "export_format_combobox"));
+    export_path_entry               = GTK_ENTRY(gtk_builder_get_object(builder,         "export_path_entry"));
+    export_source_combobox          = GTK_COMBO_BOX(gtk_builder_get_object(builder,     "export_source_combobox"));
+    export_frames_spinbutton        = GTK_SPIN_BUTTON(gtk_builder_get_object(builder,   "export_frames_spinbutton"));
+    export_run_button               = GTK_BUTTON(gtk_builder_get_object(builder,        "export_run_button"));
+    export_progressbar              = GTK_PROGRESS_BAR(gtk_builder_get_object(builder,  "export_progressbar"));
+    export_status_label             = GTK_LABEL(gtk_builder_get_object(builder,         "export_status_label"));
+
+    segment_mode_combobox           = GTK_COMBO_BOX(gtk_builder_get_object(builder,     "segment_mode_combobox"));
+    segment_count_spinbutton        = GTK_SPIN_BUTTON(gtk_builder_get_object(builder,   "segment_count_spinbutton"));
+    segment_samples_spinbutton      = GTK_SPIN_BUTTON(gtk_builder_get_object(builder,   "segment_samples_spinbutton"));
+    segment_run_button              = GTK_BUTTON(gtk_builder_get_object(builder,        "segment_run_button"));
+    segment_progressbar             = GTK_PROGRESS_BAR(gtk_builder_get_object(builder,  "segment_progressbar"));
+    segment_status_label            = GTK_LABEL(gtk_builder_get_object(builder,         "segment_status_label"));
+    segment_view_spinbutton         = GTK_SPIN_BUTTON(gtk_builder_get_object(builder,   "segment_view_spinbutton"));
+    segment_view_adj                = GTK_ADJUSTMENT(gtk_builder_get_object(builder,    "segment_view_adj"));
+
+    caplog_path_entry               = GTK_ENTRY(gtk_builder_get_object(builder,         "caplog_path_entry"));
+    caplog_threads_spinbutton       = GTK_SPIN_BUTTON(gtk_builder_get_object(builder,   "caplog_threads_spinbutton"));
+    caplog_start_button             = GTK_BUTTON(gtk_builder_get_object(builder,        "caplog_start_button"));
+    caplog_status_label             = GTK_LABEL(gtk_builder_get_object(builder,         "caplog_status_label"));
+    caplog_frame_spinbutton         = GTK_SPIN_BUTTON(gtk_builder_get_object(builder,   "caplog_frame_spinbutton"));
+    caplog_frame_adj                = GTK_ADJUSTMENT(gtk_builder_get_object(builder,    "caplog_frame_adj"));
+
+    mask_margin_spinbutton          = GTK_SPIN_BUTTON(gtk_builder_get_object(builder,   "mask_margin_spinbutton"));
+    mask_smear_spinbutton           = GTK_SPIN_BUTTON(gtk_builder_get_object(builder,   "mask_smear_spinbutton"));
+    mask_file_chooser               = GTK_FILE_CHOOSER(gtk_builder_get_object(builder,  "mask_file_chooser"));
+    mask_fail_entry                 = GTK_ENTRY(gtk_builder_get_object(builder,         "mask_fail_entry"));
+    mask_run_button                 = GTK_BUTTON(gtk_builder_get_object(builder,        "mask_run_button"));
+    mask_status_label               = GTK_LABEL(gtk_builder_get_object(builder,         "mask_status_label"));
+
+    eye_channel_combobox            = GTK_COMBO_BOX(gtk_builder_get_object(builder,     "eye_channel_combobox"));
+    eye_bitrate_spinbutton          = GTK_SPIN_BUTTON(gtk_builder_get_object(builder,   "eye_bitrate_spinbutton"));
+    eye_threshold_spinbutton        = GTK_SPIN_BUTTON(gtk_builder_get_object(builder,   "eye_threshold_spinbutton"));
+    eye_gain_spinbutton             = GTK_SPIN_BUTTON(gtk_builder_get_object(builder,   "eye_gain_spinbutton"));
+    eye_run_button                  = GTK_BUTTON(gtk_builder_get_object(builder,        "eye_run_button"));
+    eye_status_label                = GTK_LABEL(gtk_builder_get_object(builder,         "eye_status_label"));
+    eye_drawing_area                = GTK_WIDGET(gtk_builder_get_object(builder,        "eye_drawing_area"));
+
+    sinc_checkbutton                = GTK_TOGGLE_BUTTON(gtk_builder_get_object(builder, "sinc_checkbutton"));
+    run_togglebutton                = GTK_TOGGLE_BUTTON(gtk_builder_get_object(builder, "run_togglebutton"));
+    run_status_label                = GTK_LABEL(gtk_builder_get_object(builder,         "run_status_label"));
+    roll_togglebutton               = GTK_TOGGLE_BUTTON(gtk_builder_get_object(builder, "roll_togglebutton"));
+    run_period_spinbutton           = GTK_SPIN_BUTTON(gtk_builder_get_object(builder,   "run_period_spinbutton"));
+    cursor_status_label             = GTK_LABEL(gtk_builder_get_object(builder,         "cursor_status_label"));
+
+    math_slot_combobox              = GTK_COMBO_BOX(gtk_builder_get_object(builder,     "math_slot_combobox"));
+    math_op_combobox                = GTK_COMBO_BOX(gtk_builder_get_object(builder,     "math_op_combobox"));
+    math_src_a_combobox             = GTK_COMBO_BOX(gtk_builder_get_object(builder,     "math_src_a_combobox"));
+    math_src_b_combobox             = GTK_COMBO_BOX(gtk_builder_get_object(builder,     "math_src_b_combobox"));
+    math_filter_combobox            = GTK_COMBO_BOX(gtk_builder_get_object(builder,     "math_filter_combobox"));
+    math_f1_spinbutton              = GTK_SPIN_BUTTON(gtk_builder_get_object(builder,   "math_f1_spinbutton"));
+    math_f2_spinbutton              = GTK_SPIN_BUTTON(gtk_builder_get_object(builder,   "math_f2_spinbutton"));
+    math_size_spinbutton            = GTK_SPIN_BUTTON(gtk_builder_get_object(builder,   "math_size_spinbutton"));
+    math_scale_spinbutton           = GTK_SPIN_BUTTON(gtk_builder_get_object(builder,   "math_scale_spinbutton"));
+    math_show_checkbutton           = GTK_TOGGLE_BUTTON(gtk_builder_get_object(builder, "math_show_checkbutton"));
+    math_status_label               = GTK_LABEL(gtk_builder_get_object(builder,         "math_status_label"));
+
+    autoset_run_button              = GTK_BUTTON(gtk_builder_get_object(builder,        "autoset_run_button"));
+    autoset_status_label            = GTK_LABEL(gtk_builder_get_object(builder,         "autoset_status_label"));
+
+    trend_path_entry                = GTK_ENTRY(gtk_builder_get_object(builder,         "trend_path_entry"));
+    trend_start_button              = GTK_BUTTON(gtk_builder_get_object(builder,        "trend_start_button"));
+    trend_value_combobox            = GTK_COMBO_BOX(gtk_builder_get_object(builder,     "trend_value_combobox"));
+    trend_range_combobox            = GTK_COMBO_BOX(gtk_builder_get_object(builder,     "trend_range_combobox"));
+    trend_status_label              = GTK_LABEL(gtk_builder_get_object(builder,         "trend_status_label"));
+    trend_drawing_area              = GTK_WIDGET(gtk_builder_get_object(builder,        "trend_drawing_area"));
+
+    xy_show_checkbutton             = GTK_TOGGLE_BUTTON(gtk_builder_get_object(builder, "xy_show_checkbutton"));
+    xy_persistence_spinbutton       = GTK_SPIN_BUTTON(gtk_builder_get_object(builder,   "xy_persistence_spinbutton"));
+
+    xcorr_enable_checkbutton        = GTK_TOGGLE_BUTTON(gtk_builder_get_object(builder, "xcorr_enable_checkbutton"));
+    xcorr_status_label              = GTK_LABEL(gtk_builder_get_object(builder,         "xcorr_status_label"));
+
+    capture_button                  = GTK_BUTTON(gtk_builder_get_object(builder,        "capture_button"));
     capture_samples_spinbutton      = GTK_SPIN_BUTTON(gtk_builder_get_object(builder,   "capture_samples_spinbutton"));
+    record_togglebutton             = GTK_TOGGLE_BUTTON(gtk_builder_get_object(builder, "record_togglebutton"));
 
     drawing_area                    = GTK_WIDGET(gtk_builder_get_object(builder, "drawing_area"));
 
@@ -194,13 +485,8 @@ int main(int argc, char *argv[]) {
 
     gtk_widget_show(window);
 
-    if ( access("Hantek.cfg", F_OK) ) {
-        cfg_fd = open("Hantek.cfg", O_CREAT | O_RDWR, 0666);
-        write(cfg_fd, &default_config, sizeof(default_config));
-    } else {
-        cfg_fd = open("Hantek.cfg", O_RDWR);
-    }
-    cur_config = mmap(NULL, sizeof(config_t), PROT_READ | PROT_WRITE, MAP_SHARED, cfg_fd, 0);
+    config_open(&config_store, "Hantek.cfg", &default_config, &work_config);
+    cur_config = &work_config;
 
     //Init all settings
     gtk_button_clicked(GTK_BUTTON(scope_radio));
@@ -245,17 +531,59 @@ int main(int argc, char *argv[]) {
 
     gtk_main();
 
-    munmap(cur_config, sizeof(config_t));
+    if ( bode_worker ) {
+        g_atomic_int_set(&bode_stop, 1);
+        g_thread_join(bode_worker);
+    }
+
+    on_run_stop(NULL, NULL);
+    on_roll_stop(NULL, NULL);
+
+    if ( export_worker ) {
+        g_atomic_int_set(&export_stop, 1);
+        g_thread_join(export_worker);
+    }
+
+    if ( segment_worker ) {
+        g_atomic_int_set(&segment_stop, 1);
+        g_thread_join(segment_worker);
+    }
+
+    if ( autoset_worker ) {
+        g_atomic_int_set(&autoset_stop, 1);
+        g_thread_join(autoset_worker);
+    }
+
+    on_caplog_stop(NULL, NULL);
+    on_mask_stop(NULL, NULL);
+    on_eye_stop(NULL, NULL);
+    eye_free(&eye_acc);
+    on_trend_stop(NULL, NULL);
+    trend_close(&trend_store);
+    if ( xcorr_timer )
+        g_source_remove(xcorr_timer);
+    xcorr_free(&xcorr_engine);
+    caplog_reader_close(&capture_playback);
 
-    close(cfg_fd);
+    config_close(&config_store);
 
     g_object_unref(builder);
 
-    release_interfaces(device, handle);
+    record_free(&capture_record);
+    decoder_free(&capture_decoder);
+    segment_table_free(&segment_table);
+    derived_free(&math);
 
-    libusb_close(handle);
+    frame_unref(last_frame);
+    frame_pool_free(&frame_pool);
+
+    if ( handle ) {
+        release_interfaces(device, handle);
+        libusb_close(handle);
+    }
 
 cleanup:
+    usbtrace_close(&usb_trace);
     libusb_exit(NULL);
     return status;
 }
@@ -268,15 +596,21 @@ gboolean on_channel_enable (GtkSwitch* self, gboolean state, gpointer user_data)
     g_print("%s\n", __func__);
     Hantek_command_t command;
 
+    //A record export lays the channels out as they were at its start
+    if ( export_worker )
+        return TRUE;
+
     command.idx     = 0x00;
     command.boh     = 0x0A;
     command.func    = FUNC_SCOPE_SETTING;
     if ( self == channel_enable_switch_ch1 ) {
         command.cmd     = SCOPE_ENABLE_CH1;
         cur_config->channel_enable[0] = state;
+        config_publish(&config_store, cur_config);
     } else if ( self == channel_enable_switch_ch2 ) {
         command.cmd     = SCOPE_ENABLE_CH2;
         cur_config->channel_enable[1] = state;
+        config_publish(&config_store, cur_config);
     } else
         return FALSE;
 
@@ -285,7 +619,7 @@ gboolean on_channel_enable (GtkSwitch* self, gboolean state, gpointer user_data)
     command.val[2]  = 0;
     command.val[3]  = 0;
     command.last    = 0;
-    libusb_bulk_transfer(handle, LIBUSB_ENDPOINT_OUT | 2, (unsigned char*)&command, sizeof(command), NULL, 0);
+    usb_bulk(LIBUSB_ENDPOINT_OUT | 2, (unsigned char*)&command, sizeof(command), NULL, 0);
 
     gtk_switch_set_state(self, state);
 
@@ -304,9 +638,11 @@ void on_channel_coupling(GtkComboBox *widget, gpointer user_data) {
     if ( widget == channel_coupling_combobox_ch1 ) {
         command.cmd     = SCOPE_COUPLING_CH1;
         cur_config->channel_coupling[0] = val;
+        config_publish(&config_store, cur_config);
     } else if ( widget == channel_coupling_combobox_ch2 ) {
         command.cmd     = SCOPE_COUPLING_CH2;
         cur_config->channel_coupling[1] = val;
+        config_publish(&config_store, cur_config);
     } else
         return;
 
@@ -315,7 +651,7 @@ void on_channel_coupling(GtkComboBox *widget, gpointer user_data) {
     command.val[2]  = 0;
     command.val[3]  = 0;
     command.last    = 0;
-    libusb_bulk_transfer(handle, LIBUSB_ENDPOINT_OUT | 2, (unsigned char*)&command, sizeof(command), NULL, 0);
+    usb_bulk(LIBUSB_ENDPOINT_OUT | 2, (unsigned char*)&command, sizeof(command), NULL, 0);
 }
 
 void on_channel_probe(GtkComboBox *widget, gpointer user_data) {
@@ -331,10 +667,12 @@ void on_channel_probe(GtkComboBox *widget, gpointer user_data) {
         command.cmd     = SCOPE_PROBEX_CH1;
         channel_scale_combobox = channel_scale_combobox_ch1;
         cur_config->channel_probe[0] = probe_val;
+        config_publish(&config_store, cur_config);
     } else if ( widget == channel_probe_combobox_ch2 ) {
         command.cmd     = SCOPE_PROBEX_CH2;
         channel_scale_combobox = channel_scale_combobox_ch2;
         cur_config->channel_probe[1] = probe_val;
+        config_publish(&config_store, cur_config);
     } else
         return;
 
@@ -343,7 +681,7 @@ void on_channel_probe(GtkComboBox *widget, gpointer user_data) {
     command.val[2]  = 0;
     command.val[3]  = 0;
     command.last    = 0;
-    libusb_bulk_transfer(handle, LIBUSB_ENDPOINT_OUT | 2, (unsigned char*)&command, sizeof(command), NULL, 0);
+    usb_bulk(LIBUSB_ENDPOINT_OUT | 2, (unsigned char*)&command, sizeof(command), NULL, 0);
 
     int scale_val = gtk_combo_box_get_active(channel_scale_combobox);
 
@@ -385,11 +723,13 @@ void on_channel_scale(GtkComboBox *widget, gpointer user_data) {
         adj = channel_offset_adj_ch1;
         channel = 0;
         cur_config->channel_scale[0] = val;
+        config_publish(&config_store, cur_config);
     } else if ( widget == channel_scale_combobox_ch2 ) {
         command.cmd     = SCOPE_SCALE_CH2;
         adj = channel_offset_adj_ch2;
         channel = 1;
         cur_config->channel_scale[1] = val;
+        config_publish(&config_store, cur_config);
     } else
         return;
 
@@ -398,7 +738,7 @@ void on_channel_scale(GtkComboBox *widget, gpointer user_data) {
     command.val[2]  = 0;
     command.val[3]  = 0;
     command.last    = 0;
-    libusb_bulk_transfer(handle, LIBUSB_ENDPOINT_OUT | 2, (unsigned char*)&command, sizeof(command), NULL, 0);
+    usb_bulk(LIBUSB_ENDPOINT_OUT | 2, (unsigned char*)&command, sizeof(command), NULL, 0);
 
     gtk_adjustment_set_lower(adj, -4*real_val);
     gtk_adjustment_set_upper(adj, 4*real_val);
@@ -428,11 +768,13 @@ void on_channel_offset(GtkSpinButton *spin_button, GtkScrollType scroll, gpointe
         channel_scale_combobox = channel_scale_combobox_ch1;
         channel_offset_adj = channel_offset_adj_ch1;
         cur_config->channel_offset[0] = val;
+        config_publish(&config_store, cur_config);
     } else if ( spin_button == channel_offset_spinbutton_ch2 ) {
         command.cmd     = SCOPE_OFFSET_CH2;
         channel_scale_combobox = channel_scale_combobox_ch2;
         channel_offset_adj = channel_offset_adj_ch2;
         cur_config->channel_offset[1] = val;
+        config_publish(&config_store, cur_config);
     } else {
         return;
     }
@@ -446,7 +788,7 @@ void on_channel_offset(GtkSpinButton *spin_button, GtkScrollType scroll, gpointe
     command.val[2]  = 0;
     command.val[3]  = 0;
     command.last    = 0;
-    libusb_bulk_transfer(handle, LIBUSB_ENDPOINT_OUT | 2, (unsigned char*)&command, sizeof(command), NULL, 0);
+    usb_bulk(LIBUSB_ENDPOINT_OUT | 2, (unsigned char*)&command, sizeof(command), NULL, 0);
 }
 
 gboolean on_channel_bwlimit(GtkSwitch* self, gboolean state, gpointer user_data) {
@@ -459,9 +801,11 @@ gboolean on_channel_bwlimit(GtkSwitch* self, gboolean state, gpointer user_data)
     if ( self == channel_bwlimit_switch_ch1 ) {
         command.cmd     = SCOPE_BWLIMIT_CH1;
         cur_config->channel_bwlimit[0] = state;
+        config_publish(&config_store, cur_config);
     } else if ( self == channel_bwlimit_switch_ch1 ) {
         command.cmd     = SCOPE_BWLIMIT_CH2;
         cur_config->channel_bwlimit[1] = state;
+        config_publish(&config_store, cur_config);
     } else
         return FALSE;
 
@@ -470,7 +814,7 @@ gboolean on_channel_bwlimit(GtkSwitch* self, gboolean state, gpointer user_data)
     command.val[2]  = 0;
     command.val[3]  = 0;
     command.last    = 0;
-    libusb_bulk_transfer(handle, LIBUSB_ENDPOINT_OUT | 2, (unsigned char*)&command, sizeof(command), NULL, 0);
+    usb_bulk(LIBUSB_ENDPOINT_OUT | 2, (unsigned char*)&command, sizeof(command), NULL, 0);
 
     gtk_switch_set_state(self, state);
 
@@ -491,6 +835,7 @@ void on_time_scale(GtkComboBox *widget, gpointer user_data) {
     gtk_tree_model_get(gtk_combo_box_get_model(widget), &active, 1, &real_val, -1);
 
     cur_config->time_scale = val;
+    config_publish(&config_store, cur_config);
 
     command.idx     = 0x00;
     command.boh     = 0x0A;
@@ -501,7 +846,7 @@ void on_time_scale(GtkComboBox *widget, gpointer user_data) {
     command.val[2]  = 0;
     command.val[3]  = 0;
     command.last    = 0;
-    libusb_bulk_transfer(handle, LIBUSB_ENDPOINT_OUT | 2, (unsigned char*)&command, sizeof(command), NULL, 0);
+    usb_bulk(LIBUSB_ENDPOINT_OUT | 2, (unsigned char*)&command, sizeof(command), NULL, 0);
 
     gtk_adjustment_set_lower(time_offset_adj, -15*real_val);
     gtk_adjustment_set_upper(time_offset_adj, 15*real_val);
@@ -515,6 +860,7 @@ void on_time_offset(GtkSpinButton *spin_button, GtkScrollType scroll, gpointer u
     double val = -gtk_spin_button_get_value(spin_button);
 
     cur_config->time_offset = -val;
+    config_publish(&config_store, cur_config);
 
     val-=gtk_adjustment_get_lower(time_offset_adj)/15*6;
     val*=15*2*25;
@@ -527,7 +873,7 @@ void on_time_offset(GtkSpinButton *spin_button, GtkScrollType scroll, gpointer u
     command.val32   = (int)roundf(val);
     command.size[1] = 0;
     command.last    = 0;
-    libusb_bulk_transfer(handle, LIBUSB_ENDPOINT_OUT | 2, (unsigned char*)&command, sizeof(command), NULL, 0);
+    usb_bulk(LIBUSB_ENDPOINT_OUT | 2, (unsigned char*)&command, sizeof(command), NULL, 0);
 }
 
 void on_trigger_source (GtkComboBox *widget, gpointer user_data) {
@@ -539,6 +885,7 @@ void on_trigger_source (GtkComboBox *widget, gpointer user_data) {
     int channel = atoi(gtk_combo_box_get_active_id(widget));
 
     cur_config->trigger_source = channel;
+    config_publish(&config_store, cur_config);
 
     command.idx     = 0x00;
     command.boh     = 0x0A;
@@ -549,7 +896,7 @@ void on_trigger_source (GtkComboBox *widget, gpointer user_data) {
     command.val[2]  = 0;
     command.val[3]  = 0;
     command.last    = 0;
-    libusb_bulk_transfer(handle, LIBUSB_ENDPOINT_OUT | 2, (unsigned char*)&command, sizeof(command), NULL, 0);
+    usb_bulk(LIBUSB_ENDPOINT_OUT | 2, (unsigned char*)&command, sizeof(command), NULL, 0);
 
     if ( channel == 0 ) {
         channel_scale_combobox = channel_scale_combobox_ch1;
@@ -574,6 +921,7 @@ void on_trigger_slope (GtkComboBox *widget, gpointer user_data) {
     int val = atoi(gtk_combo_box_get_active_id(widget));
 
     cur_config->trigger_slope = val;
+    config_publish(&config_store, cur_config);
 
     command.idx     = 0x00;
     command.boh     = 0x0A;
@@ -584,7 +932,7 @@ void on_trigger_slope (GtkComboBox *widget, gpointer user_data) {
     command.val[2]  = 0;
     command.val[3]  = 0;
     command.last    = 0;
-    libusb_bulk_transfer(handle, LIBUSB_ENDPOINT_OUT | 2, (unsigned char*)&command, sizeof(command), NULL, 0);
+    usb_bulk(LIBUSB_ENDPOINT_OUT | 2, (unsigned char*)&command, sizeof(command), NULL, 0);
 }
 
 void on_trigger_mode (GtkComboBox *widget, gpointer user_data) {
@@ -593,6 +941,7 @@ void on_trigger_mode (GtkComboBox *widget, gpointer user_data) {
     int val = atoi(gtk_combo_box_get_active_id(widget));
 
     cur_config->trigger_mode = val;
+    config_publish(&config_store, cur_config);
 
     command.idx     = 0x00;
     command.boh     = 0x0A;
@@ -603,7 +952,7 @@ void on_trigger_mode (GtkComboBox *widget, gpointer user_data) {
     command.val[2]  = 0;
     command.val[3]  = 0;
     command.last    = 0;
-    libusb_bulk_transfer(handle, LIBUSB_ENDPOINT_OUT | 2, (unsigned char*)&command, sizeof(command), NULL, 0);
+    usb_bulk(LIBUSB_ENDPOINT_OUT | 2, (unsigned char*)&command, sizeof(command), NULL, 0);
 }
 
 void on_trigger_level(GtkSpinButton *spin_button, GtkScrollType scroll, gpointer user_data) {
@@ -613,6 +962,7 @@ void on_trigger_level(GtkSpinButton *spin_button, GtkScrollType scroll, gpointer
     double val = gtk_spin_button_get_value(spin_button);
 
     cur_config->trigger_level = val;
+    config_publish(&config_store, cur_config);
 
     val-=gtk_adjustment_get_lower(trigger_level_adj);
     val*=200;
@@ -627,7 +977,7 @@ void on_trigger_level(GtkSpinButton *spin_button, GtkScrollType scroll, gpointer
     command.val[2]  = 0;
     command.val[3]  = 0;
     command.last    = 0;
-    libusb_bulk_transfer(handle, LIBUSB_ENDPOINT_OUT | 2, (unsigned char*)&command, sizeof(command), NULL, 0);
+    usb_bulk(LIBUSB_ENDPOINT_OUT | 2, (unsigned char*)&command, sizeof(command), NULL, 0);
 }
 
 void on_start(GtkButton *button, gpointer user_data) {
@@ -643,7 +993,7 @@ void on_start(GtkButton *button, gpointer user_data) {
     command.val[2]  = 0;
     command.val[3]  = 0;
     command.last    = 0;
-    libusb_bulk_transfer(handle, LIBUSB_ENDPOINT_OUT | 2, (unsigned char*)&command, sizeof(command), NULL, 0);
+    usb_bulk(LIBUSB_ENDPOINT_OUT | 2, (unsigned char*)&command, sizeof(command), NULL, 0);
 }
 
 void on_stop(GtkButton *button, gpointer user_data) {
@@ -659,7 +1009,7 @@ void on_stop(GtkButton *button, gpointer user_data) {
     command.val[2]  = 0;
     command.val[3]  = 0;
     command.last    = 0;
-    libusb_bulk_transfer(handle, LIBUSB_ENDPOINT_OUT | 2, (unsigned char*)&command, sizeof(command), NULL, 0);
+    usb_bulk(LIBUSB_ENDPOINT_OUT | 2, (unsigned char*)&command, sizeof(command), NULL, 0);
 }
 
 void on_awg_type(GtkComboBox *widget, gpointer user_data) {
@@ -668,6 +1018,7 @@ void on_awg_type(GtkComboBox *widget, gpointer user_data) {
     int val = atoi(gtk_combo_box_get_active_id(widget));
 
     cur_config->awg_type = val;
+    config_publish(&config_store, cur_config);
 
     command.idx     = 0x00;
     command.boh     = 0x0A;
@@ -679,7 +1030,7 @@ void on_awg_type(GtkComboBox *widget, gpointer user_data) {
     command.val[2]  = 0;
     command.val[3]  = 0;
     command.last    = 0;
-    libusb_bulk_transfer(handle, LIBUSB_ENDPOINT_OUT | 2, (unsigned char*)&command, sizeof(command), NULL, 0);
+    usb_bulk(LIBUSB_ENDPOINT_OUT | 2, (unsigned char*)&command, sizeof(command), NULL, 0);
 }
 
 void on_awg_freq(GtkSpinButton *spin_button, GtkScrollType scroll, gpointer user_data) {
@@ -688,6 +1039,7 @@ void on_awg_freq(GtkSpinButton *spin_button, GtkScrollType scroll, gpointer user
     float val = gtk_spin_button_get_value_as_int(spin_button);
 
     cur_config->awg_frequency = val;
+    config_publish(&config_store, cur_config);
 
     command.idx     = 0x00;
     command.boh     = 0x0A;
@@ -695,7 +1047,7 @@ void on_awg_freq(GtkSpinButton *spin_button, GtkScrollType scroll, gpointer user
     command.cmd     = AWG_FREQ;
     command.val32   = val;
     command.last    = 0;
-    libusb_bulk_transfer(handle, LIBUSB_ENDPOINT_OUT | 2, (unsigned char*)&command, sizeof(command), NULL, 0);
+    usb_bulk(LIBUSB_ENDPOINT_OUT | 2, (unsigned char*)&command, sizeof(command), NULL, 0);
 }
 
 void on_awg_amp(GtkSpinButton *spin_button, GtkScrollType scroll, gpointer user_data) {
@@ -704,6 +1056,7 @@ void on_awg_amp(GtkSpinButton *spin_button, GtkScrollType scroll, gpointer user_
     float val = gtk_spin_button_get_value(spin_button);
 
     cur_config->awg_amplitude = val;
+    config_publish(&config_store, cur_config);
 
     command.idx     = 0x00;
     command.boh     = 0x0A;
@@ -712,7 +1065,7 @@ void on_awg_amp(GtkSpinButton *spin_button, GtkScrollType scroll, gpointer user_
     command.size[0] = abs((val*1000));
     command.size[1] = (val<0);
     command.last    = 0;
-    libusb_bulk_transfer(handle, LIBUSB_ENDPOINT_OUT | 2, (unsigned char*)&command, sizeof(command), NULL, 0);
+    usb_bulk(LIBUSB_ENDPOINT_OUT | 2, (unsigned char*)&command, sizeof(command), NULL, 0);
 }
 
 void on_awg_offset(GtkSpinButton *spin_button, GtkScrollType scroll, gpointer user_data) {
@@ -721,6 +1074,7 @@ void on_awg_offset(GtkSpinButton *spin_button, GtkScrollType scroll, gpointer us
     float val = gtk_spin_button_get_value(spin_button);
 
     cur_config->awg_offset = val;
+    config_publish(&config_store, cur_config);
 
     command.idx     = 0x00;
     command.boh     = 0x0A;
@@ -729,7 +1083,7 @@ void on_awg_offset(GtkSpinButton *spin_button, GtkScrollType scroll, gpointer us
     command.size[0] = abs((val*1000));
     command.size[1] = (val<0);
     command.last    = 0;
-    libusb_bulk_transfer(handle, LIBUSB_ENDPOINT_OUT | 2, (unsigned char*)&command, sizeof(command), NULL, 0);
+    usb_bulk(LIBUSB_ENDPOINT_OUT | 2, (unsigned char*)&command, sizeof(command), NULL, 0);
 }
 
 void on_awg_square_duty(GtkSpinButton *spin_button, GtkScrollType scroll, gpointer user_data) {
@@ -738,6 +1092,7 @@ void on_awg_square_duty(GtkSpinButton *spin_button, GtkScrollType scroll, gpoint
     float val = gtk_spin_button_get_value(spin_button);
 
     cur_config->awg_squareduty = val;
+    config_publish(&config_store, cur_config);
 
     command.idx     = 0x00;
     command.boh     = 0x0A;
@@ -746,7 +1101,7 @@ void on_awg_square_duty(GtkSpinButton *spin_button, GtkScrollType scroll, gpoint
     command.size[0] = val*100;
     command.size[1] = 0;
     command.last    = 0;
-    libusb_bulk_transfer(handle, LIBUSB_ENDPOINT_OUT | 2, (unsigned char*)&command, sizeof(command), NULL, 0);
+    usb_bulk(LIBUSB_ENDPOINT_OUT | 2, (unsigned char*)&command, sizeof(command), NULL, 0);
 }
 
 void on_awg_ramp_duty(GtkSpinButton *spin_button, GtkScrollType scroll, gpointer user_data) {
@@ -755,6 +1110,7 @@ void on_awg_ramp_duty(GtkSpinButton *spin_button, GtkScrollType scroll, gpointer
     float val = gtk_spin_button_get_value(spin_button);
 
     cur_config->awg_rampduty = val;
+    config_publish(&config_store, cur_config);
 
     command.idx     = 0x00;
     command.boh     = 0x0A;
@@ -763,7 +1119,7 @@ void on_awg_ramp_duty(GtkSpinButton *spin_button, GtkScrollType scroll, gpointer
     command.size[0] = val*100;
     command.size[1] = 0;
     command.last    = 0;
-    libusb_bulk_transfer(handle, LIBUSB_ENDPOINT_OUT | 2, (unsigned char*)&command, sizeof(command), NULL, 0);
+    usb_bulk(LIBUSB_ENDPOINT_OUT | 2, (unsigned char*)&command, sizeof(command), NULL, 0);
 }
 
 void on_awg_trap_duty(GtkSpinButton *spin_button, GtkScrollType scroll, gpointer user_data) {
@@ -776,6 +1132,7 @@ void on_awg_trap_duty(GtkSpinButton *spin_button, GtkScrollType scroll, gpointer
     if      ( spin_button == awg_trapriseduty_spinbutton ) cur_config->awg_trapriseduty = val_rise;
     else if ( spin_button == awg_traphighduty_spinbutton ) cur_config->awg_traphighduty = val_high;
     else if ( spin_button == awg_trapfallduty_spinbutton ) cur_config->awg_trapfallduty = val_fall;
+    config_publish(&config_store, cur_config);
 
     command.idx     = 0x00;
     command.boh     = 0x0A;
@@ -786,7 +1143,7 @@ void on_awg_trap_duty(GtkSpinButton *spin_button, GtkScrollType scroll, gpointer
     command.val[2]  = val_fall*100;
     command.val[3]  = 0;
     command.last    = 0;
-    libusb_bulk_transfer(handle, LIBUSB_ENDPOINT_OUT | 2, (unsigned char*)&command, sizeof(command), NULL, 0);
+    usb_bulk(LIBUSB_ENDPOINT_OUT | 2, (unsigned char*)&command, sizeof(command), NULL, 0);
 }
 
 void on_awg_start(GtkButton *button, gpointer user_data) {
@@ -802,7 +1159,7 @@ void on_awg_start(GtkButton *button, gpointer user_data) {
     command.val[2]  = 0;
     command.val[3]  = 0;
     command.last    = 0;
-    libusb_bulk_transfer(handle, LIBUSB_ENDPOINT_OUT | 2, (unsigned char*)&command, sizeof(command), NULL, 0);
+    usb_bulk(LIBUSB_ENDPOINT_OUT | 2, (unsigned char*)&command, sizeof(command), NULL, 0);
 }
 
 void on_awg_stop(GtkButton *button, gpointer user_data) {
@@ -818,7 +1175,102 @@ void on_awg_stop(GtkButton *button, gpointer user_data) {
     command.val[2]  = 0;
     command.val[3]  = 0;
     command.last    = 0;
-    libusb_bulk_transfer(handle, LIBUSB_ENDPOINT_OUT | 2, (unsigned char*)&command, sizeof(command), NULL, 0);
+    usb_bulk(LIBUSB_ENDPOINT_OUT | 2, (unsigned char*)&command, sizeof(command), NULL, 0);
+}
+
+//The slots have no known upload command, so a waveform is only generated
+//and shown, resampled to the slot length
+static void arb_preview(const float* points, int num_points, gint64 start) {
+    char* text;
+
+    arb_resample(points, num_points, arb_points, AWG_ARB_POINTS);
+    arb_num_points = AWG_ARB_POINTS;
+
+    text = g_strdup_printf("%d points from %d in %.1f ms, upload not supported", AWG_ARB_POINTS, num_points,
+                           (g_get_monotonic_time()-start)/1000.0);
+    gtk_label_set_text(arb_status_label, text);
+    g_free(text);
+
+    gtk_widget_queue_draw(arb_drawing_area);
+}
+
+void on_arb_preview_expression(GtkButton *button, gpointer user_data) {
+    g_print("%s\n", __func__);
+    static float points[AWG_ARB_POINTS];
+    gint64 start = g_get_monotonic_time();
+    arb_expr_t expr;
+
+    if ( arb_expr_compile(&expr, gtk_entry_get_text(arb_expression_entry)) ) {
+        gtk_label_set_text(arb_status_label, "Invalid expression");
+        return;
+    }
+
+    arb_expr_eval(&expr, points, AWG_ARB_POINTS);
+    arb_preview(points, AWG_ARB_POINTS, start);
+}
+
+void on_arb_preview_file(GtkButton *button, gpointer user_data) {
+    g_print("%s\n", __func__);
+    static float points[AWG_ARB_POINTS*16];
+    gint64 start = g_get_monotonic_time();
+    char* path = gtk_file_chooser_get_filename(arb_file_chooser);
+    const char* ext;
+    int num_points;
+
+    if ( path == NULL ) {
+        gtk_label_set_text(arb_status_label, "No file selected");
+        return;
+    }
+
+    ext = strrchr(path, '.');
+    if ( ext && !strcasecmp(ext, ".csv") )
+        num_points = arb_load_csv(path, points, sizeof(points)/sizeof(points[0]));
+    else
+        num_points = arb_load_raw(path, points, sizeof(points)/sizeof(points[0]));
+    g_free(path);
+
+    if ( num_points <= 0 ) {
+        gtk_label_set_text(arb_status_label, "No points in file");
+        return;
+    }
+
+    arb_normalize(points, num_points);
+    arb_preview(points, num_points, start);
+}
+
+//One period, -1 at the bottom and +1 at the top, clipped beyond that
+gboolean arb_draw_callback(GtkWidget *widget, cairo_t *cr, gpointer data) {
+    int width  = gtk_widget_get_allocated_width(widget);
+    int height = gtk_widget_get_allocated_height(widget);
+    double dashes[] = { 5.0, 5.0 };
+
+    cairo_set_source_rgb(cr, 0, 0, 0);
+    cairo_paint(cr);
+
+    cairo_set_dash(cr, dashes, 2, 0);
+    cairo_set_line_width(cr, 0.3);
+    cairo_set_source_rgb(cr, 0.9, 0.9, 0.9);
+    cairo_move_to(cr, 0, height/2);
+    cairo_line_to(cr, width, height/2);
+    cairo_stroke(cr);
+    cairo_set_dash(cr, NULL, 0, 0);
+
+    if ( arb_num_points < 2 )
+        return FALSE;
+
+    cairo_set_line_width(cr, 1);
+    cairo_set_source_rgb(cr, 1, 1, 0);
+    for (int i=0;i<arb_num_points;i++) {
+        double x = (double)i*width/(arb_num_points-1);
+        double y = (1-fmin(fmax(arb_points[i], -1), 1))*height/2;
+        if ( i == 0 )
+            cairo_move_to(cr, x, y);
+        else
+            cairo_line_to(cr, x, y);
+    }
+    cairo_stroke(cr);
+
+    return FALSE;
 }
 
 void on_radio(GtkRadioButton *button, gpointer   user_data) {
@@ -839,48 +1291,259 @@ void on_radio(GtkRadioButton *button, gpointer   user_data) {
     command.val[2]  = 0;
     command.val[3]  = 0;
     command.last    = 0;
-    libusb_bulk_transfer(handle, LIBUSB_ENDPOINT_OUT | 2, (unsigned char*)&command, sizeof(command), NULL, 0);
+    usb_bulk(LIBUSB_ENDPOINT_OUT | 2, (unsigned char*)&command, sizeof(command), NULL, 0);
+}
+
+//Flags a full record on its button; further captures are not appended until Clear
+static void record_full_show(void) {
+    bool full;
+
+    g_mutex_lock(&record_lock);
+    full = capture_record.full;
+    g_mutex_unlock(&record_lock);
+    gtk_button_set_label(GTK_BUTTON(record_togglebutton), full ? "Record (full)" : "Record");
 }
 
 void on_capture_button_clicked(GtkButton *button, gpointer user_data) {
     g_print("%s\n", __func__);
-    Hantek_command_t command;
-    int num_channels = cur_config->channel_enable[0]+cur_config->channel_enable[1];
-    int num_samples  = cur_config->num_samples*num_channels;
-    int count = 0;
+    frame_t* frame = capture_pooled(NULL);
 
-    while(count < num_samples) {
-        int length, actual_length;
-        command.idx     = 0;
-        command.boh     = 0x0A;
-        command.func    = FUNC_SCOPE_CAPTURE;
-        command.cmd     = SCOPE_START_RECV;
-        command.size[0] = num_samples/2;
-        command.size[1] = num_samples/2;
-        libusb_bulk_transfer(handle, LIBUSB_ENDPOINT_OUT | 2, (unsigned char*)&command, sizeof(command), NULL, 0);
-
-        length = (num_samples-count)<64?(num_samples-count):64;
-        libusb_bulk_transfer(handle, LIBUSB_ENDPOINT_IN | 1, &(capture_buffer[count]), length, &actual_length, 0);
-        count+=actual_length;
+    if ( frame == NULL )
+        return;
+    frame_unref(last_frame);
+    last_frame = frame;
+
+    if ( trend_logging )
+        trend_frame(frame);
+    if ( xy_show && frame->num_channels == 2 )
+        xy_push(&xy_view, frame->data, frame->num_samples, frame->time_us);
+    if ( g_atomic_int_get(&xcorr_enabled) && frame->num_channels == 2 )
+        xcorr_frame(frame);
+
+    g_mutex_lock(&record_lock);
+    if ( !gtk_toggle_button_get_active(record_togglebutton) ) {
+        record_clear(&capture_record);
+        decoder_reset(&capture_decoder);
+        view_first = 0;
+        view_span  = 0;
+    }
+    if ( record_append(&capture_record, frame->data, frame->num_samples, frame->num_channels, frame->config.channel_enable) == 0 ) {
+        record_config = frame->config;
+        decoder_run(&capture_decoder, capture_record.samples[0], capture_record.samples[1], capture_record.length);
     }
+    g_mutex_unlock(&record_lock);
 
+    record_full_show();
+    cursor_update();
     gtk_widget_queue_draw(drawing_area);
 }
 
+static inline double sample_to_y(double val, int height) {
+    return height - (val-29)*height/202.0;
+}
+
+//Decoded words as boxes along the top of the trace, START/STOP as ticks
+static void draw_annotations(cairo_t *cr, int width, double first, double span) {
+    double scale = width/span;
+    size_t i = decoder_find(&capture_decoder, first > 0 ? (size_t)first : 0);
+
+    cairo_set_font_size(cr, 10);
+    cairo_set_line_width(cr, 1);
+
+    for (;i<capture_decoder.num_anns;i++) {
+        const decode_ann_t* ann = &capture_decoder.anns[i];
+        double x0 = (ann->start-first)*scale;
+        double x1 = (ann->end-first)*scale;
+        char text[8];
+
+        if ( x0 > width )
+            break;
+
+        switch (ann->type) {
+            case ANN_START:
+            case ANN_STOP:
+                if ( ann->type == ANN_START )
+                    cairo_set_source_rgb(cr, 0, 1, 0);
+                else
+                    cairo_set_source_rgb(cr, 1, 0, 0);
+                cairo_move_to(cr, x0, 0);
+                cairo_line_to(cr, x0, 16);
+                cairo_stroke(cr);
+                break;
+            case ANN_ADDRESS:
+            case ANN_DATA:
+                if ( ann->flags & (ANN_FLAG_ERROR | ANN_FLAG_NACK) )
+                    cairo_set_source_rgb(cr, 1, 0.3, 0.3);
+                else
+                    cairo_set_source_rgb(cr, 0, 0.8, 1);
+                cairo_rectangle(cr, x0, 2, x1-x0 > 1 ? x1-x0 : 1, 14);
+                cairo_stroke(cr);
+
+                if ( x1-x0 < 16 )
+                    break;
+                if ( ann->type == ANN_ADDRESS )
+                    snprintf(text, sizeof(text), "%02X%c", ann->value, ann->flags & ANN_FLAG_READ ? 'R' : 'W');
+                else
+                    snprintf(text, sizeof(text), "%02X", ann->value);
+                cairo_move_to(cr, x0+2, 13);
+                cairo_show_text(cr, text);
+                break;
+        }
+    }
+}
+
+//Points the math channels at capture_record, scaled with the settings it
+//was taken with, so drawing and the analyze stage share one conversion
+static void math_set_input(void) {
+    const config_t* config = &record_config;
+    double volts_per_div[2], offset[2];
+
+    for (int ch=0;ch<2;ch++) {
+        volts_per_div[ch] = scale_volts_per_div(config->channel_probe[ch], config->channel_scale[ch]);
+        offset[ch]        = config->channel_offset[ch];
+    }
+    derived_set_input(&math, capture_record.samples[0], capture_record.samples[1], capture_record.length,
+                      capture_record.generation, scale_sample_rate(config->time_scale), volts_per_div, offset);
+}
+
+//Math channels that are shown, centered, at their own scale per division.
+//Only now are they (and whatever they use) brought up to date.
+static void draw_math(cairo_t *cr, int width, int height, double first, double span) {
+    static const double colors[DERIVED_MAX][3] = { { 1, 0, 1 }, { 0, 1, 1 }, { 1, 0.5, 0 }, { 0.5, 0.5, 1 } };
+    double step = span/width;
+
+    math_set_input();
+
+    for (int k=0;k<DERIVED_MAX;k++) {
+        const float* data;
+        double scale = height/8.0/math_scale[k];
+
+        if ( !math_show[k] || (data = derived_get(&math, 2+k)) == NULL )
+            continue;
+
+        cairo_set_source_rgb(cr, colors[k][0], colors[k][1], colors[k][2]);
+
+        if ( step <= 1 ) {
+            size_t from = first > 0 ? (size_t)first : 0;
+            size_t to   = (size_t)ceil(first+span)+1;
+            if ( to > capture_record.length )
+                to = capture_record.length;
+
+            for (size_t i=from;i<to;i++) {
+                double x = (i-first)/step;
+                if ( i == from )
+                    cairo_move_to(cr, x, height/2 - data[i]*scale);
+                else
+                    cairo_line_to(cr, x, height/2 - data[i]*scale);
+            }
+        } else {
+            for (int x=0;x<width;x++) {
+                double start = first+x*step;
+                size_t from = start > 0 ? (size_t)start : 0;
+                derived_span_t span = derived_range(&math, 2+k, from, (size_t)(start+step));
+
+                if ( span.min > span.max )
+                    continue;
+                cairo_move_to(cr, x, height/2 - span.min*scale);
+                cairo_line_to(cr, x, height/2 - span.max*scale);
+            }
+        }
+        cairo_stroke(cr);
+    }
+}
+
+//Mask limits as red lines over the first frame of the record
+static void draw_mask(cairo_t *cr, int height, double first, double step) {
+    cairo_set_source_rgb(cr, 1, 0, 0);
+
+    for (int ch=0;ch<2;ch++) {
+        const uint8_t* limits[2] = { test_mask.lo[ch], test_mask.hi[ch] };
+
+        if ( !cur_config->channel_enable[ch] )
+            continue;
+
+        for (int k=0;k<2;k++) {
+            for (int i=0;i<test_mask.num_samples;i++) {
+                double x = (i-first)/step;
+                double y = sample_to_y(limits[k][i], height);
+                if ( i == 0 )
+                    cairo_move_to(cr, x, y);
+                else
+                    cairo_line_to(cr, x, y);
+            }
+            cairo_stroke(cr);
+        }
+    }
+}
+
+//One image of the density, both axes spanning raw 29..231 like the traces
+static void draw_xy(cairo_t *cr, int width, int height) {
+    double dashes[] = { 5.0, 5.0 };
+    cairo_surface_t* surface;
+
+    cairo_set_dash(cr, dashes, 2, 0);
+    cairo_set_line_width(cr, 0.3);
+    cairo_set_source_rgb(cr, 0.9, 0.9, 0.9);
+    for(int i=1;i<8;i++) {
+        cairo_move_to(cr, i*width/8, 0);
+        cairo_line_to(cr, i*width/8, height);
+        cairo_move_to(cr, 0, i*height/8);
+        cairo_line_to(cr, width, i*height/8);
+    }
+    cairo_stroke(cr);
+    cairo_set_dash(cr, NULL, 0, 0);
+
+    surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, XY_SIZE, XY_SIZE);
+    cairo_surface_flush(surface);
+    xy_render(&xy_view, (uint32_t*)cairo_image_surface_get_data(surface), cairo_image_surface_get_stride(surface)/4);
+    cairo_surface_mark_dirty(surface);
+
+    cairo_save(cr);
+    cairo_scale(cr, width/202.0, height/202.0);
+    cairo_set_source_surface(cr, surface, -29, -(XY_SIZE-1-231));
+    cairo_pattern_set_filter(cairo_get_source(cr), CAIRO_FILTER_NEAREST);
+    cairo_paint(cr);
+    cairo_restore(cr);
+    cairo_surface_destroy(surface);
+}
+
+//Oldest column on the left: the surface is drawn in two pieces split at roll_x
+static void draw_roll(cairo_t *cr, int width, int height) {
+    int columns = cairo_image_surface_get_width(roll_surface);
+    int rows    = cairo_image_surface_get_height(roll_surface);
+
+    cairo_save(cr);
+    cairo_scale(cr, (double)width/columns, (double)height/rows);
+
+    cairo_set_source_surface(cr, roll_surface, -roll_x, 0);
+    cairo_pattern_set_filter(cairo_get_source(cr), CAIRO_FILTER_NEAREST);
+    cairo_rectangle(cr, 0, 0, columns-roll_x, rows);
+    cairo_fill(cr);
+
+    cairo_set_source_surface(cr, roll_surface, columns-roll_x, 0);
+    cairo_pattern_set_filter(cairo_get_source(cr), CAIRO_FILTER_NEAREST);
+    cairo_rectangle(cr, columns-roll_x, 0, roll_x, rows);
+    cairo_fill(cr);
+
+    cairo_restore(cr);
+}
+
 gboolean draw_callback(GtkWidget *widget, cairo_t *cr, gpointer data) {
     g_print("%s\n", __func__);
 
     int width  = gtk_widget_get_allocated_width(widget);
     int height = gtk_widget_get_allocated_height(widget);
-    int num_channels = cur_config->channel_enable[0]+cur_config->channel_enable[1];
-    int num_samples  = cur_config->num_samples*num_channels;
-
     double dashes[] = { 5.0, 5.0 };
 
     cairo_set_source_rgb(cr, 0, 0, 0);
     cairo_paint(cr);
     cairo_stroke(cr);
 
+    if ( xy_show ) {
+        draw_xy(cr, width, height);
+        return FALSE;
+    }
+
     cairo_set_line_width(cr, 0.5);
 
     cairo_set_dash(cr, dashes, 2, 0);
@@ -900,6 +1563,25 @@ gboolean draw_callback(GtkWidget *widget, cairo_t *cr, gpointer data) {
 
     cairo_set_dash(cr, NULL, 0, 0);
     cairo_set_line_width(cr, 0.5);
+
+    if ( roll_surface ) {
+        draw_roll(cr, width, height);
+        return FALSE;
+    }
+
+    g_mutex_lock(&record_lock);
+    if ( capture_record.length == 0 || width <= 0 ) {
+        g_mutex_unlock(&record_lock);
+        return FALSE;
+    }
+
+    double span = view_span > 0 ? view_span : capture_record.length;
+    double step = span/width;
+    record_span_t spans[width];
+
+    if ( test_mask.valid )
+        draw_mask(cr, height, view_first, step);
+
     for (int ch=0;ch<2;ch++) {
         if ( cur_config->channel_enable[ch] ) {
             if ( ch == 0 )
@@ -907,17 +1589,1942 @@ gboolean draw_callback(GtkWidget *widget, cairo_t *cr, gpointer data) {
             else
                 cairo_set_source_rgb(cr, 0, 1, 0);
 
-            cairo_move_to(cr, 0, height - ((*((uint8_t(*)[cur_config->num_samples][num_channels])capture_buffer))[0][ch]-29)*height/202);
-
-            for(int x=1;x<cur_config->num_samples;x++) cairo_line_to(cr, x*width/cur_config->num_samples, height - ((*((uint8_t(*)[cur_config->num_samples][num_channels])capture_buffer))[x][ch]-29)*height/202);
+            if ( step < 1 && gtk_toggle_button_get_active(sinc_checkbutton) ) {
+                //Zoomed in past the samples: sin(x)/x at every column
+                float values[width];
+                double from = view_first > 0 ? view_first : 0;
+                double to   = view_first+span < capture_record.length-1 ? view_first+span : capture_record.length-1;
+                int x0 = ceil((from-view_first)/step);
+                int x1 = floor((to-view_first)/step);
+
+                if ( x1 >= width )
+                    x1 = width-1;
+                if ( x1 >= x0 ) {
+                    interp_resample(capture_record.samples[ch], capture_record.length, view_first+x0*step, step,
+                                    values, x1-x0+1);
+                    cairo_move_to(cr, x0, sample_to_y(values[0], height));
+                    for (int x=x0+1;x<=x1;x++)
+                        cairo_line_to(cr, x, sample_to_y(values[x-x0], height));
+                }
+            } else if ( step <= 1 ) {
+                //Zoomed in: join the real samples
+                size_t first = view_first > 0 ? (size_t)view_first : 0;
+                size_t last  = (size_t)ceil(view_first+span)+1;
+                if ( last > capture_record.length )
+                    last = capture_record.length;
+
+                for (size_t i=first;i<last;i++) {
+                    double x = (i-view_first)/step;
+                    double y = sample_to_y(capture_record.samples[ch][i], height);
+                    if ( i == first )
+                        cairo_move_to(cr, x, y);
+                    else
+                        cairo_line_to(cr, x, y);
+                }
+            } else {
+                //Zoomed out: one min/max span per column from the pyramid
+                bool drawing = false;
+
+                record_query(&capture_record, ch, view_first, step, width, spans);
+                for (int x=0;x<width;x++) {
+                    if ( spans[x].min > spans[x].max ) {
+                        drawing = false;
+                        continue;
+                    }
+                    if ( !drawing )
+                        cairo_move_to(cr, x, sample_to_y(spans[x].min, height));
+                    else
+                        cairo_line_to(cr, x, sample_to_y(spans[x].min, height));
+                    cairo_line_to(cr, x, sample_to_y(spans[x].max, height));
+                    drawing = true;
+                }
+            }
 
             cairo_stroke(cr);
         }
     }
 
+    draw_math(cr, width, height, view_first, span);
+
+    if ( capture_decoder.protocol != DECODE_NONE )
+        draw_annotations(cr, width, view_first, span);
+
+    if ( cursor_a >= 0 && cursor_b >= 0 ) {
+        cairo_set_line_width(cr, 1);
+        cairo_set_source_rgb(cr, 0.4, 0.7, 1);
+        cairo_move_to(cr, (cursor_a-view_first)/step, 0);
+        cairo_line_to(cr, (cursor_a-view_first)/step, height);
+        cairo_move_to(cr, (cursor_b-view_first)/step, 0);
+        cairo_line_to(cr, (cursor_b-view_first)/step, height);
+        cairo_stroke(cr);
+    }
+    g_mutex_unlock(&record_lock);
+
     return FALSE;
 }
 
-void on_capture_samples(GtkSpinButton *spin_button, GtkScrollType scroll, gpointer user_data) {
-    cur_config->num_samples = gtk_spin_button_get_value_as_int(spin_button);
+static void view_set(double first, double span) {
+    double length = capture_record.length;
+
+    if ( span < 8 )
+        span = 8;
+    if ( span >= length ) {
+        view_first = 0;
+        view_span  = 0;
+        return;
+    }
+
+    if ( first > length-span )
+        first = length-span;
+    if ( first < 0 )
+        first = 0;
+
+    view_first = first;
+    view_span  = span;
+}
+
+gboolean on_drawing_area_scroll(GtkWidget *widget, GdkEventScroll *event, gpointer user_data) {
+    int width = gtk_widget_get_allocated_width(widget);
+    double span = view_span > 0 ? view_span : capture_record.length;
+    double anchor = view_first + event->x*span/width;
+
+    switch (event->direction) {
+        case GDK_SCROLL_UP:
+            span /= 1.25;
+            break;
+        case GDK_SCROLL_DOWN:
+            span *= 1.25;
+            break;
+        case GDK_SCROLL_SMOOTH:
+            span *= pow(1.25, event->delta_y);
+            break;
+        default:
+            return FALSE;
+    }
+
+    view_set(anchor - event->x*span/width, span);
+    gtk_widget_queue_draw(widget);
+
+    return TRUE;
+}
+
+//Statistics between the cursors, scaled with the settings the record was
+//taken with. record_stats costs a few blocks for the sums and the log of the
+//distance for min/max, so this runs on every motion event of a cursor drag.
+static void cursor_update(void) {
+    const config_t* config = &record_config;
+    double sample_rate;
+    char text[256];
+    size_t first, last;
+    int len;
+
+    if ( cursor_a < 0 || cursor_b < 0 ) {
+        gtk_label_set_text(cursor_status_label, "");
+        return;
+    }
+
+    first = (size_t)fmin(cursor_a, cursor_b);
+    last  = (size_t)fmax(cursor_a, cursor_b)+1;
+
+    g_mutex_lock(&record_lock);
+    sample_rate = scale_sample_rate(config->time_scale);
+    len = snprintf(text, sizeof(text), "dt %g s", (last-first-1)/sample_rate);
+    for (int ch=0;ch<2;ch++) {
+        double volts_per_div = scale_volts_per_div(config->channel_probe[ch], config->channel_scale[ch]);
+        double offset = config->channel_offset[ch];
+        double mean, variance, rms;
+        record_stats_t stats;
+
+        if ( !config->channel_enable[ch] )
+            continue;
+
+        record_stats(&capture_record, ch, first, last, &stats);
+        if ( stats.count == 0 )
+            continue;
+
+        //Raw codes are linear in volts, so only the mean moves with the offset
+        mean     = (double)stats.sum/stats.count;
+        variance = fmax(0, (double)stats.squares/stats.count - mean*mean);
+        mean     = (mean-SCALE_RAW_CENTER)*volts_per_div/SCALE_RAW_PER_DIV - offset;
+        rms      = sqrt(variance*pow(volts_per_div/SCALE_RAW_PER_DIV, 2) + mean*mean);
+
+        len += snprintf(text+len, sizeof(text)-len, "\nCH%d mean %.4g V, rms %.4g V, min %.4g V, max %.4g V, area %.4g Vs",
+                        ch+1, mean, rms,
+                        scale_raw_to_volts(stats.min, volts_per_div, offset), scale_raw_to_volts(stats.max, volts_per_div, offset),
+                        mean*stats.count/sample_rate);
+    }
+    g_mutex_unlock(&record_lock);
+
+    gtk_label_set_text(cursor_status_label, text);
+}
+
+//Shift and drag places the cursors, the middle button removes them
+gboolean on_drawing_area_button_press(GtkWidget *widget, GdkEventButton *event, gpointer user_data) {
+    int width = gtk_widget_get_allocated_width(widget);
+    double span = view_span > 0 ? view_span : capture_record.length;
+
+    if ( event->button == 1 && (event->state & GDK_SHIFT_MASK) ) {
+        cursor_dragging = true;
+        cursor_a = cursor_b = fmax(0, view_first + event->x*span/width);
+        cursor_update();
+        gtk_widget_queue_draw(widget);
+    } else if ( event->button == 1 ) {
+        view_dragging   = true;
+        view_drag_x     = event->x;
+        view_drag_first = view_first;
+    } else if ( event->button == 2 ) {
+        cursor_a = cursor_b = -1;
+        cursor_update();
+        gtk_widget_queue_draw(widget);
+    } else if ( event->button == 3 ) {
+        view_set(0, 0);
+        gtk_widget_queue_draw(widget);
+    }
+
+    return TRUE;
+}
+
+gboolean on_drawing_area_button_release(GtkWidget *widget, GdkEventButton *event, gpointer user_data) {
+    if ( event->button == 1 ) {
+        view_dragging   = false;
+        cursor_dragging = false;
+    }
+
+    return TRUE;
+}
+
+gboolean on_drawing_area_motion(GtkWidget *widget, GdkEventMotion *event, gpointer user_data) {
+    int width = gtk_widget_get_allocated_width(widget);
+
+    if ( cursor_dragging ) {
+        double span = view_span > 0 ? view_span : capture_record.length;
+        cursor_b = fmax(0, view_first + event->x*span/width);
+        cursor_update();
+        gtk_widget_queue_draw(widget);
+        return TRUE;
+    }
+
+    if ( !view_dragging || view_span == 0 )
+        return FALSE;
+
+    view_set(view_drag_first - (event->x-view_drag_x)*view_span/width, view_span);
+    gtk_widget_queue_draw(widget);
+
+    return TRUE;
+}
+
+void on_record_clear(GtkButton *button, gpointer user_data) {
+    g_print("%s\n", __func__);
+
+    if ( export_worker )
+        return;
+
+    g_mutex_lock(&record_lock);
+    record_clear(&capture_record);
+    decoder_reset(&capture_decoder);
+    g_mutex_unlock(&record_lock);
+    record_full_show();
+    view_set(0, 0);
+    cursor_a = cursor_b = -1;
+    cursor_update();
+    gtk_widget_queue_draw(drawing_area);
+}
+
+void on_capture_samples(GtkSpinButton *spin_button, GtkScrollType scroll, gpointer user_data) {
+    cur_config->num_samples = gtk_spin_button_get_value_as_int(spin_button);
+    config_publish(&config_store, cur_config);
+}
+
+static gboolean on_bode_progress(gpointer data) {
+    bode_num_done = GPOINTER_TO_INT(data);
+
+    gtk_progress_bar_set_fraction(bode_progressbar, (double)bode_num_done/bode_num_points);
+    gtk_widget_queue_draw(bode_drawing_area);
+
+    return G_SOURCE_REMOVE;
+}
+
+static gboolean on_bode_finished(gpointer data) {
+    char* text = g_strdup_printf("%d points in %.2f s", bode_num_done, GPOINTER_TO_INT(data)/1000.0);
+
+    g_thread_join(bode_worker);
+    bode_worker = NULL;
+
+    gtk_label_set_text(bode_status_label, text);
+    gtk_widget_set_sensitive(GTK_WIDGET(bode_run_button), TRUE);
+    gtk_widget_set_sensitive(GTK_WIDGET(capture_button), TRUE);
+    g_free(text);
+
+    return G_SOURCE_REMOVE;
+}
+
+static gint64 bode_setup(const bode_point_t* point, int num_samples, double min_settle) {
+    send_setting(FUNC_AWG_SETTING, AWG_FREQ, (uint32_t)point->frequency);
+    send_setting(FUNC_SCOPE_SETTING, SCOPE_SCALE_TIME, point->time_scale);
+
+    return g_get_monotonic_time() + (gint64)(bode_settle_time(point, num_samples, min_settle)*G_USEC_PER_SEC);
+}
+
+//The next point is programmed right after the current capture is read, so
+//its settling runs while the current point is being measured and published.
+static gpointer bode_thread(gpointer data) {
+    frame_t* frame = frame_acquire(&frame_pool);
+    config_t config;
+    int num_samples;
+    double min_settle = bode_min_settle;
+    double volts_per_div[2];
+    gint64 start = g_get_monotonic_time();
+    gint64 ready;
+    int i, res;
+
+    if ( frame == NULL ) {
+        fprintf(stderr, "[%d] No free frame.\n", frame_pool_in_use(&frame_pool));
+        g_idle_add(on_bode_finished, GINT_TO_POINTER(0));
+        return NULL;
+    }
+
+    config_read(&config_store, &config);
+    num_samples = config.num_samples;
+
+    for (int ch=0;ch<2;ch++)
+        volts_per_div[ch] = scale_volts_per_div(config.channel_probe[ch], config.channel_scale[ch]);
+
+    send_setting(FUNC_AWG_SETTING, AWG_START, 1);
+    ready = bode_setup(&bode_points[0], num_samples, min_settle);
+
+    for (i=0;i<bode_num_points && !g_atomic_int_get(&bode_stop);i++) {
+        gint64 wait = ready - g_get_monotonic_time();
+        if ( wait > 0 )
+            g_usleep(wait);
+
+        res = capture_frame_stoppable(frame->data, num_samples, 2, bode_points[i].time_scale, &bode_stop);
+        if ( g_atomic_int_get(&bode_stop) )
+            break;
+        if ( res ) {
+            fprintf(stderr, "[%d] Bode capture failed at %g Hz.\n", res, bode_points[i].frequency);
+            break;
+        }
+
+        if ( i+1 < bode_num_points )
+            ready = bode_setup(&bode_points[i+1], num_samples, min_settle);
+
+        bode_measure(&bode_points[i], frame->data, num_samples, volts_per_div);
+        g_idle_add(on_bode_progress, GINT_TO_POINTER(i+1));
+    }
+
+    //Back to what the widgets show
+    send_setting(FUNC_AWG_SETTING, AWG_FREQ, (uint32_t)config.awg_frequency);
+    send_setting(FUNC_SCOPE_SETTING, SCOPE_SCALE_TIME, config.time_scale);
+
+    frame_unref(frame);
+    g_idle_add(on_bode_finished, GINT_TO_POINTER((int)((g_get_monotonic_time()-start)/1000)));
+    return NULL;
+}
+
+void on_bode_run(GtkButton *button, gpointer user_data) {
+    g_print("%s\n", __func__);
+
+    if ( acquisition_busy() )
+        return;
+
+    if ( !cur_config->channel_enable[0] || !cur_config->channel_enable[1] ) {
+        gtk_label_set_text(bode_status_label, "Enable both channels");
+        return;
+    }
+
+    bode_num_points = bode_plan(gtk_spin_button_get_value(bode_start_spinbutton),
+                                gtk_spin_button_get_value(bode_stop_spinbutton),
+                                gtk_spin_button_get_value_as_int(bode_points_spinbutton),
+                                cur_config->num_samples, bode_points);
+    bode_min_settle = gtk_spin_button_get_value(bode_settle_spinbutton)/1000;
+    bode_num_done = 0;
+    g_atomic_int_set(&bode_stop, 0);
+
+    gtk_widget_set_sensitive(GTK_WIDGET(bode_run_button), FALSE);
+    gtk_widget_set_sensitive(GTK_WIDGET(capture_button), FALSE);
+    gtk_label_set_text(bode_status_label, "Sweeping...");
+    gtk_progress_bar_set_fraction(bode_progressbar, 0);
+    gtk_widget_queue_draw(bode_drawing_area);
+
+    bode_worker = g_thread_new("bode", bode_thread, NULL);
+}
+
+void on_bode_abort(GtkButton *button, gpointer user_data) {
+    g_print("%s\n", __func__);
+    g_atomic_int_set(&bode_stop, 1);
+}
+
+//Gain (yellow, left axis) and phase (green, right axis, +-180) over log frequency
+gboolean bode_draw_callback(GtkWidget *widget, cairo_t *cr, gpointer data) {
+    int width  = gtk_widget_get_allocated_width(widget);
+    int height = gtk_widget_get_allocated_height(widget);
+    double dashes[] = { 5.0, 5.0 };
+    double gain_min = 0, gain_max = 0;
+    double log_first, log_span;
+
+    cairo_set_source_rgb(cr, 0, 0, 0);
+    cairo_paint(cr);
+
+    if ( bode_num_done < 1 )
+        return FALSE;
+
+    for (int i=0;i<bode_num_done;i++) {
+        if ( !isfinite(bode_points[i].gain_db) ) continue;
+        if ( bode_points[i].gain_db < gain_min ) gain_min = bode_points[i].gain_db;
+        if ( bode_points[i].gain_db > gain_max ) gain_max = bode_points[i].gain_db;
+    }
+    gain_min = floor(gain_min/10)*10;
+    gain_max = ceil(gain_max/10)*10;
+    if ( gain_max-gain_min < 10 )
+        gain_max = gain_min+10;
+
+    log_first = log10(bode_points[0].frequency);
+    log_span  = log10(bode_points[bode_num_points-1].frequency)-log_first;
+    if ( log_span <= 0 )
+        log_span = 1;
+
+    cairo_set_dash(cr, dashes, 2, 0);
+    cairo_set_line_width(cr, 0.3);
+    cairo_set_source_rgb(cr, 0.9, 0.9, 0.9);
+    for (double decade=ceil(log_first);decade<=log_first+log_span;decade++) {
+        double x = (decade-log_first)*width/log_span;
+        cairo_move_to(cr, x, 0);
+        cairo_line_to(cr, x, height);
+    }
+    for (int i=1;i<4;i++) {
+        cairo_move_to(cr, 0, i*height/4);
+        cairo_line_to(cr, width, i*height/4);
+    }
+    cairo_stroke(cr);
+    cairo_set_dash(cr, NULL, 0, 0);
+
+    //A point without signal on a channel has no gain or phase; the traces
+    //break there
+    cairo_set_line_width(cr, 1);
+    cairo_set_source_rgb(cr, 1, 1, 0);
+    for (int i=0;i<bode_num_done;i++) {
+        double x = (log10(bode_points[i].frequency)-log_first)*width/log_span;
+        double y = height - (bode_points[i].gain_db-gain_min)*height/(gain_max-gain_min);
+        if ( !isfinite(bode_points[i].gain_db) )
+            continue;
+        if ( i == 0 || !isfinite(bode_points[i-1].gain_db) )
+            cairo_move_to(cr, x, y);
+        else
+            cairo_line_to(cr, x, y);
+    }
+    cairo_stroke(cr);
+
+    cairo_set_source_rgb(cr, 0, 1, 0);
+    for (int i=0;i<bode_num_done;i++) {
+        double x = (log10(bode_points[i].frequency)-log_first)*width/log_span;
+        double y = height/2 - bode_points[i].phase_deg*height/360;
+        if ( !isfinite(bode_points[i].gain_db) )
+            continue;
+        if ( i == 0 || !isfinite(bode_points[i-1].gain_db) )
+            cairo_move_to(cr, x, y);
+        else
+            cairo_line_to(cr, x, y);
+    }
+    cairo_stroke(cr);
+
+    char* text = g_strdup_printf("%+.0f dB", gain_max);
+    cairo_set_source_rgb(cr, 1, 1, 0);
+    cairo_move_to(cr, 2, 12);
+    cairo_show_text(cr, text);
+    g_free(text);
+    text = g_strdup_printf("%+.0f dB", gain_min);
+    cairo_move_to(cr, 2, height-2);
+    cairo_show_text(cr, text);
+    g_free(text);
+
+    return FALSE;
+}
+
+static int volts_to_raw(int ch, double volts) {
+    double volts_per_div = scale_volts_per_div(cur_config->channel_probe[ch], cur_config->channel_scale[ch]);
+    return lround(SCALE_RAW_CENTER + (volts+cur_config->channel_offset[ch])*SCALE_RAW_PER_DIV/volts_per_div);
+}
+
+//Any decoder setting change restarts decoding over the whole record
+void on_decode_changed(GtkWidget *widget, gpointer user_data) {
+    g_print("%s\n", __func__);
+    decoder_t* decoder = &capture_decoder;
+
+    g_mutex_lock(&record_lock);
+    decoder->protocol        = gtk_combo_box_get_active(decode_protocol_combobox);
+    decoder->uart_channel    = gtk_combo_box_get_active(decode_uart_channel_combobox) == 1;
+    decoder->samples_per_bit = scale_sample_rate(cur_config->time_scale)/gtk_spin_button_get_value(decode_baud_spinbutton);
+    decoder->spi_bits        = gtk_spin_button_get_value_as_int(decode_spi_bits_spinbutton);
+    decoder->spi_falling     = gtk_combo_box_get_active(decode_spi_edge_combobox) == 1;
+    decoder->spi_timeout     = 4*SCALE_SAMPLES_PER_DIV;
+
+    decoder_set_threshold(decoder, 0, volts_to_raw(0, gtk_spin_button_get_value(decode_threshold_spinbutton_ch1)), 6);
+    decoder_set_threshold(decoder, 1, volts_to_raw(1, gtk_spin_button_get_value(decode_threshold_spinbutton_ch2)), 6);
+
+    decoder_reset(decoder);
+    if ( capture_record.length > 0 )
+        decoder_run(decoder, capture_record.samples[0], capture_record.samples[1], capture_record.length);
+    g_mutex_unlock(&record_lock);
+
+    gtk_widget_queue_draw(drawing_area);
+}
+
+static const char* export_extensions[] = { ".csv", ".wav", ".sr" };
+
+void on_export_format(GtkComboBox *widget, gpointer user_data) {
+    g_print("%s\n", __func__);
+    const char* path  = gtk_entry_get_text(export_path_entry);
+    const char* dot   = strrchr(path, '.');
+    const char* slash = strrchr(path, '/');
+    int length = ( dot && (!slash || dot > slash) ) ? dot-path : (int)strlen(path);
+    char* text = g_strdup_printf("%.*s%s", length, path, export_extensions[gtk_combo_box_get_active(widget)]);
+
+    gtk_entry_set_text(export_path_entry, text);
+    g_free(text);
+}
+
+static gboolean on_export_progress(gpointer data) {
+    gtk_progress_bar_set_fraction(export_progressbar, GPOINTER_TO_INT(data)/1000.0);
+    return G_SOURCE_REMOVE;
+}
+
+static gboolean on_export_finished(gpointer data) {
+    char* text;
+
+    g_thread_join(export_worker);
+    export_worker = NULL;
+
+    if ( GPOINTER_TO_INT(data) )
+        text = g_strdup("Export failed");
+    else
+        text = g_strdup_printf("%" G_GUINT64_FORMAT " samples written", (guint64)export_job.num_samples);
+
+    gtk_label_set_text(export_status_label, text);
+    gtk_widget_set_sensitive(GTK_WIDGET(export_run_button), TRUE);
+    gtk_widget_set_sensitive(GTK_WIDGET(capture_button), TRUE);
+    gtk_widget_set_sensitive(GTK_WIDGET(channel_enable_switch_ch1), TRUE);
+    gtk_widget_set_sensitive(GTK_WIDGET(channel_enable_switch_ch2), TRUE);
+    g_free(text);
+
+    return G_SOURCE_REMOVE;
+}
+
+//The record is written in slices straight from its buffers, live frames are
+//captured and written one at a time: memory use does not grow with the job.
+static gpointer export_thread(gpointer data) {
+    int num_frames = GPOINTER_TO_INT(data);
+    int status = 0;
+
+    if ( num_frames == 0 ) {
+        size_t length = capture_record.length;
+
+        for (size_t first=0;first<length && !status && !g_atomic_int_get(&export_stop);first+=EXPORT_SLICE) {
+            size_t count = length-first < EXPORT_SLICE ? length-first : EXPORT_SLICE;
+
+            status = export_write(&export_job, capture_record.samples[0]+first, capture_record.samples[1]+first, 1, count);
+            g_idle_add(on_export_progress, GINT_TO_POINTER((int)(1000*(first+count)/length)));
+        }
+    } else {
+        for (int i=0;i<num_frames && !status && !g_atomic_int_get(&export_stop);i++) {
+            frame_t* frame = capture_pooled(&export_stop);
+            if ( frame == NULL ) {
+                if ( !g_atomic_int_get(&export_stop) )
+                    status = -1;
+                break;
+            }
+
+            status = export_write(&export_job, frame->data, frame->data+frame->config.channel_enable[0],
+                                  frame->num_channels, frame->num_samples);
+            frame_unref(frame);
+            g_idle_add(on_export_progress, GINT_TO_POINTER(1000*(i+1)/num_frames));
+        }
+    }
+
+    if ( export_close(&export_job) )
+        status = -1;
+
+    g_idle_add(on_export_finished, GINT_TO_POINTER(status));
+    return NULL;
+}
+
+void on_export_run(GtkButton *button, gpointer user_data) {
+    g_print("%s\n", __func__);
+    bool live = gtk_combo_box_get_active(export_source_combobox) == 1;
+    double volts_per_div[2], offset[2];
+    config_t config;
+
+    if ( acquisition_busy() )
+        return;
+
+    if ( !live && capture_record.length == 0 ) {
+        gtk_label_set_text(export_status_label, "Record is empty");
+        return;
+    }
+
+    //The header is written from a snapshot, the worker never reads cur_config.
+    //A record is written with the settings it was taken with.
+    if ( live ) {
+        config_read(&config_store, &config);
+    } else {
+        g_mutex_lock(&record_lock);
+        config = record_config;
+        g_mutex_unlock(&record_lock);
+    }
+    for (int ch=0;ch<2;ch++) {
+        volts_per_div[ch] = scale_volts_per_div(config.channel_probe[ch], config.channel_scale[ch]);
+        offset[ch]        = config.channel_offset[ch];
+    }
+
+    if ( export_open(&export_job, gtk_entry_get_text(export_path_entry), gtk_combo_box_get_active(export_format_combobox),
+                     scale_sample_rate(config.time_scale), config.channel_enable, volts_per_div, offset) ) {
+        gtk_label_set_text(export_status_label, "Cannot open file");
+        return;
+    }
+
+    g_atomic_int_set(&export_stop, 0);
+
+    //The record must not move and the USB must stay ours while exporting
+    gtk_widget_set_sensitive(GTK_WIDGET(export_run_button), FALSE);
+    gtk_widget_set_sensitive(GTK_WIDGET(capture_button), FALSE);
+    gtk_widget_set_sensitive(GTK_WIDGET(channel_enable_switch_ch1), FALSE);
+    gtk_widget_set_sensitive(GTK_WIDGET(channel_enable_switch_ch2), FALSE);
+    gtk_label_set_text(export_status_label, "Exporting...");
+    gtk_progress_bar_set_fraction(export_progressbar, 0);
+
+    export_worker = g_thread_new("export", export_thread, GINT_TO_POINTER(live ? gtk_spin_button_get_value_as_int(export_frames_spinbutton) : 0));
+}
+
+void on_export_abort(GtkButton *button, gpointer user_data) {
+    g_print("%s\n", __func__);
+    g_atomic_int_set(&export_stop, 1);
+}
+
+static gboolean on_segment_progress(gpointer data) {
+    gtk_progress_bar_set_fraction(segment_progressbar, (double)GPOINTER_TO_INT(data)/segment_table.capacity);
+    return G_SOURCE_REMOVE;
+}
+
+static gboolean on_segment_finished(gpointer data) {
+    segment_stats_t stats;
+    char* text;
+
+    g_thread_join(segment_worker);
+    segment_worker = NULL;
+
+    segment_stats(&segment_table, &stats);
+    text = g_strdup_printf("%d segments, %.1f trig/s\n"
+                           "dead %.0f us (readout %.0f + re-arm %.0f), max %.0f us\n"
+                           "not armed %.1f%% of the run",
+                           stats.count, stats.rate,
+                           stats.dead_mean_us, stats.readout_mean_us, stats.rearm_mean_us, stats.dead_max_us,
+                           100*stats.dead_fraction);
+    if ( GPOINTER_TO_INT(data) )
+        gtk_label_set_text(segment_status_label, "Capture failed");
+    else
+        gtk_label_set_text(segment_status_label, text);
+    g_free(text);
+
+    gtk_progress_bar_set_fraction(segment_progressbar, (double)stats.count/segment_table.capacity);
+    gtk_adjustment_set_upper(segment_view_adj, stats.count > 0 ? stats.count : 1);
+    gtk_widget_set_sensitive(GTK_WIDGET(segment_run_button), TRUE);
+    gtk_widget_set_sensitive(GTK_WIDGET(capture_button), TRUE);
+
+    return G_SOURCE_REMOVE;
+}
+
+//The scope is re-armed as soon as the last packet of a segment is in, before
+//any bookkeeping; the UI only hears about progress every SEGMENT_REPORT_US.
+static gpointer segment_thread(gpointer data) {
+    segment_table_t* table = &segment_table;
+    int mode = GPOINTER_TO_INT(data);
+    gint64 last_report = 0;
+    int status = 0;
+    config_t config;
+
+    send_setting(FUNC_SCOPE_SETTING, SCOPE_TRIGGER_MODE, mode);
+    send_setting(FUNC_SCOPE_SETTING, SCOPE_START, 1);
+
+    while ( table->count < table->capacity && !g_atomic_int_get(&segment_stop) ) {
+        segment_info_t* info = &table->info[table->count];
+        gint64 first = 0, done, armed;
+
+        status = capture_frame_timed(segment_data(table, table->count), table->num_samples, table->num_channels, SEGMENT_WAIT, &first);
+        if ( status == LIBUSB_ERROR_TIMEOUT ) {
+            status = 0;
+            continue;
+        }
+        if ( status ) {
+            fprintf(stderr, "[%d] Segment capture failed.\n", status);
+            break;
+        }
+        done = g_get_monotonic_time();
+
+        if ( mode == SCOPE_VAL_TRIGGER_MODE_SINGLE )
+            send_setting(FUNC_SCOPE_SETTING, SCOPE_START, 1);
+        armed = g_get_monotonic_time();
+
+        info->time_us    = first;
+        info->readout_us = done-first;
+        info->rearm_us   = armed-done;
+        table->count++;
+
+        if ( done-last_report >= SEGMENT_REPORT_US ) {
+            g_idle_add(on_segment_progress, GINT_TO_POINTER(table->count));
+            last_report = done;
+        }
+    }
+
+    config_read(&config_store, &config);
+    send_setting(FUNC_SCOPE_SETTING, SCOPE_TRIGGER_MODE, config.trigger_mode);
+
+    g_idle_add(on_segment_finished, GINT_TO_POINTER(status));
+    return NULL;
+}
+
+void on_segment_run(GtkButton *button, gpointer user_data) {
+    g_print("%s\n", __func__);
+    int mode = gtk_combo_box_get_active(segment_mode_combobox) == 1 ? SCOPE_VAL_TRIGGER_MODE_NORMAL : SCOPE_VAL_TRIGGER_MODE_SINGLE;
+    int num_channels;
+    config_t config;
+
+    if ( acquisition_busy() )
+        return;
+
+    config_read(&config_store, &config);
+    num_channels = config.channel_enable[0]+config.channel_enable[1];
+    if ( num_channels == 0 )
+        return;
+
+    if ( segment_table_alloc(&segment_table, gtk_spin_button_get_value_as_int(segment_count_spinbutton),
+                             gtk_spin_button_get_value_as_int(segment_samples_spinbutton), num_channels) ) {
+        gtk_label_set_text(segment_status_label, "Not enough memory");
+        return;
+    }
+    segment_table.config = config;
+    segment_table.config.num_samples = segment_table.num_samples;
+
+    g_atomic_int_set(&segment_stop, 0);
+
+    gtk_widget_set_sensitive(GTK_WIDGET(segment_run_button), FALSE);
+    gtk_widget_set_sensitive(GTK_WIDGET(capture_button), FALSE);
+    gtk_label_set_text(segment_status_label, "Waiting for triggers...");
+    gtk_progress_bar_set_fraction(segment_progressbar, 0);
+
+    segment_worker = g_thread_new("segment", segment_thread, GINT_TO_POINTER(mode));
+}
+
+void on_segment_abort(GtkButton *button, gpointer user_data) {
+    g_print("%s\n", __func__);
+    g_atomic_int_set(&segment_stop, 1);
+}
+
+//Loads one segment into the capture record, replacing its content, with
+//the settings the table was filled with
+void on_segment_view(GtkSpinButton *spin_button, GtkScrollType scroll, gpointer user_data) {
+    g_print("%s\n", __func__);
+    int index = gtk_spin_button_get_value_as_int(spin_button)-1;
+
+    if ( acquisition_busy() || index < 0 || index >= segment_table.count )
+        return;
+
+    g_mutex_lock(&record_lock);
+    record_clear(&capture_record);
+    decoder_reset(&capture_decoder);
+    record_append(&capture_record, segment_data(&segment_table, index), segment_table.num_samples, segment_table.num_channels,
+                  segment_table.config.channel_enable);
+    record_config = segment_table.config;
+    decoder_run(&capture_decoder, capture_record.samples[0], capture_record.samples[1], capture_record.length);
+    g_mutex_unlock(&record_lock);
+    record_full_show();
+    view_set(0, 0);
+
+    gtk_widget_queue_draw(drawing_area);
+}
+
+static void caplog_show_stats(void) {
+    caplog_stats_t stats;
+    char* text;
+
+    caplog_stats(&capture_log, &stats);
+    text = g_strdup_printf("%" G_GUINT64_FORMAT " frames, ratio %.2f:1\n"
+                           "%.1f MB/s per thread, %.2f MB/s logged\n"
+                           "%" G_GUINT64_FORMAT " dropped",
+                           (guint64)stats.frames, stats.ratio, stats.thread_mbps, stats.wall_mbps, (guint64)stats.dropped);
+    gtk_label_set_text(caplog_status_label, text);
+    g_free(text);
+}
+
+static gboolean on_caplog_timer(gpointer data) {
+    caplog_show_stats();
+    return G_SOURCE_CONTINUE;
+}
+
+//Acquires back to back; compression and disk writes happen off this thread
+static gpointer caplog_thread(gpointer data) {
+    while ( !g_atomic_int_get(&caplog_stop) ) {
+        frame_t* frame = capture_pooled(&caplog_stop);
+        if ( frame == NULL )
+            break;
+        caplog_push(&capture_log, frame);
+        frame_unref(frame);
+    }
+
+    return NULL;
+}
+
+void on_caplog_start(GtkButton *button, gpointer user_data) {
+    g_print("%s\n", __func__);
+
+    //Run is the one worker a log can join, through its persist stage
+    if ( run_logging || (acquisition_busy() && run_worker == NULL) )
+        return;
+
+    if ( cur_config->channel_enable[0]+cur_config->channel_enable[1] == 0 )
+        return;
+
+    if ( caplog_open(&capture_log, gtk_entry_get_text(caplog_path_entry), gtk_spin_button_get_value_as_int(caplog_threads_spinbutton)) ) {
+        gtk_label_set_text(caplog_status_label, "Cannot open file");
+        return;
+    }
+
+    gtk_widget_set_sensitive(GTK_WIDGET(caplog_start_button), FALSE);
+
+    //While running, the persist stage feeds the log
+    if ( run_worker ) {
+        g_mutex_lock(&run_log_lock);
+        run_logging = true;
+        g_mutex_unlock(&run_log_lock);
+    } else {
+        g_atomic_int_set(&caplog_stop, 0);
+        gtk_widget_set_sensitive(GTK_WIDGET(capture_button), FALSE);
+        caplog_worker = g_thread_new("caplog", caplog_thread, NULL);
+    }
+    caplog_timer = g_timeout_add(CAPLOG_REFRESH, on_caplog_timer, NULL);
+}
+
+void on_caplog_stop(GtkButton *button, gpointer user_data) {
+    g_print("%s\n", __func__);
+
+    if ( caplog_worker == NULL && !run_logging )
+        return;
+
+    if ( caplog_worker ) {
+        g_atomic_int_set(&caplog_stop, 1);
+        g_thread_join(caplog_worker);
+        caplog_worker = NULL;
+    } else {
+        g_mutex_lock(&run_log_lock);
+        run_logging = false;
+        g_mutex_unlock(&run_log_lock);
+    }
+
+    g_source_remove(caplog_timer);
+    caplog_timer = 0;
+
+    caplog_show_stats();
+    if ( caplog_close(&capture_log) )
+        gtk_label_set_text(caplog_status_label, "Write failed");
+
+    gtk_widget_set_sensitive(GTK_WIDGET(caplog_start_button), TRUE);
+    gtk_widget_set_sensitive(GTK_WIDGET(capture_button), run_worker == NULL);
+}
+
+//Loads one logged frame into the capture record
+void on_caplog_frame(GtkSpinButton *spin_button, GtkScrollType scroll, gpointer user_data) {
+    g_print("%s\n", __func__);
+    static uint8_t frame[CAPLOG_MAX_FRAME];
+    caplog_frame_t header;
+    config_t config;
+
+    if ( acquisition_busy() )
+        return;
+
+    if ( caplog_reader_read(&capture_playback, gtk_spin_button_get_value_as_int(spin_button)-1, &header, frame) ) {
+        gtk_label_set_text(caplog_status_label, "Cannot read frame");
+        return;
+    }
+
+    //Settings the log does not keep come from the current ones
+    config_read(&config_store, &config);
+    config.time_scale  = header.time_scale;
+    config.num_samples = header.num_samples;
+    for (int ch=0;ch<2;ch++) {
+        config.channel_enable[ch] = header.enable >> ch & 1;
+        config.channel_probe[ch]  = header.probe[ch];
+        config.channel_scale[ch]  = header.scale[ch];
+        config.channel_offset[ch] = header.offset[ch];
+    }
+
+    g_mutex_lock(&record_lock);
+    record_clear(&capture_record);
+    decoder_reset(&capture_decoder);
+    record_append(&capture_record, frame, header.num_samples, header.num_channels, config.channel_enable);
+    record_config = config;
+    decoder_run(&capture_decoder, capture_record.samples[0], capture_record.samples[1], capture_record.length);
+    g_mutex_unlock(&record_lock);
+    record_full_show();
+    view_set(0, 0);
+
+    gtk_widget_queue_draw(drawing_area);
+}
+
+void on_caplog_play(GtkButton *button, gpointer user_data) {
+    g_print("%s\n", __func__);
+    char* text;
+
+    caplog_reader_close(&capture_playback);
+    if ( caplog_reader_open(&capture_playback, gtk_entry_get_text(caplog_path_entry)) ) {
+        gtk_label_set_text(caplog_status_label, "Cannot open log");
+        return;
+    }
+
+    text = g_strdup_printf("%zu frames in log", capture_playback.num_frames);
+    gtk_label_set_text(caplog_status_label, text);
+    g_free(text);
+
+    gtk_adjustment_set_upper(caplog_frame_adj, capture_playback.num_frames > 0 ? capture_playback.num_frames : 1);
+    if ( capture_playback.num_frames > 0 )
+        on_caplog_frame(caplog_frame_spinbutton, 0, NULL);
+}
+
+void on_mask_from_capture(GtkButton *button, gpointer user_data) {
+    g_print("%s\n", __func__);
+    int margin = lround(gtk_spin_button_get_value(mask_margin_spinbutton)*SCALE_RAW_PER_DIV);
+
+    if ( mask_worker )
+        return;
+
+    if ( last_frame == NULL || last_frame->num_channels == 0 ||
+         mask_from_golden(&test_mask, last_frame->data, last_frame->num_samples, last_frame->num_channels,
+                          last_frame->config.channel_enable, margin, gtk_spin_button_get_value_as_int(mask_smear_spinbutton)) ) {
+        gtk_label_set_text(mask_status_label, "Capture a golden frame first");
+        return;
+    }
+
+    gtk_label_set_text(mask_status_label, "Mask from capture");
+    gtk_widget_queue_draw(drawing_area);
+}
+
+void on_mask_load(GtkFileChooserButton *widget, gpointer user_data) {
+    g_print("%s\n", __func__);
+    char* path = gtk_file_chooser_get_filename(mask_file_chooser);
+
+    if ( path == NULL || mask_worker )
+        return;
+
+    if ( mask_load(&test_mask, path, cur_config->num_samples) )
+        gtk_label_set_text(mask_status_label, "No limits in mask file");
+    else
+        gtk_label_set_text(mask_status_label, "Mask from file");
+    g_free(path);
+
+    gtk_widget_queue_draw(drawing_area);
+}
+
+static gboolean on_mask_timer(gpointer data) {
+    int frames   = g_atomic_int_get(&mask_frames);
+    int failures = g_atomic_int_get(&mask_failures);
+    int skipped  = g_atomic_int_get(&mask_skipped);
+    double elapsed = (g_get_monotonic_time()-mask_start)/(double)G_USEC_PER_SEC;
+    char* text = g_strdup_printf("%d frames, %d failed (%.4f%%)\n"
+                                 "%.1f frames/s, %.3f failures/s\n"
+                                 "%d skipped, settings differ from the mask",
+                                 frames, failures, frames ? 100.0*failures/frames : 0.0,
+                                 elapsed > 0 ? frames/elapsed : 0.0, elapsed > 0 ? failures/elapsed : 0.0, skipped);
+
+    gtk_label_set_text(mask_status_label, text);
+    g_free(text);
+
+    return G_SOURCE_CONTINUE;
+}
+
+//Every frame is checked, only failing ones go to the log. Frames taken after
+//a length or channel change do not fit the mask and are only counted.
+static gpointer mask_thread(gpointer data) {
+    while ( !g_atomic_int_get(&mask_stop) ) {
+        frame_t* frame = capture_pooled(&mask_stop);
+        long failed;
+
+        if ( frame == NULL )
+            break;
+
+        failed = mask_test(&test_mask, frame);
+        if ( failed < 0 ) {
+            g_atomic_int_inc(&mask_skipped);
+        } else {
+            if ( failed ) {
+                caplog_push(&mask_log, frame);
+                g_atomic_int_inc(&mask_failures);
+            }
+            g_atomic_int_inc(&mask_frames);
+        }
+        frame_unref(frame);
+    }
+
+    return NULL;
+}
+
+void on_mask_run(GtkButton *button, gpointer user_data) {
+    g_print("%s\n", __func__);
+    int num_channels = cur_config->channel_enable[0]+cur_config->channel_enable[1];
+
+    if ( acquisition_busy() || num_channels == 0 )
+        return;
+
+    if ( !test_mask.valid ) {
+        gtk_label_set_text(mask_status_label, "No mask");
+        return;
+    }
+
+    if ( test_mask.num_samples != cur_config->num_samples ) {
+        gtk_label_set_text(mask_status_label, "Mask length differs from the capture length");
+        return;
+    }
+
+    if ( caplog_open(&mask_log, gtk_entry_get_text(mask_fail_entry), 1) ) {
+        gtk_label_set_text(mask_status_label, "Cannot open file");
+        return;
+    }
+
+    mask_layout(&test_mask, num_channels, cur_config->channel_enable);
+    g_atomic_int_set(&mask_frames, 0);
+    g_atomic_int_set(&mask_failures, 0);
+    g_atomic_int_set(&mask_skipped, 0);
+    g_atomic_int_set(&mask_stop, 0);
+    mask_start = g_get_monotonic_time();
+
+    gtk_widget_set_sensitive(GTK_WIDGET(mask_run_button), FALSE);
+    gtk_widget_set_sensitive(GTK_WIDGET(capture_button), FALSE);
+
+    mask_worker = g_thread_new("mask", mask_thread, NULL);
+    mask_timer  = g_timeout_add(MASK_REFRESH, on_mask_timer, NULL);
+}
+
+void on_mask_stop(GtkButton *button, gpointer user_data) {
+    g_print("%s\n", __func__);
+
+    if ( mask_worker == NULL )
+        return;
+
+    g_atomic_int_set(&mask_stop, 1);
+    g_thread_join(mask_worker);
+    mask_worker = NULL;
+
+    g_source_remove(mask_timer);
+    mask_timer = 0;
+
+    on_mask_timer(NULL);
+    caplog_close(&mask_log);
+
+    gtk_widget_set_sensitive(GTK_WIDGET(mask_run_button), TRUE);
+    gtk_widget_set_sensitive(GTK_WIDGET(capture_button), TRUE);
+}
+
+static gboolean on_eye_timer(gpointer data) {
+    double elapsed = (g_get_monotonic_time()-eye_start_time)/(double)G_USEC_PER_SEC;
+    char* text;
+
+    eye_snapshot(&eye_acc, &eye_view);
+
+    text = g_strdup_printf("%.0f UI folded, %.0f UI/s\n%" G_GUINT64_FORMAT " frames dropped",
+                           eye_view.uis, elapsed > 0 ? eye_view.uis/elapsed : 0.0, (guint64)eye_acc.dropped);
+    gtk_label_set_text(eye_status_label, text);
+    g_free(text);
+
+    gtk_widget_queue_draw(eye_drawing_area);
+    return G_SOURCE_CONTINUE;
+}
+
+//Acquisition only queues frames, folding happens on the eye workers
+static gpointer eye_thread(gpointer data) {
+    int ch = GPOINTER_TO_INT(data);
+    config_t config;
+    int slot;
+
+    config_read(&config_store, &config);
+    slot = (ch == 1 && config.channel_enable[0]) ? 1 : 0;
+
+    while ( !g_atomic_int_get(&eye_capture_stop) ) {
+        frame_t* frame = capture_pooled(&eye_capture_stop);
+        if ( frame == NULL )
+            break;
+        eye_push(&eye_acc, frame, slot);
+        frame_unref(frame);
+    }
+
+    return NULL;
+}
+
+void on_eye_run(GtkButton *button, gpointer user_data) {
+    g_print("%s\n", __func__);
+    int ch = gtk_combo_box_get_active(eye_channel_combobox) == 1;
+    eye_params_t params;
+
+    if ( acquisition_busy() )
+        return;
+
+    if ( !cur_config->channel_enable[ch] ) {
+        gtk_label_set_text(eye_status_label, "Channel is disabled");
+        return;
+    }
+
+    params.ui        = scale_sample_rate(cur_config->time_scale)/gtk_spin_button_get_value(eye_bitrate_spinbutton);
+    params.threshold = volts_to_raw(ch, gtk_spin_button_get_value(eye_threshold_spinbutton));
+    params.gain      = gtk_spin_button_get_value(eye_gain_spinbutton);
+
+    if ( params.ui < 2 ) {
+        gtk_label_set_text(eye_status_label, "Less than 2 samples per UI");
+        return;
+    }
+
+    if ( eye_start(&eye_acc, &params, g_get_num_processors()) ) {
+        gtk_label_set_text(eye_status_label, "Cannot start the workers");
+        return;
+    }
+
+    g_atomic_int_set(&eye_capture_stop, 0);
+    eye_start_time = g_get_monotonic_time();
+
+    gtk_widget_set_sensitive(GTK_WIDGET(eye_run_button), FALSE);
+    gtk_widget_set_sensitive(GTK_WIDGET(capture_button), FALSE);
+
+    eye_capture_worker = g_thread_new("eye", eye_thread, GINT_TO_POINTER(ch));
+    eye_timer          = g_timeout_add(EYE_REFRESH, on_eye_timer, NULL);
+}
+
+void on_eye_stop(GtkButton *button, gpointer user_data) {
+    g_print("%s\n", __func__);
+
+    if ( eye_capture_worker == NULL )
+        return;
+
+    g_atomic_int_set(&eye_capture_stop, 1);
+    g_thread_join(eye_capture_worker);
+    eye_capture_worker = NULL;
+
+    g_source_remove(eye_timer);
+    eye_timer = 0;
+
+    eye_stop(&eye_acc);
+    on_eye_timer(NULL);
+
+    gtk_widget_set_sensitive(GTK_WIDGET(eye_run_button), TRUE);
+    gtk_widget_set_sensitive(GTK_WIDGET(capture_button), TRUE);
+}
+
+//Log scaled density, dark blue to yellow, over the visible raw range
+gboolean eye_draw_callback(GtkWidget *widget, cairo_t *cr, gpointer data) {
+    int width  = gtk_widget_get_allocated_width(widget);
+    int height = gtk_widget_get_allocated_height(widget);
+    cairo_surface_t* surface;
+    unsigned char* pixels;
+    uint32_t max = 0;
+    double scale;
+    int stride;
+
+    cairo_set_source_rgb(cr, 0, 0, 0);
+    cairo_paint(cr);
+
+    for (int r=0;r<EYE_ROWS;r++)
+        for (int c=0;c<EYE_COLUMNS;c++)
+            if ( eye_view.bins[r][c] > max )
+                max = eye_view.bins[r][c];
+    if ( max == 0 )
+        return FALSE;
+    scale = 1/log1p(max);
+
+    surface = cairo_image_surface_create(CAIRO_FORMAT_RGB24, EYE_COLUMNS, EYE_ROWS);
+    pixels  = cairo_image_surface_get_data(surface);
+    stride  = cairo_image_surface_get_stride(surface);
+    cairo_surface_flush(surface);
+
+    for (int r=0;r<EYE_ROWS;r++) {
+        uint32_t* row = (uint32_t*)(pixels + r*stride);
+        for (int c=0;c<EYE_COLUMNS;c++) {
+            uint32_t count = eye_view.bins[r][c];
+            double level = count ? log1p(count)*scale : 0;
+            int red   = 255*level;
+            int green = 255*level*level;
+            int blue  = count ? 255*(1-level) : 0;
+            row[c] = red << 16 | green << 8 | blue;
+        }
+    }
+    cairo_surface_mark_dirty(surface);
+
+    //Rows are raw codes from 255 down, the screen spans 29..231
+    cairo_scale(cr, (double)width/EYE_COLUMNS, height/202.0);
+    cairo_set_source_surface(cr, surface, 0, -(EYE_ROWS-1-231));
+    cairo_pattern_set_filter(cairo_get_source(cr), CAIRO_FILTER_NEAREST);
+    cairo_paint(cr);
+    cairo_surface_destroy(surface);
+
+    return FALSE;
+}
+
+void on_math_changed(GtkWidget *widget, gpointer user_data) {
+    g_print("%s\n", __func__);
+    int k = gtk_combo_box_get_active(math_slot_combobox);
+    int status;
+
+    if ( math_loading || k < 0 )
+        return;
+
+    g_mutex_lock(&record_lock);
+    status = derived_configure(&math, k, gtk_combo_box_get_active(math_op_combobox),
+                               gtk_combo_box_get_active(math_src_a_combobox), gtk_combo_box_get_active(math_src_b_combobox),
+                               gtk_combo_box_get_active(math_filter_combobox),
+                               gtk_spin_button_get_value(math_f1_spinbutton), gtk_spin_button_get_value(math_f2_spinbutton),
+                               gtk_spin_button_get_value_as_int(math_size_spinbutton));
+    if ( status == 0 ) {
+        math_show[k]  = gtk_toggle_button_get_active(math_show_checkbutton);
+        math_scale[k] = gtk_spin_button_get_value(math_scale_spinbutton);
+    }
+    g_mutex_unlock(&record_lock);
+
+    if ( status ) {
+        gtk_label_set_text(math_status_label, "Only CH1, CH2 and earlier math channels");
+        return;
+    }
+    gtk_label_set_text(math_status_label, "");
+
+    gtk_widget_queue_draw(drawing_area);
+}
+
+//Shows the settings of the selected math channel
+void on_math_slot(GtkComboBox *widget, gpointer user_data) {
+    g_print("%s\n", __func__);
+    int k = gtk_combo_box_get_active(widget);
+    const derived_channel_t* channel = &math.channels[2+k];
+
+    if ( k < 0 )
+        return;
+
+    math_loading = true;
+    gtk_combo_box_set_active(math_op_combobox, channel->op);
+    gtk_combo_box_set_active(math_src_a_combobox, channel->src[0]);
+    gtk_combo_box_set_active(math_src_b_combobox, channel->src[1]);
+    gtk_combo_box_set_active(math_filter_combobox, channel->filter);
+    if ( channel->op != DERIVED_OFF ) {
+        gtk_spin_button_set_value(math_f1_spinbutton, channel->f1);
+        gtk_spin_button_set_value(math_f2_spinbutton, channel->f2);
+        gtk_spin_button_set_value(math_size_spinbutton, channel->size);
+    }
+    gtk_spin_button_set_value(math_scale_spinbutton, math_scale[k]);
+    gtk_toggle_button_set_active(math_show_checkbutton, math_show[k]);
+    math_loading = false;
+}
+
+void on_sinc_toggled(GtkToggleButton *widget, gpointer user_data) {
+    g_print("%s\n", __func__);
+    gtk_widget_queue_draw(drawing_area);
+}
+
+static bool run_decode(frame_t* frame, void* user) {
+    g_mutex_lock(&record_lock);
+    if ( !run_accumulate ) {
+        record_clear(&capture_record);
+        decoder_reset(&capture_decoder);
+    }
+    if ( record_append(&capture_record, frame->data, frame->num_samples, frame->num_channels, frame->config.channel_enable) == 0 ) {
+        record_config = frame->config;
+        decoder_run(&capture_decoder, capture_record.samples[0], capture_record.samples[1], capture_record.length);
+    }
+    g_mutex_unlock(&record_lock);
+
+    return true;
+}
+
+//Brings the shown math channels up to date, so drawing finds them cached
+static bool run_analyze(frame_t* frame, void* user) {
+    g_mutex_lock(&record_lock);
+    math_set_input();
+    for (int k=0;k<DERIVED_MAX;k++)
+        if ( math_show[k] )
+            derived_get(&math, 2+k);
+    g_mutex_unlock(&record_lock);
+
+    if ( g_atomic_int_get(&trend_logging) )
+        trend_frame(frame);
+    if ( xy_show && frame->num_channels == 2 )
+        xy_push(&xy_view, frame->data, frame->num_samples, frame->time_us);
+    if ( g_atomic_int_get(&xcorr_enabled) && frame->num_channels == 2 )
+        xcorr_frame(frame);
+
+    return true;
+}
+
+static gboolean on_run_redraw(gpointer data) {
+    g_atomic_int_set(&run_redraw, 0);
+    gtk_widget_queue_draw(drawing_area);
+    return G_SOURCE_REMOVE;
+}
+
+//At most one redraw is pending however fast frames arrive
+static bool run_render(frame_t* frame, void* user) {
+    if ( g_atomic_int_compare_and_exchange(&run_redraw, 0, 1) )
+        g_idle_add(on_run_redraw, NULL);
+    return true;
+}
+
+static bool run_persist(frame_t* frame, void* user) {
+    g_mutex_lock(&run_log_lock);
+    if ( run_logging )
+        caplog_push(&capture_log, frame);
+    g_mutex_unlock(&run_log_lock);
+
+    return false;
+}
+
+//The stages may hold every pooled frame for a moment. That holds back
+//acquisition the way a full queue does, it does not end the run.
+static bool run_pool_full(void) {
+    return frame_pool_in_use(&frame_pool) >= frame_pool.size;
+}
+
+//A worker that ends without being stopped (a failed capture) releases the
+//toggle, unless a new run has started since
+static gboolean on_run_ended(gpointer data) {
+    if ( data == run_worker )
+        gtk_toggle_button_set_active(run_togglebutton, FALSE);
+    return G_SOURCE_REMOVE;
+}
+
+static gpointer run_thread(gpointer data) {
+    while ( !g_atomic_int_get(&run_stop) ) {
+        frame_t* frame;
+
+        if ( run_pool_full() ) {
+            g_usleep(RUN_POOL_RETRY*1000);
+            continue;
+        }
+
+        frame = capture_pooled(&run_stop);
+        if ( frame == NULL )
+            break;
+        pipeline_push(&run_pipeline, frame);
+    }
+
+    if ( !g_atomic_int_get(&run_stop) )
+        g_idle_add(on_run_ended, g_thread_self());
+    return NULL;
+}
+
+//A slot that finds the pool empty counts as failed, the next one retries
+static gpointer run_periodic_thread(gpointer data) {
+    while ( !g_atomic_int_get(&run_stop) ) {
+        int64_t request;
+        frame_t* frame;
+        int res = periodic_wait(&run_periodic, RUN_PERIODIC_WAIT, &request);
+
+        if ( res < 0 )
+            break;
+        if ( res == 0 )
+            continue;
+
+        if ( run_pool_full() ) {
+            periodic_done(&run_periodic, g_get_monotonic_time(), false);
+            continue;
+        }
+
+        frame = capture_pooled(&run_stop);
+        periodic_done(&run_periodic, g_get_monotonic_time(), frame != NULL);
+        if ( frame == NULL )
+            break;
+        frame->request_us = request;
+        pipeline_push(&run_pipeline, frame);
+    }
+
+    if ( !g_atomic_int_get(&run_stop) )
+        g_idle_add(on_run_ended, g_thread_self());
+    return NULL;
+}
+
+static gboolean on_run_timer(gpointer data) {
+    char text[(PIPE_MAX_STAGES+2+PERIODIC_RATES)*80];
+    periodic_rate_t rates[PERIODIC_RATES];
+    int num_rates;
+    int len = 0;
+
+    text[0] = 0;
+    for (int i=0;i<run_pipeline.num_stages;i++) {
+        pipe_stats_t stats;
+
+        pipeline_stats(&run_pipeline, i, &stats);
+        len += snprintf(text+len, sizeof(text)-len, "%s%s %d/%d (max %d), %.0f%% busy, %" G_GUINT64_FORMAT " dropped",
+                        i ? "\n" : "", stats.name, stats.fill, PIPE_QUEUE_SIZE, stats.max_fill,
+                        100*stats.busy, (guint64)stats.dropped);
+    }
+
+    if ( run_period_us ) {
+        periodic_stats_t stats;
+
+        periodic_stats(&run_periodic, &stats);
+        len += snprintf(text+len, sizeof(text)-len, "\nevery %.1f ms: achieved %.2f ms, jitter %.2f ms rms (max %.2f), "
+                        "%" G_GUINT64_FORMAT " of %" G_GUINT64_FORMAT " slots missed",
+                        stats.period_us/1000.0, stats.achieved_us/1000, stats.late_rms_us/1000, stats.late_max_us/1000,
+                        (guint64)stats.missed, (guint64)stats.slots);
+    }
+
+    //What each frame size can sustain, from the captures actually made
+    num_rates = periodic_rates_get(&capture_rates, rates, PERIODIC_RATES);
+    for (int i=0;i<num_rates;i++)
+        len += snprintf(text+len, sizeof(text)-len, "\n%d x %d ch: %.1f ms (max %.1f), up to %.1f/s",
+                        rates[i].num_samples, rates[i].num_channels, rates[i].mean_us/1000, rates[i].max_us/1000,
+                        rates[i].mean_us > 0 ? 1e6/rates[i].mean_us : 0);
+    gtk_label_set_text(run_status_label, text);
+    record_full_show();
+
+    return G_SOURCE_CONTINUE;
+}
+
+//Only the decode queue drops its oldest frames; the others hold back the
+//stage before them, so a slow stage costs frames there and never stalls
+//acquisition
+void on_run_toggled(GtkToggleButton *button, gpointer user_data) {
+    g_print("%s\n", __func__);
+
+    if ( !gtk_toggle_button_get_active(button) ) {
+        on_run_stop(NULL, NULL);
+        return;
+    }
+
+    if ( acquisition_busy() ) {
+        gtk_toggle_button_set_active(button, FALSE);
+        return;
+    }
+
+    run_accumulate = gtk_toggle_button_get_active(record_togglebutton);
+
+    pipeline_init(&run_pipeline);
+    pipeline_add(&run_pipeline, "decode",  run_decode,  NULL, PIPE_DROP_OLDEST);
+    pipeline_add(&run_pipeline, "analyze", run_analyze, NULL, PIPE_BLOCK);
+    pipeline_add(&run_pipeline, "render",  run_render,  NULL, PIPE_BLOCK);
+    pipeline_add(&run_pipeline, "persist", run_persist, NULL, PIPE_BLOCK);
+
+    //A period of 0 runs free
+    run_period_us = gtk_spin_button_get_value(run_period_spinbutton)*1000;
+    if ( run_period_us && periodic_open(&run_periodic, run_period_us) ) {
+        run_period_us = 0;
+        gtk_toggle_button_set_active(button, FALSE);
+        return;
+    }
+
+    if ( pipeline_start(&run_pipeline) ) {
+        if ( run_period_us )
+            periodic_close(&run_periodic);
+        run_period_us = 0;
+        gtk_toggle_button_set_active(button, FALSE);
+        return;
+    }
+
+    g_atomic_int_set(&run_stop, 0);
+    gtk_widget_set_sensitive(GTK_WIDGET(capture_button), FALSE);
+
+    run_worker = g_thread_new("run", run_period_us ? run_periodic_thread : run_thread, NULL);
+    run_timer  = g_timeout_add(CAPLOG_REFRESH, on_run_timer, NULL);
+}
+
+void on_run_stop(GtkButton *button, gpointer user_data) {
+    g_print("%s\n", __func__);
+
+    if ( run_worker == NULL )
+        return;
+
+    g_atomic_int_set(&run_stop, 1);
+    g_thread_join(run_worker);
+    run_worker = NULL;
+
+    on_run_timer(NULL);
+    pipeline_stop(&run_pipeline);
+    g_source_remove(run_timer);
+    run_timer = 0;
+
+    if ( run_period_us )
+        periodic_close(&run_periodic);
+    run_period_us = 0;
+
+    on_caplog_stop(NULL, NULL);
+    gtk_widget_set_sensitive(GTK_WIDGET(capture_button), TRUE);
+    gtk_widget_queue_draw(drawing_area);
+}
+
+//Offsets and trigger level go out in the 0..200 code of the spin buttons,
+//which span -4..+4 divisions of their channel
+static void autoset_apply(const autoset_state_t* state) {
+    double volts_per_div;
+
+    for (int ch=0;ch<2;ch++) {
+        if ( !state->enable[ch] )
+            continue;
+        volts_per_div = scale_volts_per_div(state->probe[ch], state->scale[ch]);
+        send_setting(FUNC_SCOPE_SETTING, ch ? SCOPE_SCALE_CH2 : SCOPE_SCALE_CH1, state->scale[ch]);
+        send_setting(FUNC_SCOPE_SETTING, ch ? SCOPE_OFFSET_CH2 : SCOPE_OFFSET_CH1, (int)(100+25*state->offset[ch]/volts_per_div));
+    }
+
+    volts_per_div = scale_volts_per_div(state->probe[state->trigger_source], state->scale[state->trigger_source]);
+    send_setting(FUNC_SCOPE_SETTING, SCOPE_SCALE_TIME, state->time_scale);
+    send_setting(FUNC_SCOPE_SETTING, SCOPE_TRIGGER_SOURCE, state->trigger_source);
+    send_setting(FUNC_SCOPE_SETTING, SCOPE_TRIGGER_LEVEL, (int)(100+25*state->trigger_level/volts_per_div));
+}
+
+//The result goes through the widgets, so their handlers send and publish it
+static gboolean on_autoset_finished(gpointer data) {
+    int status = GPOINTER_TO_INT(data);
+    autoset_state_t* state = &autoset_state;
+    char id[4];
+    char* text;
+
+    g_thread_join(autoset_worker);
+    autoset_worker = NULL;
+
+    for (int ch=0;ch<2;ch++) {
+        if ( !state->enable[ch] )
+            continue;
+        gtk_combo_box_set_active(ch ? channel_scale_combobox_ch2 : channel_scale_combobox_ch1, state->scale[ch]);
+        gtk_spin_button_set_value(ch ? channel_offset_spinbutton_ch2 : channel_offset_spinbutton_ch1, state->offset[ch]);
+    }
+    gtk_combo_box_set_active(time_scale_combobox, state->time_scale);
+    snprintf(id, sizeof(id), "%d", state->trigger_source);
+    gtk_combo_box_set_active_id(trigger_source_combobox, id);
+    gtk_spin_button_set_value(trigger_level_spinbutton, state->trigger_level);
+    gtk_combo_box_set_active_id(trigger_mode_combobox, "0");
+
+    if ( status < 0 )
+        text = g_strdup("Capture failed");
+    else
+        text = g_strdup_printf("%s after %d steps in %.0f ms", autoset_converged ? "Settled" : "Stopped", status,
+                               (g_get_monotonic_time()-autoset_start)/1000.0);
+    gtk_label_set_text(autoset_status_label, text);
+    g_free(text);
+
+    gtk_widget_set_sensitive(GTK_WIDGET(autoset_run_button), TRUE);
+    gtk_widget_set_sensitive(GTK_WIDGET(capture_button), TRUE);
+
+    return G_SOURCE_REMOVE;
+}
+
+//Each step applies the settings, throws away the frame that may predate
+//them, measures the next one and moves toward a good framing; the loop ends
+//when a step changes nothing or after AUTOSET_MAX_STEPS
+static gpointer autoset_thread(gpointer data) {
+    autoset_state_t* state = &autoset_state;
+    int num_channels = state->enable[0]+state->enable[1];
+    frame_t* frame = frame_acquire(&frame_pool);
+    int steps = 0;
+    int status = 0;
+
+    if ( frame == NULL ) {
+        fprintf(stderr, "[%d] No free frame.\n", frame_pool_in_use(&frame_pool));
+        g_idle_add(on_autoset_finished, GINT_TO_POINTER(-1));
+        return NULL;
+    }
+
+    autoset_converged = false;
+    send_setting(FUNC_SCOPE_SETTING, SCOPE_TRIGGER_MODE, SCOPE_VAL_TRIGGER_MODE_AUTO);
+
+    while ( steps < AUTOSET_MAX_STEPS && !g_atomic_int_get(&autoset_stop) ) {
+        unsigned int wait_ms = AUTOSET_WAIT + 1000.0*state->num_samples/scale_sample_rate(state->time_scale);
+        autoset_meas_t meas[2] = { { 0 }, { 0 } };
+        autoset_state_t next;
+
+        autoset_apply(state);
+        for (int i=0;i<2 && status == 0;i++)
+            status = capture_frame_timed(frame->data, state->num_samples, num_channels, wait_ms, NULL);
+        if ( status ) {
+            fprintf(stderr, "[%d] Auto-setup capture failed.\n", status);
+            break;
+        }
+        steps++;
+
+        for (int ch=0;ch<2;ch++)
+            if ( state->enable[ch] )
+                autoset_measure(frame->data, state->num_samples, num_channels, ch == 1 && state->enable[0], &meas[ch]);
+
+        autoset_converged = !autoset_step(state, meas, &next);
+        *state = next;
+        if ( autoset_converged )
+            break;
+    }
+
+    frame_unref(frame);
+    g_idle_add(on_autoset_finished, GINT_TO_POINTER(status ? -1 : steps));
+    return NULL;
+}
+
+void on_autoset_run(GtkButton *button, gpointer user_data) {
+    g_print("%s\n", __func__);
+    autoset_state_t* state = &autoset_state;
+
+    if ( acquisition_busy() )
+        return;
+
+    if ( cur_config->channel_enable[0]+cur_config->channel_enable[1] == 0 )
+        return;
+
+    for (int ch=0;ch<2;ch++) {
+        state->enable[ch] = cur_config->channel_enable[ch];
+        state->probe[ch]  = cur_config->channel_probe[ch];
+        state->scale[ch]  = cur_config->channel_scale[ch];
+        state->offset[ch] = cur_config->channel_offset[ch];
+    }
+    state->time_scale     = cur_config->time_scale;
+    state->trigger_source = state->enable[cur_config->trigger_source] ? cur_config->trigger_source : !cur_config->trigger_source;
+    state->trigger_level  = cur_config->trigger_level;
+    state->num_samples    = cur_config->num_samples;
+
+    g_atomic_int_set(&autoset_stop, 0);
+    autoset_start = g_get_monotonic_time();
+
+    gtk_widget_set_sensitive(GTK_WIDGET(autoset_run_button), FALSE);
+    gtk_widget_set_sensitive(GTK_WIDGET(capture_button), FALSE);
+    gtk_label_set_text(autoset_status_label, "Measuring...");
+
+    autoset_worker = g_thread_new("autoset", autoset_thread, NULL);
+}
+
+void on_autoset_abort(GtkButton *button, gpointer user_data) {
+    g_print("%s\n", __func__);
+    g_atomic_int_set(&autoset_stop, 1);
+}
+
+//A packet later than its own duration plus ROLL_WAIT means the device
+//stopped sending; the frame is given up and a new one asked for
+static gpointer roll_thread(gpointer data) {
+    frame_t* frame = data;
+    int num_channels = frame->config.channel_enable[0]+frame->config.channel_enable[1];
+    unsigned int packet_ms = capture_packet_ms(frame->config.time_scale, num_channels, ROLL_WAIT);
+
+    while ( !g_atomic_int_get(&roll_stop) ) {
+        int res = capture_frame_stream(frame->data, frame->config.num_samples, num_channels, ROLL_WAIT, packet_ms,
+                                       &roll_stop, NULL, &roll);
+        if ( res == LIBUSB_ERROR_TIMEOUT || res == LIBUSB_ERROR_INTERRUPTED )
+            continue;
+        if ( res ) {
+            fprintf(stderr, "[%d] Roll capture failed.\n", res);
+            break;
+        }
+    }
+
+    frame_unref(frame);
+    return NULL;
+}
+
+//Paints only the columns finished since the last call; more than a screen
+//of them and the oldest would be overwritten anyway
+static gboolean on_roll_timer(gpointer data) {
+    static roll_column_t columns[ROLL_COLUMNS];
+    int width  = cairo_image_surface_get_width(roll_surface);
+    int height = cairo_image_surface_get_height(roll_surface);
+    size_t count = roll_read(&roll, &roll_position, columns, width);
+    cairo_t* cr;
+
+    if ( count == 0 )
+        return G_SOURCE_CONTINUE;
+
+    cr = cairo_create(roll_surface);
+    for (size_t i=0;i<count;i++) {
+        cairo_set_operator(cr, CAIRO_OPERATOR_CLEAR);
+        cairo_rectangle(cr, roll_x, 0, 1, height);
+        cairo_fill(cr);
+        cairo_set_operator(cr, CAIRO_OPERATOR_OVER);
+
+        for (int ch=0;ch<2;ch++) {
+            int slot = (ch == 1 && roll_config.channel_enable[0]) ? 1 : 0;
+            double top, bottom;
+
+            if ( !roll_config.channel_enable[ch] )
+                continue;
+            if ( ch == 0 )
+                cairo_set_source_rgb(cr, 1, 1, 0);
+            else
+                cairo_set_source_rgb(cr, 0, 1, 0);
+
+            top    = sample_to_y(columns[i].max[slot], height);
+            bottom = sample_to_y(columns[i].min[slot], height);
+            cairo_rectangle(cr, roll_x, top, 1, bottom-top+1);
+            cairo_fill(cr);
+        }
+
+        roll_x = (roll_x+1) % width;
+    }
+    cairo_destroy(cr);
+
+    gtk_widget_queue_draw(drawing_area);
+    return G_SOURCE_CONTINUE;
+}
+
+//Streams packets into a scrolling display as they arrive, for time bases
+//where one capture takes seconds. One surface column per screen column, or
+//per sample when the frame is narrower than the screen.
+void on_roll_toggled(GtkToggleButton *button, gpointer user_data) {
+    g_print("%s\n", __func__);
+    int width  = gtk_widget_get_allocated_width(drawing_area);
+    int height = gtk_widget_get_allocated_height(drawing_area);
+    int num_samples = cur_config->num_samples;
+    int samples_per_column;
+    frame_t* frame;
+
+    if ( !gtk_toggle_button_get_active(button) ) {
+        on_roll_stop(NULL, NULL);
+        return;
+    }
+
+    if ( acquisition_busy() || cur_config->channel_enable[0]+cur_config->channel_enable[1] == 0 || width <= 0 || height <= 0 ) {
+        gtk_toggle_button_set_active(button, FALSE);
+        return;
+    }
+
+    frame = frame_acquire(&frame_pool);
+    if ( frame == NULL ) {
+        gtk_toggle_button_set_active(button, FALSE);
+        return;
+    }
+    config_read(&config_store, &frame->config);
+    roll_config = frame->config;
+
+    samples_per_column = (num_samples+width-1)/width;
+    roll_init(&roll, frame->config.channel_enable[0]+frame->config.channel_enable[1], samples_per_column);
+    roll_surface  = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, (num_samples+samples_per_column-1)/samples_per_column, height);
+    roll_position = 0;
+    roll_x        = 0;
+
+    g_atomic_int_set(&roll_stop, 0);
+    gtk_widget_set_sensitive(GTK_WIDGET(capture_button), FALSE);
+
+    roll_worker = g_thread_new("roll", roll_thread, frame);
+    roll_timer  = g_timeout_add(ROLL_REFRESH, on_roll_timer, NULL);
+}
+
+//The thread sees the stop flag within ROLL_WAIT, also in the middle of a frame
+void on_roll_stop(GtkButton *button, gpointer user_data) {
+    g_print("%s\n", __func__);
+
+    if ( roll_worker == NULL )
+        return;
+
+    g_atomic_int_set(&roll_stop, 1);
+    g_thread_join(roll_worker);
+    roll_worker = NULL;
+
+    g_source_remove(roll_timer);
+    roll_timer = 0;
+    roll_free(&roll);
+
+    cairo_surface_destroy(roll_surface);
+    roll_surface = NULL;
+
+    gtk_widget_set_sensitive(GTK_WIDGET(capture_button), TRUE);
+    gtk_widget_queue_draw(drawing_area);
+}
+
+static void trend_frame(const frame_t* frame) {
+    const config_t* config = &frame->config;
+    float values[TREND_VALUES];
+
+    for (int ch=0;ch<2;ch++) {
+        int slot = (ch == 1 && config->channel_enable[0]) ? 1 : 0;
+
+        if ( !config->channel_enable[ch] ) {
+            values[3*ch+TREND_VPP] = values[3*ch+TREND_FREQUENCY] = values[3*ch+TREND_MEAN] = NAN;
+            continue;
+        }
+        trend_measure(frame->data, frame->num_samples, frame->num_channels, slot,
+                      scale_volts_per_div(config->channel_probe[ch], config->channel_scale[ch]),
+                      config->channel_offset[ch], scale_sample_rate(config->time_scale), &values[3*ch]);
+    }
+
+    trend_append(&trend_store, g_get_real_time(), values);
+}
+
+static gboolean on_trend_timer(gpointer data) {
+    char* text = g_strdup_printf("%" G_GUINT64_FORMAT " frames logged", (guint64)trend_store.points);
+
+    gtk_label_set_text(trend_status_label, text);
+    g_free(text);
+    gtk_widget_queue_draw(trend_drawing_area);
+
+    return G_SOURCE_CONTINUE;
+}
+
+//Frames from Capture and from Run are measured and appended; the files
+//already there are continued
+void on_trend_start(GtkButton *button, gpointer user_data) {
+    g_print("%s\n", __func__);
+
+    if ( trend_logging )
+        return;
+
+    if ( trend_open(&trend_store, gtk_entry_get_text(trend_path_entry)) ) {
+        gtk_label_set_text(trend_status_label, "Cannot open files");
+        return;
+    }
+
+    g_atomic_int_set(&trend_logging, 1);
+    gtk_widget_set_sensitive(GTK_WIDGET(trend_start_button), FALSE);
+    trend_timer = g_timeout_add(TREND_REFRESH, on_trend_timer, NULL);
+    on_trend_timer(NULL);
+}
+
+//The files stay open for the plot until the next start
+void on_trend_stop(GtkButton *button, gpointer user_data) {
+    g_print("%s\n", __func__);
+
+    if ( !trend_logging )
+        return;
+
+    g_atomic_int_set(&trend_logging, 0);
+    g_source_remove(trend_timer);
+    trend_timer = 0;
+
+    on_trend_timer(NULL);
+    gtk_widget_set_sensitive(GTK_WIDGET(trend_start_button), TRUE);
+}
+
+void on_trend_view(GtkComboBox *widget, gpointer user_data) {
+    g_print("%s\n", __func__);
+    gtk_widget_queue_draw(trend_drawing_area);
+}
+
+//The range up to now from the coarsest level that still gives one point
+//per pixel: min/max as a band, the mean as a line
+gboolean trend_draw_callback(GtkWidget *widget, cairo_t *cr, gpointer data) {
+    static trend_point_t points[TREND_MAX_DRAW];
+    static const char* names[] = { "raw", "1 s", "1 min", "1 h" };
+    int width  = gtk_widget_get_allocated_width(widget);
+    int height = gtk_widget_get_allocated_height(widget);
+    int v = gtk_combo_box_get_active(trend_value_combobox);
+    gint64 range = (gint64)atoi(gtk_combo_box_get_active_id(trend_range_combobox))*1000000;
+    gint64 now = g_get_real_time();
+    double low = INFINITY, high = -INFINITY;
+    bool drawing = false;
+    size_t count;
+    int level = 0;
+    char* text;
+
+    cairo_set_source_rgb(cr, 0, 0, 0);
+    cairo_paint(cr);
+
+    if ( v < 0 || width <= 0 )
+        return FALSE;
+
+    count = trend_query(&trend_store, now-range, now, width < TREND_MAX_DRAW ? width : TREND_MAX_DRAW, points, &level);
+    for (size_t i=0;i<count;i++) {
+        if ( isnan(points[i].mean[v]) )
+            continue;
+        low  = fmin(low, points[i].min[v]);
+        high = fmax(high, points[i].max[v]);
+    }
+    if ( low > high )
+        return FALSE;
+    if ( high-low < 1e-6 ) {
+        high += 0.5;
+        low  -= 0.5;
+    }
+
+    cairo_set_line_width(cr, 1);
+    cairo_set_source_rgba(cr, 1, 1, 0, 0.4);
+    for (size_t i=0;i<count;i++) {
+        double x = (double)(points[i].time_us-(now-range))*width/range;
+        double top, bottom;
+
+        if ( isnan(points[i].mean[v]) )
+            continue;
+        top    = height - (points[i].max[v]-low)*height/(high-low);
+        bottom = height - (points[i].min[v]-low)*height/(high-low);
+        cairo_rectangle(cr, x, top, 1, bottom-top+1);
+    }
+    cairo_fill(cr);
+
+    cairo_set_source_rgb(cr, 1, 1, 0);
+    for (size_t i=0;i<count;i++) {
+        double x = (double)(points[i].time_us-(now-range))*width/range;
+        double y = height - (points[i].mean[v]-low)*height/(high-low);
+
+        if ( isnan(points[i].mean[v]) ) {
+            drawing = false;
+            continue;
+        }
+        if ( !drawing )
+            cairo_move_to(cr, x, y);
+        else
+            cairo_line_to(cr, x, y);
+        drawing = true;
+    }
+    cairo_stroke(cr);
+
+    text = g_strdup_printf("%g", high);
+    cairo_move_to(cr, 2, 12);
+    cairo_show_text(cr, text);
+    g_free(text);
+    text = g_strdup_printf("%g, %zu points from %s", low, count, names[level]);
+    cairo_move_to(cr, 2, height-2);
+    cairo_show_text(cr, text);
+    g_free(text);
+
+    return FALSE;
+}
+
+void on_xy_changed(GtkWidget *widget, gpointer user_data) {
+    g_print("%s\n", __func__);
+
+    xy_set_persistence(&xy_view, gtk_spin_button_get_value(xy_persistence_spinbutton));
+    xy_show = gtk_toggle_button_get_active(xy_show_checkbutton);
+    if ( xy_show && last_frame && last_frame->num_channels == 2 && xy_view.frames == 0 )
+        xy_push(&xy_view, last_frame->data, last_frame->num_samples, last_frame->time_us);
+    gtk_widget_queue_draw(drawing_area);
+}
+
+void on_xy_clear(GtkButton *button, gpointer user_data) {
+    g_print("%s\n", __func__);
+    xy_clear(&xy_view);
+    gtk_widget_queue_draw(drawing_area);
+}
+
+static void xcorr_frame(const frame_t* frame) {
+    xcorr_push(&xcorr_engine, frame->data, frame->num_samples, scale_sample_rate(frame->config.time_scale));
+}
+
+static gboolean on_xcorr_timer(gpointer data) {
+    xcorr_result_t result;
+    char* text;
+
+    xcorr_get(&xcorr_engine, &result);
+    if ( result.frames == 0 ) {
+        gtk_label_set_text(xcorr_status_label, "Waiting for a frame with both channels");
+        return G_SOURCE_CONTINUE;
+    }
+
+    text = g_strdup_printf("Delay %.4g s (%.2f samples), correlation %.3f\n"
+                           "Phase %.1f deg at %.4g Hz, coherence %.3f\n%d frames",
+                           result.lag/result.sample_rate, result.lag, result.peak,
+                           result.phase_deg, result.frequency*result.sample_rate, result.coherence, result.frames);
+    gtk_label_set_text(xcorr_status_label, text);
+    g_free(text);
+
+    return G_SOURCE_CONTINUE;
+}
+
+void on_xcorr_changed(GtkToggleButton *button, gpointer user_data) {
+    g_print("%s\n", __func__);
+
+    xcorr_reset(&xcorr_engine);
+    g_atomic_int_set(&xcorr_enabled, gtk_toggle_button_get_active(button));
+
+    if ( g_atomic_int_get(&xcorr_enabled) ) {
+        if ( last_frame && last_frame->num_channels == 2 )
+            xcorr_frame(last_frame);
+        if ( xcorr_timer == 0 )
+            xcorr_timer = g_timeout_add(XCORR_REFRESH, on_xcorr_timer, NULL);
+        on_xcorr_timer(NULL);
+    } else if ( xcorr_timer ) {
+        g_source_remove(xcorr_timer);
+        xcorr_timer = 0;
+    }
+}
+
+void on_xcorr_reset(GtkButton *button, gpointer user_data) {
+    g_print("%s\n", __func__);
+    xcorr_reset(&xcorr_engine);
+    if ( g_atomic_int_get(&xcorr_enabled) )
+        on_xcorr_timer(NULL);
 }
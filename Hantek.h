@@ -28,11 +28,34 @@
 #include <math.h>
 #include <libusb.h>
 #include <sys/fcntl.h>
-#include <sys/mman.h>
 #include <unistd.h>
 
 #include <assert.h>
 
+#include "Config.h"
+#include "Record.h"
+#include "Arb.h"
+#include "Scale.h"
+#include "Bode.h"
+#include "Decode.h"
+#include "Export.h"
+#include "Segment.h"
+#include "Codec.h"
+#include "Caplog.h"
+#include "Mask.h"
+#include "Eye.h"
+#include "Derived.h"
+#include "Interp.h"
+#include "Frame.h"
+#include "Pipeline.h"
+#include "Usbtrace.h"
+#include "Autoset.h"
+#include "Roll.h"
+#include "Trend.h"
+#include "Xy.h"
+#include "Xcorr.h"
+#include "Periodic.h"
+
 #define VENDOR 0x0483
 #define PRODUCT 0x2d42
 
@@ -153,6 +176,52 @@
 #define AWG_VAL_TYPE_ARB3               0x06
 #define AWG_VAL_TYPE_ARB4               0x07
 
+//Arbitrary waveforms: points a waveform is resampled to for the preview
+#define AWG_ARB_POINTS                  4096
+
+//Pooled captures on a worker: packet wait before the stop flag is checked,
+//also the margin on top of one packet time before a packet counts as lost,
+//in ms
+#define CAPTURE_WAIT                    100
+
+//Segmented acquisition: first packet wait before the stop flag is checked
+#define SEGMENT_WAIT                    100
+#define SEGMENT_REPORT_US               50000
+
+//Compressed capture log: statistics refresh period in ms
+#define CAPLOG_REFRESH                  500
+
+//Mask test: counters refresh period in ms
+#define MASK_REFRESH                    500
+
+//Eye diagram: histogram refresh period in ms
+#define EYE_REFRESH                     500
+
+//Auto-setup: capture wait on top of the frame duration, in ms
+#define AUTOSET_WAIT                    200
+
+//Roll mode: packet wait before the stop flag is checked, also the margin on
+//top of one packet time before a packet counts as lost, and redraw period,
+//in ms
+#define ROLL_WAIT                       100
+#define ROLL_REFRESH                    50
+
+//Scheduled acquisition: slot wait before the stop flag is checked, in ms
+#define RUN_PERIODIC_WAIT               100
+
+//Run: retry period while every pooled frame is held by the stages, in ms
+#define RUN_POOL_RETRY                  2
+
+//Trend log: plot refresh period in ms, and most points drawn
+#define TREND_REFRESH                   1000
+#define TREND_MAX_DRAW                  4096
+
+//Delay measurement: result refresh period in ms
+#define XCORR_REFRESH                   500
+
+//Export
+#define EXPORT_SLICE                    (1 << 16)
+
 //Screen Settings
 #define SCREEN_VAL_SCOPE                0x00
 #define SCREEN_VAL_DMM                  0x01
@@ -208,7 +277,105 @@ GtkSpinButton*  awg_trapriseduty_spinbutton = NULL;
 GtkSpinButton*  awg_traphighduty_spinbutton = NULL;
 GtkSpinButton*  awg_trapfallduty_spinbutton = NULL;
 
+GtkEntry*       arb_expression_entry        = NULL;
+GtkFileChooser* arb_file_chooser            = NULL;
+GtkLabel*       arb_status_label            = NULL;
+GtkWidget*      arb_drawing_area            = NULL;
+
+GtkSpinButton*  bode_start_spinbutton       = NULL;
+GtkSpinButton*  bode_stop_spinbutton        = NULL;
+GtkSpinButton*  bode_points_spinbutton      = NULL;
+GtkSpinButton*  bode_settle_spinbutton      = NULL;
+GtkButton*      bode_run_button             = NULL;
+GtkProgressBar* bode_progressbar            = NULL;
+GtkLabel*       bode_status_label           = NULL;
+GtkWidget*      bode_drawing_area           = NULL;
+
+GtkComboBox*    decode_protocol_combobox        = NULL;
+GtkComboBox*    decode_uart_channel_combobox    = NULL;
+GtkSpinButton*  decode_baud_spinbutton          = NULL;
+GtkSpinButton*  decode_spi_bits_spinbutton      = NULL;
+GtkComboBox*    decode_spi_edge_combobox        = NULL;
+GtkSpinButton*  decode_threshold_spinbutton_ch1 = NULL;
+GtkSpinButton*  decode_threshold_spinbutton_ch2 = NULL;
+
+GtkComboBox*    export_format_combobox      = NULL;
+GtkEntry*       export_path_entry           = NULL;
+GtkComboBox*    export_source_combobox      = NULL;
+GtkSpinButton*  export_frames_spinbutton    = NULL;
+GtkButton*      export_run_button           = NULL;
+GtkProgressBar* export_progressbar          = NULL;
+GtkLabel*       export_status_label         = NULL;
+
+GtkComboBox*    segment_mode_combobox       = NULL;
+GtkSpinButton*  segment_count_spinbutton    = NULL;
+GtkSpinButton*  segment_samples_spinbutton  = NULL;
+GtkButton*      segment_run_button          = NULL;
+GtkProgressBar* segment_progressbar         = NULL;
+GtkLabel*       segment_status_label        = NULL;
+GtkSpinButton*  segment_view_spinbutton     = NULL;
+GtkAdjustment*  segment_view_adj            = NULL;
+
+GtkEntry*       caplog_path_entry           = NULL;
+GtkSpinButton*  caplog_threads_spinbutton   = NULL;
+GtkButton*      caplog_start_button         = NULL;
+GtkLabel*       caplog_status_label         = NULL;
+GtkSpinButton*  caplog_frame_spinbutton     = NULL;
+GtkAdjustment*  caplog_frame_adj            = NULL;
+
+GtkSpinButton*  mask_margin_spinbutton      = NULL;
+GtkSpinButton*  mask_smear_spinbutton       = NULL;
+GtkFileChooser* mask_file_chooser           = NULL;
+GtkEntry*       mask_fail_entry             = NULL;
+GtkButton*      mask_run_button             = NULL;
+GtkLabel*       mask_status_label           = NULL;
+
+GtkComboBox*    eye_channel_combobox        = NULL;
+GtkSpinButton*  eye_bitrate_spinbutton      = NULL;
+GtkSpinButton*  eye_threshold_spinbutton    = NULL;
+GtkSpinButton*  eye_gain_spinbutton         = NULL;
+GtkButton*      eye_run_button              = NULL;
+GtkLabel*       eye_status_label            = NULL;
+GtkWidget*      eye_drawing_area            = NULL;
+
+GtkToggleButton* sinc_checkbutton          = NULL;
+GtkToggleButton* run_togglebutton          = NULL;
+GtkLabel*       run_status_label            = NULL;
+GtkToggleButton* roll_togglebutton         = NULL;
+GtkSpinButton*  run_period_spinbutton       = NULL;
+GtkLabel*       cursor_status_label         = NULL;
+
+GtkComboBox*    math_slot_combobox          = NULL;
+GtkComboBox*    math_op_combobox            = NULL;
+GtkComboBox*    math_src_a_combobox         = NULL;
+GtkComboBox*    math_src_b_combobox         = NULL;
+GtkComboBox*    math_filter_combobox        = NULL;
+GtkSpinButton*  math_f1_spinbutton          = NULL;
+GtkSpinButton*  math_f2_spinbutton          = NULL;
+GtkSpinButton*  math_size_spinbutton        = NULL;
+GtkSpinButton*  math_scale_spinbutton       = NULL;
+GtkToggleButton* math_show_checkbutton      = NULL;
+GtkLabel*       math_status_label           = NULL;
+
+GtkButton*      autoset_run_button          = NULL;
+GtkLabel*       autoset_status_label        = NULL;
+
+GtkEntry*       trend_path_entry            = NULL;
+GtkButton*      trend_start_button          = NULL;
+GtkComboBox*    trend_value_combobox        = NULL;
+GtkComboBox*    trend_range_combobox        = NULL;
+GtkLabel*       trend_status_label          = NULL;
+GtkWidget*      trend_drawing_area          = NULL;
+
+GtkToggleButton* xy_show_checkbutton       = NULL;
+GtkSpinButton*  xy_persistence_spinbutton   = NULL;
+
+GtkToggleButton* xcorr_enable_checkbutton  = NULL;
+GtkLabel*       xcorr_status_label          = NULL;
+
+GtkButton*      capture_button              = NULL;
 GtkSpinButton*  capture_samples_spinbutton  = NULL;
+GtkToggleButton* record_togglebutton        = NULL;
 
 GtkWidget* drawing_area = NULL;
 
@@ -227,36 +394,125 @@ typedef struct  __attribute__((packed)) {
         uint8_t last;
 } Hantek_command_t ;
 
-uint8_t capture_buffer[6000];
-
-typedef struct {
-        bool    channel_enable[2];
-        int     channel_coupling[2];
-        int     channel_probe[2];
-        int     channel_scale[2];
-        float   channel_offset[2];
-        bool    channel_bwlimit[2];
-
-        int     time_scale;
-        float   time_offset;
-
-        int     trigger_source;
-        int     trigger_slope;
-        int     trigger_mode;
-        float   trigger_level;                        
-
-        int     awg_type;
-        float   awg_frequency;
-        float   awg_amplitude;
-        float   awg_offset;
-        float   awg_squareduty;
-        float   awg_rampduty;
-        float   awg_trapriseduty;
-        float   awg_traphighduty;
-        float   awg_trapfallduty;
-
-        int     num_samples;
-} config_t;
+//Every capture lands in a frame from this pool; last_frame is the one
+//taken with the Capture button
+frame_pool_t frame_pool;
+frame_t*     last_frame = NULL;
+
+record_t capture_record;
+config_t record_config;         //what capture_record was last appended with, under record_lock
+
+decoder_t capture_decoder;
+
+float arb_points[AWG_ARB_POINTS];
+int   arb_num_points = 0;
+
+bode_point_t bode_points[BODE_MAX_POINTS];
+int          bode_num_points    = 0;
+int          bode_num_done      = 0;
+double       bode_min_settle    = 0;
+int          bode_stop          = 0;
+GThread*     bode_worker        = NULL;
+
+export_t      export_job;
+GThread*      export_worker     = NULL;
+int           export_stop       = 0;
+
+segment_table_t segment_table;
+GThread*      segment_worker    = NULL;
+int           segment_stop      = 0;
+
+caplog_writer_t capture_log;
+caplog_reader_t capture_playback;
+GThread*      caplog_worker     = NULL;
+int           caplog_stop       = 0;
+guint         caplog_timer      = 0;
+
+mask_t        test_mask;
+caplog_writer_t mask_log;
+GThread*      mask_worker       = NULL;
+int           mask_stop         = 0;
+guint         mask_timer        = 0;
+int           mask_frames       = 0;
+int           mask_failures     = 0;
+int           mask_skipped      = 0;
+gint64        mask_start        = 0;
+
+eye_acc_t     eye_acc;
+eye_hist_t    eye_view;
+GThread*      eye_capture_worker = NULL;
+int           eye_capture_stop  = 0;
+guint         eye_timer         = 0;
+gint64        eye_start_time    = 0;
+
+//Free running acquisition: frames go through decode, analyze, render and
+//persist stages. record_lock guards capture_record, capture_decoder and
+//math against the decode and analyze stages.
+pipeline_t    run_pipeline;
+GThread*      run_worker        = NULL;
+int           run_stop          = 0;
+guint         run_timer         = 0;
+bool          run_accumulate    = false;
+int           run_redraw        = 0;
+bool          run_logging       = false;
+GMutex        run_log_lock;
+GMutex        record_lock;
+
+//Run with a period takes one capture per timer slot instead of back to
+//back. capture_rates keeps the capture time of every frame size seen.
+periodic_t    run_periodic;
+int64_t       run_period_us     = 0;
+periodic_rates_t capture_rates;
+
+//Math channels, computed on demand from capture_record
+derived_t     math;
+bool          math_show[DERIVED_MAX];
+double        math_scale[DERIVED_MAX] = { 1, 1, 1, 1 };
+bool          math_loading      = false;
+
+autoset_state_t autoset_state;
+GThread*      autoset_worker    = NULL;
+int           autoset_stop      = 0;
+gint64        autoset_start     = 0;
+bool          autoset_converged = false;
+
+//Roll mode: finished columns are painted into roll_surface at roll_x, which
+//wraps around, so the picture scrolls without moving what is already drawn
+roll_t        roll;
+GThread*      roll_worker       = NULL;
+int           roll_stop         = 0;
+guint         roll_timer        = 0;
+uint64_t      roll_position     = 0;
+cairo_surface_t* roll_surface   = NULL;
+int           roll_x            = 0;
+config_t      roll_config;      //the settings roll was sized and is captured with
+
+//Measurement trend of every frame captured while trend_logging is set
+trend_t       trend_store;
+int           trend_logging     = 0;
+guint         trend_timer       = 0;
+
+//XY mode: CH1 against CH2 as a density image in place of the traces
+xy_t          xy_view;
+bool          xy_show           = false;
+
+//Delay and phase of CH2 against CH1, measured on every two channel frame
+//while xcorr_enabled is set
+xcorr_t       xcorr_engine;
+int           xcorr_enabled     = 0;
+guint         xcorr_timer       = 0;
+
+//Visible window of capture_record, in samples. view_span 0 shows the whole record.
+double  view_first      = 0;
+double  view_span       = 0;
+bool    view_dragging   = false;
+double  view_drag_x     = 0;
+double  view_drag_first = 0;
+
+//Measurement cursors, in samples of capture_record; -1 when not placed
+double  cursor_a        = -1;
+double  cursor_b        = -1;
+bool    cursor_dragging = false;
 
 config_t default_config = {
         .channel_enable   = { true, true },
@@ -287,6 +543,11 @@ config_t default_config = {
         .num_samples      = 1200 
 };
 
-config_t* cur_config = NULL;
+//Settings as edited by the GTK thread; other threads use config_read
+config_t       work_config;
+config_t*      cur_config = NULL;
+config_store_t config_store;
+
+usbtrace_t     usb_trace;
 
 #endif //_HANTEK_H
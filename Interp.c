@@ -0,0 +1,81 @@
+/*
+    Hantek 2D72 handheld oscillosope tool for linux
+    Copyright (C) 2021 Luca Oliva
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+#include <math.h>
+
+#include "Interp.h"
+
+typedef float   v8sf_t __attribute__((vector_size(32)));
+typedef uint8_t v8u8_t __attribute__((vector_size(8)));
+
+static v8sf_t coeffs[INTERP_PHASES];
+static int    coeffs_ready;
+
+static double sinc(double x) {
+    return x == 0 ? 1 : sin(M_PI*x)/(M_PI*x);
+}
+
+//Tap t of phase p weighs sample base+t for a point p/INTERP_PHASES past
+//sample base+INTERP_TAPS/2-1. Each phase is normalised to unity DC gain.
+static void coeffs_init(void) {
+    if ( coeffs_ready )
+        return;
+
+    for (int p=0;p<INTERP_PHASES;p++) {
+        double sum = 0;
+        for (int t=0;t<INTERP_TAPS;t++) {
+            double x = t-(INTERP_TAPS/2-1)-(double)p/INTERP_PHASES;
+            coeffs[p][t] = sinc(x)*sinc(x/(INTERP_TAPS/2));
+            sum += coeffs[p][t];
+        }
+        for (int t=0;t<INTERP_TAPS;t++)
+            coeffs[p][t] /= sum;
+    }
+
+    coeffs_ready = 1;
+}
+
+//Raw sample values at first, first+step, ... for count points, samples
+//past either end of the record repeating the end values. Away from the ends
+//each point is one 8 byte load, one conversion and one vector multiply.
+void interp_resample(const uint8_t* samples, size_t length, double first, double step, float* out, int count) {
+    coeffs_init();
+
+    for (int k=0;k<count;k++) {
+        //Position in 1/INTERP_PHASES of a sample
+        long long q = llrint((first+k*step)*INTERP_PHASES);
+        int p = q & (INTERP_PHASES-1);
+        ptrdiff_t base = (ptrdiff_t)((q-p)/INTERP_PHASES)-(INTERP_TAPS/2-1);
+        v8sf_t acc;
+
+        if ( base >= 0 && base+INTERP_TAPS <= (ptrdiff_t)length ) {
+            v8u8_t bytes;
+            memcpy(&bytes, samples+base, sizeof(bytes));
+            acc = __builtin_convertvector(bytes, v8sf_t)*coeffs[p];
+        } else {
+            for (int t=0;t<INTERP_TAPS;t++) {
+                ptrdiff_t i = base+t;
+                i = i < 0 ? 0 : i >= (ptrdiff_t)length ? (ptrdiff_t)length-1 : i;
+                acc[t] = samples[i]*coeffs[p][t];
+            }
+        }
+
+        out[k] = (acc[0]+acc[4]) + (acc[1]+acc[5]) + (acc[2]+acc[6]) + (acc[3]+acc[7]);
+    }
+}
@@ -0,0 +1,32 @@
+/*
+    Hantek 2D72 handheld oscillosope tool for linux
+    Copyright (C) 2021 Luca Oliva
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _INTERP_H
+#define _INTERP_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+//sin(x)/x reconstruction: a Lanczos windowed sinc of INTERP_TAPS taps,
+//tabulated for INTERP_PHASES fractional positions between two samples
+#define INTERP_TAPS                     8
+#define INTERP_PHASES                   64 //power of two
+
+void interp_resample(const uint8_t* samples, size_t length, double first, double step, float* out, int count);
+
+#endif //_INTERP_H
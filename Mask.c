@@ -0,0 +1,208 @@
+/*
+    Hantek 2D72 handheld oscillosope tool for linux
+    Copyright (C) 2021 Luca Oliva
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "Mask.h"
+#include "Scale.h"
+
+#define MASK_MAX_POINTS                 256
+
+static inline uint8_t clamp_raw(int raw) {
+    return raw < 0 ? 0 : raw > 255 ? 255 : raw;
+}
+
+//Envelope of the golden frame widened by smear samples on each side and by
+//margin codes up and down; a disabled channel accepts anything.
+int mask_from_golden(mask_t* mask, const uint8_t* frame, int num_samples, int num_channels, const bool enable[2],
+                     int margin, int smear) {
+    if ( num_samples <= 0 || num_samples > MASK_MAX_SAMPLES )
+        return -1;
+
+    mask->num_samples = num_samples;
+
+    for (int ch=0;ch<2;ch++) {
+        int slot = (ch == 1 && enable[0]) ? 1 : 0;
+
+        for (int i=0;i<num_samples;i++) {
+            int lo = 255, hi = 0;
+
+            if ( !enable[ch] ) {
+                mask->lo[ch][i] = 0;
+                mask->hi[ch][i] = 255;
+                continue;
+            }
+
+            for (int j=i-smear;j<=i+smear;j++) {
+                int v;
+                if ( j < 0 || j >= num_samples )
+                    continue;
+                v = frame[j*num_channels+slot];
+                if ( v < lo )
+                    lo = v;
+                if ( v > hi )
+                    hi = v;
+            }
+
+            mask->lo[ch][i] = clamp_raw(lo-margin);
+            mask->hi[ch][i] = clamp_raw(hi+margin);
+        }
+    }
+
+    mask->valid = true;
+    mask->num_channels = 0;
+    return 0;
+}
+
+//Text file, one breakpoint per line, in screen divisions:
+//  <channel 1|2> <time div> <low div> <high div>
+//Time counts from the left edge, levels from the center line. Limits are
+//interpolated linearly between breakpoints, channels without any accept
+//everything.
+int mask_load(mask_t* mask, const char* path, int num_samples) {
+    static double points[2][MASK_MAX_POINTS][3];
+    int num_points[2] = { 0, 0 };
+    char line[256];
+    FILE* file;
+
+    if ( num_samples <= 0 || num_samples > MASK_MAX_SAMPLES )
+        return -1;
+
+    file = fopen(path, "r");
+    if ( file == NULL ) {
+        perror(path);
+        return -1;
+    }
+
+    while ( fgets(line, sizeof(line), file) ) {
+        int ch;
+        double x, lo, hi;
+
+        if ( line[0] == '#' || sscanf(line, "%d %lf %lf %lf", &ch, &x, &lo, &hi) != 4 )
+            continue;
+        if ( ch < 1 || ch > 2 || num_points[ch-1] == MASK_MAX_POINTS )
+            continue;
+
+        points[ch-1][num_points[ch-1]][0] = x*SCALE_SAMPLES_PER_DIV;
+        points[ch-1][num_points[ch-1]][1] = SCALE_RAW_CENTER + lo*SCALE_RAW_PER_DIV;
+        points[ch-1][num_points[ch-1]][2] = SCALE_RAW_CENTER + hi*SCALE_RAW_PER_DIV;
+        num_points[ch-1]++;
+    }
+    fclose(file);
+
+    if ( num_points[0]+num_points[1] == 0 )
+        return -1;
+
+    mask->num_samples = num_samples;
+
+    for (int ch=0;ch<2;ch++) {
+        double (*p)[3] = points[ch];
+        int n = num_points[ch];
+        int k = 0;
+
+        for (int i=0;i<num_samples;i++) {
+            double lo, hi;
+
+            if ( n == 0 ) {
+                lo = 0;
+                hi = 255;
+            } else if ( i <= p[0][0] ) {
+                lo = p[0][1];
+                hi = p[0][2];
+            } else {
+                while ( k+1 < n && p[k+1][0] < i )
+                    k++;
+                if ( k+1 == n ) {
+                    lo = p[k][1];
+                    hi = p[k][2];
+                } else {
+                    double t = p[k+1][0] > p[k][0] ? (i-p[k][0])/(p[k+1][0]-p[k][0]) : 1;
+                    lo = p[k][1] + t*(p[k+1][1]-p[k][1]);
+                    hi = p[k][2] + t*(p[k+1][2]-p[k][2]);
+                }
+            }
+
+            mask->lo[ch][i] = clamp_raw(ceil(lo));
+            mask->hi[ch][i] = clamp_raw(floor(hi));
+        }
+    }
+
+    mask->valid = true;
+    mask->num_channels = 0;
+    return 0;
+}
+
+//Interleaves the limits of the enabled channels the way capture_frame does
+void mask_layout(mask_t* mask, int num_channels, const bool enable[2]) {
+    for (int ch=0;ch<2;ch++) {
+        int slot = (ch == 1 && enable[0]) ? 1 : 0;
+
+        if ( !enable[ch] )
+            continue;
+
+        for (int i=0;i<mask->num_samples;i++) {
+            mask->test_lo[i*num_channels+slot] = mask->lo[ch][i];
+            mask->test_hi[i*num_channels+slot] = mask->hi[ch][i];
+        }
+    }
+
+    mask->num_channels = num_channels;
+    mask->enable[0]    = enable[0];
+    mask->enable[1]    = enable[1];
+}
+
+//Number of samples outside the limits, compared 16 bytes at a time with
+//the compiler vector extensions. A vector compare yields 0xFF per failing
+//byte, so subtracting it counts; byte counters are emptied every 255 steps.
+//A frame laid out differently from the limits can not be tested: -1.
+long mask_test(const mask_t* mask, const frame_t* frame) {
+    typedef uint8_t v16_t __attribute__((vector_size(16)));
+    const uint8_t* data = frame->data;
+    const uint8_t* lo = mask->test_lo;
+    const uint8_t* hi = mask->test_hi;
+    size_t length = (size_t)mask->num_samples*mask->num_channels;
+    long count = 0;
+    size_t i = 0;
+
+    if ( frame->num_samples != mask->num_samples || frame->num_channels != mask->num_channels ||
+         frame->config.channel_enable[0] != mask->enable[0] || frame->config.channel_enable[1] != mask->enable[1] )
+        return -1;
+
+    while ( i+16 <= length ) {
+        v16_t acc = { 0 };
+
+        for (int step=0;step<255 && i+16<=length;step++,i+=16) {
+            v16_t f, l, h;
+            memcpy(&f, data+i, 16);
+            memcpy(&l, lo+i, 16);
+            memcpy(&h, hi+i, 16);
+            acc -= (v16_t)((f < l) | (f > h));
+        }
+
+        for (int k=0;k<16;k++)
+            count += acc[k];
+    }
+
+    for (;i<length;i++)
+        count += (data[i] < lo[i]) | (data[i] > hi[i]);
+
+    return count;
+}
@@ -0,0 +1,52 @@
+/*
+    Hantek 2D72 handheld oscillosope tool for linux
+    Copyright (C) 2021 Luca Oliva
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _MASK_H
+#define _MASK_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "Frame.h"
+
+#define MASK_MAX_SAMPLES                3000
+
+//Per channel limits in raw sample codes, inclusive. test_lo and test_hi are
+//the same limits laid out like a capture frame, so a frame is checked with
+//one flat compare over its bytes; only frames taken with the same length
+//and enables as the layout can be.
+typedef struct {
+        bool            valid;
+        int             num_samples;
+        uint8_t         lo[2][MASK_MAX_SAMPLES];
+        uint8_t         hi[2][MASK_MAX_SAMPLES];
+
+        int             num_channels;
+        bool            enable[2];
+        uint8_t         test_lo[2*MASK_MAX_SAMPLES];
+        uint8_t         test_hi[2*MASK_MAX_SAMPLES];
+} mask_t;
+
+int    mask_from_golden(mask_t* mask, const uint8_t* frame, int num_samples, int num_channels, const bool enable[2],
+                        int margin, int smear);
+int    mask_load(mask_t* mask, const char* path, int num_samples);
+void   mask_layout(mask_t* mask, int num_channels, const bool enable[2]);
+long   mask_test(const mask_t* mask, const frame_t* frame);
+
+#endif //_MASK_H
@@ -0,0 +1,180 @@
+/*
+    Hantek 2D72 handheld oscillosope tool for linux
+    Copyright (C) 2021 Luca Oliva
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+
+#include "Periodic.h"
+
+static int64_t periodic_now(void) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec*1000000 + now.tv_nsec/1000;
+}
+
+//The first slot is one period from now, the following ones are absolute
+//so lateness never accumulates
+int periodic_open(periodic_t* periodic, int64_t period_us) {
+    struct itimerspec spec;
+
+    memset(periodic, 0, sizeof(*periodic));
+    pthread_mutex_init(&periodic->lock, NULL);
+
+    periodic->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+    if ( periodic->timer_fd < 0 ) {
+        perror("timerfd_create");
+        return -1;
+    }
+
+    periodic->first_us        = periodic_now()+period_us;
+    periodic->stats.period_us = period_us;
+
+    spec.it_value.tv_sec     = periodic->first_us/1000000;
+    spec.it_value.tv_nsec    = periodic->first_us%1000000*1000;
+    spec.it_interval.tv_sec  = period_us/1000000;
+    spec.it_interval.tv_nsec = period_us%1000000*1000;
+    if ( timerfd_settime(periodic->timer_fd, TFD_TIMER_ABSTIME, &spec, NULL) ) {
+        perror("timerfd_settime");
+        close(periodic->timer_fd);
+        periodic->timer_fd = -1;
+        return -1;
+    }
+
+    return 0;
+}
+
+//Waits at most timeout_ms for the next slot: 1 with the slot time in
+//request_us, 0 on timeout, -1 on error. Expirations that piled up while
+//the last capture ran are counted as missed, the latest one is served.
+int periodic_wait(periodic_t* periodic, int timeout_ms, int64_t* request_us) {
+    struct pollfd fd = { .fd = periodic->timer_fd, .events = POLLIN };
+    periodic_stats_t* stats = &periodic->stats;
+    uint64_t expirations;
+    int64_t late;
+    int res;
+
+    res = poll(&fd, 1, timeout_ms);
+    if ( res <= 0 )
+        return res;
+    if ( read(periodic->timer_fd, &expirations, sizeof(expirations)) != sizeof(expirations) ) {
+        perror("timerfd");
+        return -1;
+    }
+
+    pthread_mutex_lock(&periodic->lock);
+    periodic->start_us = periodic_now();
+    periodic->slot    += expirations;
+    *request_us        = periodic->first_us + (int64_t)(periodic->slot-1)*stats->period_us;
+    late               = periodic->start_us - *request_us;
+
+    stats->slots  += expirations;
+    stats->missed += expirations-1;
+    stats->captures++;
+    if ( periodic->last_start_us )
+        stats->achieved_us += ((periodic->start_us-periodic->last_start_us)-stats->achieved_us)/(stats->captures-1);
+    periodic->last_start_us = periodic->start_us;
+
+    //Welford, so the jitter needs no history
+    {
+        double delta = late-stats->late_mean_us;
+        stats->late_mean_us += delta/stats->captures;
+        periodic->late_m2      += delta*(late-stats->late_mean_us);
+        stats->late_rms_us   = sqrt(periodic->late_m2/stats->captures);
+        if ( late > stats->late_max_us )
+            stats->late_max_us = late;
+    }
+    pthread_mutex_unlock(&periodic->lock);
+
+    return 1;
+}
+
+void periodic_done(periodic_t* periodic, int64_t done_us, bool ok) {
+    periodic_stats_t* stats = &periodic->stats;
+    double busy = done_us-periodic->start_us;
+
+    pthread_mutex_lock(&periodic->lock);
+    if ( !ok )
+        stats->failed++;
+    stats->busy_mean_us += (busy-stats->busy_mean_us)/stats->captures;
+    if ( busy > stats->busy_max_us )
+        stats->busy_max_us = busy;
+    pthread_mutex_unlock(&periodic->lock);
+}
+
+void periodic_stats(periodic_t* periodic, periodic_stats_t* stats) {
+    pthread_mutex_lock(&periodic->lock);
+    *stats = periodic->stats;
+    pthread_mutex_unlock(&periodic->lock);
+}
+
+void periodic_close(periodic_t* periodic) {
+    if ( periodic->timer_fd >= 0 )
+        close(periodic->timer_fd);
+    periodic->timer_fd = -1;
+    pthread_mutex_destroy(&periodic->lock);
+}
+
+void periodic_rates_init(periodic_rates_t* rates) {
+    memset(rates, 0, sizeof(*rates));
+    pthread_mutex_init(&rates->lock, NULL);
+}
+
+//A new frame size takes the place of the least seen one when the table is full
+void periodic_rates_note(periodic_rates_t* rates, int num_samples, int num_channels, int64_t busy_us) {
+    periodic_rate_t* rate = NULL;
+
+    pthread_mutex_lock(&rates->lock);
+    for (int i=0;i<rates->count;i++) {
+        if ( rates->rates[i].num_samples == num_samples && rates->rates[i].num_channels == num_channels ) {
+            rate = &rates->rates[i];
+            break;
+        }
+        if ( rate == NULL || rates->rates[i].count < rate->count )
+            rate = &rates->rates[i];
+    }
+    if ( rate == NULL || rate->num_samples != num_samples || rate->num_channels != num_channels ) {
+        if ( rates->count < PERIODIC_RATES )
+            rate = &rates->rates[rates->count++];
+        memset(rate, 0, sizeof(*rate));
+        rate->num_samples  = num_samples;
+        rate->num_channels = num_channels;
+    }
+
+    rate->count++;
+    rate->mean_us += (busy_us-rate->mean_us)/rate->count;
+    if ( busy_us > rate->max_us )
+        rate->max_us = busy_us;
+    pthread_mutex_unlock(&rates->lock);
+}
+
+int periodic_rates_get(periodic_rates_t* rates, periodic_rate_t* out, int max) {
+    int count;
+
+    pthread_mutex_lock(&rates->lock);
+    count = rates->count < max ? rates->count : max;
+    memcpy(out, rates->rates, count*sizeof(periodic_rate_t));
+    pthread_mutex_unlock(&rates->lock);
+
+    return count;
+}
@@ -0,0 +1,81 @@
+/*
+    Hantek 2D72 handheld oscillosope tool for linux
+    Copyright (C) 2021 Luca Oliva
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _PERIODIC_H
+#define _PERIODIC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#define PERIODIC_RATES                  16
+
+//Times are CLOCK_MONOTONIC microseconds. Lateness is how long after its
+//slot a capture started; a slot whose capture could not start before the
+//next one is missed.
+typedef struct {
+        int64_t         period_us;
+        uint64_t        slots;
+        uint64_t        captures;
+        uint64_t        missed;
+        uint64_t        failed;
+        double          achieved_us;    //mean time between starts
+        double          late_mean_us;
+        double          late_rms_us;    //around the mean, the jitter
+        double          late_max_us;
+        double          busy_mean_us;
+        double          busy_max_us;
+} periodic_stats_t;
+
+typedef struct {
+        int             timer_fd;
+        int64_t         first_us;
+        uint64_t        slot;
+        int64_t         start_us;
+        int64_t         last_start_us;
+        double          late_m2;
+        periodic_stats_t stats;
+        pthread_mutex_t lock;
+} periodic_t;
+
+//Capture time seen for one frame size
+typedef struct {
+        int             num_samples;
+        int             num_channels;
+        uint64_t        count;
+        double          mean_us;
+        double          max_us;
+} periodic_rate_t;
+
+typedef struct {
+        pthread_mutex_t lock;
+        int             count;
+        periodic_rate_t rates[PERIODIC_RATES];
+} periodic_rates_t;
+
+int  periodic_open(periodic_t* periodic, int64_t period_us);
+int  periodic_wait(periodic_t* periodic, int timeout_ms, int64_t* request_us);
+void periodic_done(periodic_t* periodic, int64_t done_us, bool ok);
+void periodic_stats(periodic_t* periodic, periodic_stats_t* stats);
+void periodic_close(periodic_t* periodic);
+
+void periodic_rates_init(periodic_rates_t* rates);
+void periodic_rates_note(periodic_rates_t* rates, int num_samples, int num_channels, int64_t busy_us);
+int  periodic_rates_get(periodic_rates_t* rates, periodic_rate_t* out, int max);
+
+#endif //_PERIODIC_H
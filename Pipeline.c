@@ -0,0 +1,222 @@
+/*
+    Hantek 2D72 handheld oscillosope tool for linux
+    Copyright (C) 2021 Luca Oliva
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include "Pipeline.h"
+
+#define PIPE_WAIT_US                    10000
+
+static int64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec*1000000 + ts.tv_nsec/1000;
+}
+
+//Sleeps until posted or for at most PIPE_WAIT_US, so a stop is noticed
+static void pipe_wait(sem_t* sem) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_nsec += PIPE_WAIT_US*1000;
+    if ( ts.tv_nsec >= 1000000000 ) {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000;
+    }
+    while ( sem_timedwait(sem, &ts) && errno == EINTR )
+        ;
+}
+
+static void queue_init(pipe_queue_t* queue, int policy) {
+    memset(queue, 0, sizeof(*queue));
+    queue->policy = policy;
+    sem_init(&queue->items, 0, 0);
+    sem_init(&queue->space, 0, 0);
+}
+
+static void queue_destroy(pipe_queue_t* queue) {
+    sem_destroy(&queue->items);
+    sem_destroy(&queue->space);
+}
+
+static int queue_fill(const pipe_queue_t* queue) {
+    return __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE) - __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE);
+}
+
+//The oldest frame, or NULL when empty. The slot is read before the claim:
+//the producer only reuses it once tail has moved, which fails our claim.
+static frame_t* queue_pop(pipe_queue_t* queue) {
+    uint64_t tail = __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE);
+
+    for (;;) {
+        frame_t* frame;
+
+        if ( tail == __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE) )
+            return NULL;
+        frame = __atomic_load_n(&queue->slots[tail % PIPE_QUEUE_SIZE], __ATOMIC_RELAXED);
+        if ( __atomic_compare_exchange_n(&queue->tail, &tail, tail+1, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE) )
+            return frame;
+    }
+}
+
+//Takes over the caller's reference. With PIPE_BLOCK waits for room while
+//running is set, otherwise makes room by dropping; false if the frame
+//could not be queued and was released.
+static bool queue_push(pipe_queue_t* queue, frame_t* frame, const bool* running) {
+    uint64_t head = queue->head;
+    int fill;
+
+    while ( head-__atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE) >= PIPE_QUEUE_SIZE ) {
+        if ( queue->policy == PIPE_BLOCK ) {
+            if ( !__atomic_load_n(running, __ATOMIC_ACQUIRE) ) {
+                frame_unref(frame);
+                __atomic_add_fetch(&queue->dropped, 1, __ATOMIC_RELAXED);
+                return false;
+            }
+            pipe_wait(&queue->space);
+        } else {
+            frame_t* oldest = queue_pop(queue);
+            if ( oldest ) {
+                frame_unref(oldest);
+                __atomic_add_fetch(&queue->dropped, 1, __ATOMIC_RELAXED);
+            }
+        }
+    }
+
+    __atomic_store_n(&queue->slots[head % PIPE_QUEUE_SIZE], frame, __ATOMIC_RELAXED);
+    __atomic_store_n(&queue->head, head+1, __ATOMIC_RELEASE);
+    __atomic_add_fetch(&queue->pushed, 1, __ATOMIC_RELAXED);
+    sem_post(&queue->items);
+
+    fill = queue_fill(queue);
+    if ( fill > __atomic_load_n(&queue->max_fill, __ATOMIC_RELAXED) )
+        __atomic_store_n(&queue->max_fill, fill, __ATOMIC_RELAXED);
+
+    return true;
+}
+
+static void* pipe_stage(void* data) {
+    pipe_stage_t* stage = data;
+
+    for (;;) {
+        frame_t* frame = queue_pop(&stage->input);
+        int64_t start;
+
+        if ( frame == NULL ) {
+            //Stopping: the previous stage is done, so empty means drained
+            if ( !__atomic_load_n(&stage->running, __ATOMIC_ACQUIRE) )
+                break;
+            pipe_wait(&stage->input.items);
+            continue;
+        }
+        sem_post(&stage->input.space);
+
+        start = now_us();
+        if ( stage->work(frame, stage->user) && stage->next )
+            queue_push(&stage->next->input, frame, &stage->next->running);
+        else
+            frame_unref(frame);
+
+        __atomic_add_fetch(&stage->busy_us, now_us()-start, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&stage->processed, 1, __ATOMIC_RELAXED);
+    }
+
+    return NULL;
+}
+
+void pipeline_init(pipeline_t* pipe) {
+    memset(pipe, 0, sizeof(*pipe));
+}
+
+int pipeline_add(pipeline_t* pipe, const char* name, pipe_work_t work, void* user, int policy) {
+    pipe_stage_t* stage;
+
+    if ( pipe->num_stages == PIPE_MAX_STAGES )
+        return -1;
+
+    stage = &pipe->stages[pipe->num_stages];
+    stage->name = name;
+    stage->work = work;
+    stage->user = user;
+    queue_init(&stage->input, policy);
+    if ( pipe->num_stages > 0 )
+        pipe->stages[pipe->num_stages-1].next = stage;
+
+    return pipe->num_stages++;
+}
+
+int pipeline_start(pipeline_t* pipe) {
+    pipe->start_us = now_us();
+
+    for (int i=0;i<pipe->num_stages;i++) {
+        pipe_stage_t* stage = &pipe->stages[i];
+
+        stage->running = true;
+        if ( pthread_create(&stage->thread, NULL, pipe_stage, stage) ) {
+            perror(stage->name);
+            for (int j=i;j<pipe->num_stages;j++)
+                queue_destroy(&pipe->stages[j].input);
+            pipe->num_stages = i;
+            pipeline_stop(pipe);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+//Called by the acquisition thread with a reference it gives away
+bool pipeline_push(pipeline_t* pipe, frame_t* frame) {
+    if ( pipe->num_stages == 0 ) {
+        frame_unref(frame);
+        return false;
+    }
+
+    return queue_push(&pipe->stages[0].input, frame, &pipe->stages[0].running);
+}
+
+void pipeline_stats(pipeline_t* pipe, int index, pipe_stats_t* stats) {
+    pipe_stage_t* stage = &pipe->stages[index];
+    int64_t elapsed = now_us()-pipe->start_us;
+
+    stats->name      = stage->name;
+    stats->fill      = queue_fill(&stage->input);
+    stats->max_fill  = __atomic_load_n(&stage->input.max_fill, __ATOMIC_RELAXED);
+    stats->pushed    = __atomic_load_n(&stage->input.pushed, __ATOMIC_RELAXED);
+    stats->dropped   = __atomic_load_n(&stage->input.dropped, __ATOMIC_RELAXED);
+    stats->processed = __atomic_load_n(&stage->processed, __ATOMIC_RELAXED);
+    stats->busy      = elapsed > 0 ? (double)__atomic_load_n(&stage->busy_us, __ATOMIC_RELAXED)/elapsed : 0;
+}
+
+//Stages are stopped front to back, each once its input is drained, so
+//every queued frame is processed; the acquisition thread must be gone
+void pipeline_stop(pipeline_t* pipe) {
+    for (int i=0;i<pipe->num_stages;i++) {
+        pipe_stage_t* stage = &pipe->stages[i];
+
+        __atomic_store_n(&stage->running, false, __ATOMIC_RELEASE);
+        sem_post(&stage->input.items);
+        pthread_join(stage->thread, NULL);
+        queue_destroy(&stage->input);
+    }
+
+    pipe->num_stages = 0;
+}
@@ -0,0 +1,95 @@
+/*
+    Hantek 2D72 handheld oscillosope tool for linux
+    Copyright (C) 2021 Luca Oliva
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _PIPELINE_H
+#define _PIPELINE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <semaphore.h>
+
+#include "Frame.h"
+
+#define PIPE_QUEUE_SIZE                 64 //power of two
+#define PIPE_MAX_STAGES                 8
+
+enum {
+    PIPE_DROP_OLDEST,                   //a full queue gives up its oldest frame
+    PIPE_BLOCK                          //a full queue holds back its producer
+};
+
+//Bounded queue of frame handles with a single producer. Consumers, and a
+//producer dropping the oldest entry, claim entries by moving tail with a
+//compare and swap, so no lock is taken. The semaphores only put idle
+//threads to sleep and may run ahead of the queue.
+typedef struct {
+        frame_t*        slots[PIPE_QUEUE_SIZE];
+        uint64_t        head;
+        uint64_t        tail;
+        int             policy;
+        sem_t           items;
+        sem_t           space;
+
+        uint64_t        pushed;
+        uint64_t        dropped;
+        int             max_fill;
+} pipe_queue_t;
+
+//Returns false to keep the frame from the next stage
+typedef bool (*pipe_work_t)(frame_t* frame, void* user);
+
+typedef struct pipe_stage {
+        const char*     name;
+        pipe_work_t     work;
+        void*           user;
+        pipe_queue_t    input;
+        struct pipe_stage* next;
+        pthread_t       thread;
+        bool            running;
+
+        uint64_t        processed;
+        int64_t         busy_us;
+} pipe_stage_t;
+
+typedef struct {
+        const char*     name;
+        int             fill;
+        int             max_fill;
+        uint64_t        pushed;
+        uint64_t        dropped;
+        uint64_t        processed;
+        double          busy;           //fraction of the time spent working
+} pipe_stats_t;
+
+//Stages run one thread each, in the order they were added; a frame leaves
+//a stage into the input queue of the next one
+typedef struct {
+        pipe_stage_t    stages[PIPE_MAX_STAGES];
+        int             num_stages;
+        int64_t         start_us;
+} pipeline_t;
+
+void pipeline_init(pipeline_t* pipe);
+int  pipeline_add(pipeline_t* pipe, const char* name, pipe_work_t work, void* user, int policy);
+int  pipeline_start(pipeline_t* pipe);
+bool pipeline_push(pipeline_t* pipe, frame_t* frame);
+void pipeline_stats(pipeline_t* pipe, int stage, pipe_stats_t* stats);
+void pipeline_stop(pipeline_t* pipe);
+
+#endif //_PIPELINE_H
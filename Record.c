@@ -0,0 +1,241 @@
+/*
+    Hantek 2D72 handheld oscillosope tool for linux
+    Copyright (C) 2021 Luca Oliva
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Record.h"
+
+#define RECORD_MIN_CAPACITY             65536
+
+void record_init(record_t* record) {
+    memset(record, 0, sizeof(*record));
+}
+
+void record_free(record_t* record) {
+    for (int ch=0;ch<2;ch++) {
+        free(record->samples[ch]);
+        free(record->sums[ch]);
+        free(record->squares[ch]);
+        for (int k=1;k<RECORD_MAX_LEVELS;k++)
+            free(record->levels[ch][k]);
+    }
+    record_init(record);
+}
+
+void record_clear(record_t* record) {
+    record->length = 0;
+    record->generation++;
+    record->full = false;
+}
+
+static int record_reserve(record_t* record, size_t length) {
+    size_t capacity = record->capacity ? record->capacity : RECORD_MIN_CAPACITY;
+
+    if ( length <= record->capacity )
+        return 0;
+    if ( length > RECORD_MAX_SAMPLES )
+        return -1;
+
+    while ( capacity < length )
+        capacity *= 2;
+    if ( capacity > RECORD_MAX_SAMPLES )
+        capacity = RECORD_MAX_SAMPLES;
+
+    for (int ch=0;ch<2;ch++) {
+        uint8_t* samples = realloc(record->samples[ch], capacity);
+        if ( samples == NULL )
+            return -1;
+        record->samples[ch] = samples;
+
+        for (int s=0;s<2;s++) {
+            uint64_t** prefix = s ? &record->squares[ch] : &record->sums[ch];
+            uint64_t* sums = realloc(*prefix, (capacity/RECORD_SUM_BLOCK+1)*sizeof(uint64_t));
+            if ( sums == NULL )
+                return -1;
+            *prefix = sums;
+        }
+
+        //Level k only keeps complete buckets, so capacity>>k entries are enough
+        for (int k=1;k<RECORD_MAX_LEVELS && (capacity >> k) > 0;k++) {
+            record_span_t* level = realloc(record->levels[ch][k], (capacity >> k)*sizeof(record_span_t));
+            if ( level == NULL )
+                return -1;
+            record->levels[ch][k] = level;
+        }
+    }
+
+    record->capacity = capacity;
+    return 0;
+}
+
+static inline record_span_t record_bucket(const record_t* record, int ch, int k, size_t idx) {
+    if ( k == 0 ) {
+        uint8_t val = record->samples[ch][idx];
+        return (record_span_t){ val, val };
+    }
+    return record->levels[ch][k][idx];
+}
+
+static inline void record_merge(record_span_t* span, record_span_t other) {
+    if ( other.min < span->min ) span->min = other.min;
+    if ( other.max > span->max ) span->max = other.max;
+}
+
+//Only the buckets and blocks completed by the new samples are computed, so
+//the cost of building the indexes is proportional to the appended data.
+static void record_update(record_t* record, int ch, size_t old_length, size_t new_length) {
+    const uint8_t* samples = record->samples[ch];
+
+    record->sums[ch][0]    = 0;
+    record->squares[ch][0] = 0;
+    for (size_t b=old_length/RECORD_SUM_BLOCK+1;b<=new_length/RECORD_SUM_BLOCK;b++) {
+        uint64_t sum = 0, squares = 0;
+
+        for (size_t i=(b-1)*RECORD_SUM_BLOCK;i<b*RECORD_SUM_BLOCK;i++) {
+            sum     += samples[i];
+            squares += samples[i]*samples[i];
+        }
+        record->sums[ch][b]    = record->sums[ch][b-1]+sum;
+        record->squares[ch][b] = record->squares[ch][b-1]+squares;
+    }
+
+    for (int k=1;k<RECORD_MAX_LEVELS && (new_length >> k) > 0;k++) {
+        record_span_t* level = record->levels[ch][k];
+
+        for (size_t b=old_length >> k;b<(new_length >> k);b++) {
+            record_span_t span = record_bucket(record, ch, k-1, 2*b);
+            record_merge(&span, record_bucket(record, ch, k-1, 2*b+1));
+            level[b] = span;
+        }
+    }
+}
+
+int record_append(record_t* record, const uint8_t* frame, size_t num_samples, int num_channels, const bool enable[2]) {
+    size_t old_length = record->length;
+
+    if ( num_channels < 1 )
+        return 0;
+    if ( record->full )
+        return -1;
+
+    if ( record_reserve(record, old_length+num_samples) ) {
+        fprintf(stderr, "Record full at %zu samples, further captures are not appended.\n", old_length);
+        record->full = true;
+        return -1;
+    }
+
+    for (int ch=0;ch<2;ch++) {
+        uint8_t* dst = record->samples[ch]+old_length;
+        int slot = (ch == 1 && enable[0]) ? 1 : 0;
+
+        if ( enable[ch] ) {
+            for (size_t i=0;i<num_samples;i++)
+                dst[i] = frame[i*num_channels+slot];
+        } else {
+            memset(dst, 0, num_samples);
+        }
+
+        record_update(record, ch, old_length, old_length+num_samples);
+    }
+
+    record->length = old_length+num_samples;
+    return 0;
+}
+
+//Min/max over [first, last), walking the largest aligned buckets available:
+//at most two buckets per level are touched.
+record_span_t record_range(const record_t* record, int ch, size_t first, size_t last) {
+    record_span_t span = { 0xFF, 0x00 };
+
+    if ( last > record->length )
+        last = record->length;
+
+    while ( first < last ) {
+        int k = 0;
+
+        while ( k+1 < RECORD_MAX_LEVELS &&
+                (first & (((size_t)2 << k)-1)) == 0 &&
+                first + ((size_t)2 << k) <= last )
+            k++;
+
+        record_merge(&span, record_bucket(record, ch, k, first >> k));
+        first += (size_t)1 << k;
+    }
+
+    return span;
+}
+
+//Column c covers samples [first+c*step, first+(c+1)*step). Empty columns
+//(outside the record) are returned with min > max.
+void record_query(const record_t* record, int ch, double first, double step, int num_cols, record_span_t* out) {
+    for (int c=0;c<num_cols;c++) {
+        double start = first + c*step;
+        double end   = start + step;
+        size_t s0, s1;
+
+        if ( end <= 0 || start >= record->length ) {
+            out[c] = (record_span_t){ 0xFF, 0x00 };
+            continue;
+        }
+
+        s0 = start < 0 ? 0 : (size_t)start;
+        s1 = (size_t)end;
+        if ( s1 <= s0 )
+            s1 = s0+1;
+
+        out[c] = record_range(record, ch, s0, s1);
+    }
+}
+
+//Sum and sum of squares of the samples before index, from the block prefix
+//and at most RECORD_SUM_BLOCK-1 samples
+static void record_prefix(const record_t* record, int ch, size_t index, uint64_t* sum, uint64_t* squares) {
+    size_t b = index/RECORD_SUM_BLOCK;
+
+    *sum     = record->sums[ch][b];
+    *squares = record->squares[ch][b];
+    for (size_t i=b*RECORD_SUM_BLOCK;i<index;i++) {
+        *sum     += record->samples[ch][i];
+        *squares += record->samples[ch][i]*record->samples[ch][i];
+    }
+}
+
+//Constant work for the sums; min/max walks the pyramid, which grows with
+//the log of last-first
+void record_stats(const record_t* record, int ch, size_t first, size_t last, record_stats_t* out) {
+    uint64_t sum0, squares0, sum1, squares1;
+    record_span_t span;
+
+    memset(out, 0, sizeof(*out));
+    if ( last > record->length )
+        last = record->length;
+    if ( first >= last )
+        return;
+
+    record_prefix(record, ch, first, &sum0, &squares0);
+    record_prefix(record, ch, last, &sum1, &squares1);
+    span = record_range(record, ch, first, last);
+
+    out->count   = last-first;
+    out->sum     = sum1-sum0;
+    out->squares = squares1-squares0;
+    out->min     = span.min;
+    out->max     = span.max;
+}
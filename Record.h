@@ -0,0 +1,68 @@
+/*
+    Hantek 2D72 handheld oscillosope tool for linux
+    Copyright (C) 2021 Luca Oliva
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _RECORD_H
+#define _RECORD_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define RECORD_MAX_SAMPLES              (16*1024*1024)
+#define RECORD_MAX_LEVELS               32
+#define RECORD_SUM_BLOCK                16
+
+typedef struct {
+        uint8_t min;
+        uint8_t max;
+} record_span_t;
+
+//Sums over [first, last) of a channel, in raw codes
+typedef struct {
+        size_t          count;
+        uint64_t        sum;
+        uint64_t        squares;
+        uint8_t         min;
+        uint8_t         max;
+} record_stats_t;
+
+//Long record built by stitching captures, with a min/max pyramid per channel.
+//Level k holds one span every 2^k samples, level 0 is the raw samples.
+//sums[ch][b] and squares[ch][b] add up the samples before b*RECORD_SUM_BLOCK.
+typedef struct {
+        uint8_t*        samples[2];
+        record_span_t*  levels[2][RECORD_MAX_LEVELS];
+        uint64_t*       sums[2];
+        uint64_t*       squares[2];
+        size_t          length;
+        size_t          capacity;
+        unsigned int    generation;     //bumped whenever old samples go away
+        bool            full;           //hit the size limit, appends are refused until cleared
+} record_t;
+
+void   record_init(record_t* record);
+void   record_free(record_t* record);
+void   record_clear(record_t* record);
+
+int    record_append(record_t* record, const uint8_t* frame, size_t num_samples, int num_channels, const bool enable[2]);
+
+record_span_t record_range(const record_t* record, int ch, size_t first, size_t last);
+void   record_query(const record_t* record, int ch, double first, double step, int num_cols, record_span_t* out);
+void   record_stats(const record_t* record, int ch, size_t first, size_t last, record_stats_t* out);
+
+#endif //_RECORD_H
@@ -0,0 +1,89 @@
+/*
+    Hantek 2D72 handheld oscillosope tool for linux
+    Copyright (C) 2021 Luca Oliva
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "Roll.h"
+
+void roll_init(roll_t* roll, int num_channels, int samples_per_column) {
+    pthread_mutex_init(&roll->lock, NULL);
+    roll->num_channels       = num_channels;
+    roll->samples_per_column = samples_per_column > 0 ? samples_per_column : 1;
+    roll->slot               = 0;
+    roll->fill               = 0;
+    roll->started            = false;
+    roll->head               = 0;
+}
+
+//Packets need not end on a sample boundary
+void roll_push(roll_t* roll, const uint8_t* data, size_t length) {
+    roll_column_t* open = &roll->open;
+
+    pthread_mutex_lock(&roll->lock);
+    for (size_t i=0;i<length;i++) {
+        int slot = roll->slot;
+        uint8_t v = data[i];
+
+        if ( roll->fill == 0 && slot == 0 ) {
+            for (int k=0;k<roll->num_channels;k++) {
+                open->min[k] = roll->started ? roll->last[k] : 255;
+                open->max[k] = roll->started ? roll->last[k] : 0;
+            }
+        }
+
+        if ( v < open->min[slot] )
+            open->min[slot] = v;
+        if ( v > open->max[slot] )
+            open->max[slot] = v;
+        roll->last[slot] = v;
+
+        if ( ++roll->slot < roll->num_channels )
+            continue;
+        roll->slot = 0;
+
+        if ( ++roll->fill == roll->samples_per_column ) {
+            roll->columns[roll->head % ROLL_COLUMNS] = *open;
+            roll->head++;
+            roll->fill    = 0;
+            roll->started = true;
+        }
+    }
+    pthread_mutex_unlock(&roll->lock);
+}
+
+//Copies the columns finished since position, at most max of the newest
+size_t roll_read(roll_t* roll, uint64_t* position, roll_column_t* out, size_t max) {
+    uint64_t from;
+    size_t count = 0;
+
+    pthread_mutex_lock(&roll->lock);
+    from = *position;
+    if ( roll->head-from > ROLL_COLUMNS )
+        from = roll->head-ROLL_COLUMNS;
+    if ( roll->head-from > max )
+        from = roll->head-max;
+
+    for (;from<roll->head;from++)
+        out[count++] = roll->columns[from % ROLL_COLUMNS];
+    *position = roll->head;
+    pthread_mutex_unlock(&roll->lock);
+
+    return count;
+}
+
+void roll_free(roll_t* roll) {
+    pthread_mutex_destroy(&roll->lock);
+}
@@ -0,0 +1,55 @@
+/*
+    Hantek 2D72 handheld oscillosope tool for linux
+    Copyright (C) 2021 Luca Oliva
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _ROLL_H
+#define _ROLL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <pthread.h>
+
+#define ROLL_COLUMNS                    4096
+
+//Range of each slot over one screen column, joined to the column before
+typedef struct {
+        uint8_t         min[2];
+        uint8_t         max[2];
+} roll_column_t;
+
+//Interleaved samples come in packet by packet and leave as finished
+//columns; a reader more than ROLL_COLUMNS behind loses the oldest ones
+typedef struct {
+        pthread_mutex_t lock;
+        int             num_channels;
+        int             samples_per_column;
+        int             slot;           //slot of the next byte
+        int             fill;           //samples in the open column
+        bool            started;
+        uint8_t         last[2];
+        roll_column_t   open;
+        uint64_t        head;
+        roll_column_t   columns[ROLL_COLUMNS];
+} roll_t;
+
+void   roll_init(roll_t* roll, int num_channels, int samples_per_column);
+void   roll_push(roll_t* roll, const uint8_t* data, size_t length);
+size_t roll_read(roll_t* roll, uint64_t* position, roll_column_t* out, size_t max);
+void   roll_free(roll_t* roll);
+
+#endif //_ROLL_H
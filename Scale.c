@@ -0,0 +1,45 @@
+/*
+    Hantek 2D72 handheld oscillosope tool for linux
+    Copyright (C) 2021 Luca Oliva
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <math.h>
+
+#include "Scale.h"
+
+//Same 1-2-5 sequences as liststore_time and liststore_1x in Hantek.glade
+static const double scale_mantissa[3] = { 1, 2, 5 };
+
+double scale_time_per_div(int time_scale) {
+    if ( time_scale < 0 ) time_scale = 0;
+    if ( time_scale >= SCALE_NUM_TIME ) time_scale = SCALE_NUM_TIME-1;
+
+    //Index 0 is 5ns
+    time_scale += 2;
+    return scale_mantissa[time_scale % 3]*pow(10, time_scale/3 - 9);
+}
+
+double scale_sample_rate(int time_scale) {
+    return SCALE_SAMPLES_PER_DIV/scale_time_per_div(time_scale);
+}
+
+double scale_volts_per_div(int probe, int scale) {
+    if ( scale < 0 ) scale = 0;
+    if ( scale >= SCALE_NUM_VOLT ) scale = SCALE_NUM_VOLT-1;
+
+    //Index 0 is 10mV with a 1X probe, every probe step is a factor 10
+    return scale_mantissa[scale % 3]*pow(10, scale/3 - 2 + probe);
+}
@@ -0,0 +1,41 @@
+/*
+    Hantek 2D72 handheld oscillosope tool for linux
+    Copyright (C) 2021 Luca Oliva
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _SCALE_H
+#define _SCALE_H
+
+#include <stdint.h>
+
+//Screen geometry of a capture: 100 samples per horizontal division,
+//8 vertical divisions mapped on raw codes 29..231
+#define SCALE_SAMPLES_PER_DIV           100
+#define SCALE_NUM_TIME                  34
+#define SCALE_NUM_VOLT                  10
+#define SCALE_RAW_BOTTOM                29
+#define SCALE_RAW_CENTER                130
+#define SCALE_RAW_PER_DIV               25.25
+
+double scale_time_per_div(int time_scale);
+double scale_sample_rate(int time_scale);
+double scale_volts_per_div(int probe, int scale);
+
+static inline double scale_raw_to_volts(uint8_t raw, double volts_per_div, double offset) {
+    return (raw-SCALE_RAW_CENTER)*volts_per_div/SCALE_RAW_PER_DIV - offset;
+}
+
+#endif //_SCALE_H
@@ -0,0 +1,88 @@
+/*
+    Hantek 2D72 handheld oscillosope tool for linux
+    Copyright (C) 2021 Luca Oliva
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "Segment.h"
+
+int segment_table_alloc(segment_table_t* table, int capacity, int num_samples, int num_channels) {
+    size_t size = (size_t)capacity*num_samples*num_channels;
+
+    //Keep the old table when the shape is unchanged
+    if ( table->data && table->capacity == capacity &&
+         table->num_samples == num_samples && table->num_channels == num_channels ) {
+        table->count = 0;
+        return 0;
+    }
+
+    segment_table_free(table);
+
+    table->data = malloc(size);
+    table->info = calloc(capacity, sizeof(segment_info_t));
+    if ( table->data == NULL || table->info == NULL ) {
+        segment_table_free(table);
+        return -1;
+    }
+
+    table->capacity     = capacity;
+    table->num_samples  = num_samples;
+    table->num_channels = num_channels;
+    table->count        = 0;
+    return 0;
+}
+
+void segment_table_free(segment_table_t* table) {
+    free(table->data);
+    free(table->info);
+    memset(table, 0, sizeof(*table));
+}
+
+//Dead time of a segment is its readout plus the re-arm that follows: a
+//trigger in that window is lost.
+void segment_stats(const segment_table_t* table, segment_stats_t* stats) {
+    double readout = 0, rearm = 0;
+
+    memset(stats, 0, sizeof(*stats));
+    stats->count = table->count;
+    if ( table->count == 0 )
+        return;
+
+    for (int i=0;i<table->count;i++) {
+        const segment_info_t* info = &table->info[i];
+        double dead = (double)info->readout_us + info->rearm_us;
+
+        readout += info->readout_us;
+        rearm   += info->rearm_us;
+        if ( dead > stats->dead_max_us )
+            stats->dead_max_us = dead;
+    }
+
+    stats->readout_mean_us = readout/table->count;
+    stats->rearm_mean_us   = rearm/table->count;
+    stats->dead_mean_us    = (readout+rearm)/table->count;
+
+    if ( table->count > 1 ) {
+        const segment_info_t* last = &table->info[table->count-1];
+        double span = last->time_us + last->readout_us + last->rearm_us - table->info[0].time_us;
+
+        stats->duration      = (last->time_us - table->info[0].time_us)/1e6;
+        stats->rate          = stats->duration > 0 ? (table->count-1)/stats->duration : 0;
+        stats->dead_fraction = span > 0 ? (readout+rearm)/span : 0;
+    }
+}
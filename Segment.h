@@ -0,0 +1,65 @@
+/*
+    Hantek 2D72 handheld oscillosope tool for linux
+    Copyright (C) 2021 Luca Oliva
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _SEGMENT_H
+#define _SEGMENT_H
+
+#include <stdint.h>
+
+#include "Config.h"
+
+#define SEGMENT_MAX_COUNT               10000
+
+//Host side timing of one segment, all in microseconds
+typedef struct {
+        int64_t         time_us;        //first packet of the segment arrived
+        uint32_t        readout_us;     //first to last packet
+        uint32_t        rearm_us;       //last packet to scope armed again
+} segment_info_t;
+
+//Preallocated so that nothing is allocated between a read and the re-arm
+typedef struct {
+        uint8_t*        data;
+        segment_info_t* info;
+        int             capacity;
+        int             num_samples;
+        int             num_channels;
+        int             count;
+        config_t        config;         //settings the segments were taken with
+} segment_table_t;
+
+typedef struct {
+        int             count;
+        double          duration;       //seconds from first to last segment
+        double          rate;           //segments per second
+        double          readout_mean_us;
+        double          rearm_mean_us;
+        double          dead_mean_us;
+        double          dead_max_us;
+        double          dead_fraction;  //share of the run the scope was not armed
+} segment_stats_t;
+
+int  segment_table_alloc(segment_table_t* table, int capacity, int num_samples, int num_channels);
+void segment_table_free(segment_table_t* table);
+void segment_stats(const segment_table_t* table, segment_stats_t* stats);
+
+static inline uint8_t* segment_data(const segment_table_t* table, int index) {
+    return table->data + (size_t)index*table->num_samples*table->num_channels;
+}
+
+#endif //_SEGMENT_H
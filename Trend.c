@@ -0,0 +1,292 @@
+/*
+    Hantek 2D72 handheld oscillosope tool for linux
+    Copyright (C) 2021 Luca Oliva
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "Trend.h"
+#include "Autoset.h"
+#include "Scale.h"
+
+static const int64_t trend_bucket_us[TREND_LEVELS] = TREND_BUCKETS_US;
+static const char* trend_suffix[TREND_LEVELS] = TREND_SUFFIXES;
+
+static void bucket_reset(trend_bucket_t* bucket, int64_t start) {
+    memset(bucket, 0, sizeof(*bucket));
+    bucket->point.time_us = start;
+    bucket->record = -1;
+}
+
+static void bucket_add(trend_bucket_t* bucket, const float values[TREND_VALUES]) {
+    trend_point_t* point = &bucket->point;
+
+    point->count++;
+    for (int v=0;v<TREND_VALUES;v++) {
+        if ( isnan(values[v]) )
+            continue;
+        if ( bucket->count[v] == 0 || values[v] < point->min[v] )
+            point->min[v] = values[v];
+        if ( bucket->count[v] == 0 || values[v] > point->max[v] )
+            point->max[v] = values[v];
+        bucket->sum[v] += values[v];
+        bucket->count[v]++;
+    }
+}
+
+static void bucket_point(const trend_bucket_t* bucket, trend_point_t* point) {
+    *point = bucket->point;
+    for (int v=0;v<TREND_VALUES;v++) {
+        if ( bucket->count[v] ) {
+            point->mean[v] = bucket->sum[v]/bucket->count[v];
+        } else {
+            point->min[v]  = NAN;
+            point->max[v]  = NAN;
+            point->mean[v] = NAN;
+        }
+    }
+}
+
+static int64_t trend_records(trend_t* trend, int level) {
+    struct stat st;
+
+    if ( fstat(trend->fd[level], &st) )
+        return 0;
+    return st.st_size/sizeof(trend_point_t);
+}
+
+//Appends the bucket, or rewrites it where it already is on disk
+static int trend_write(trend_t* trend, int level, trend_bucket_t* bucket) {
+    trend_point_t point;
+
+    if ( bucket->record < 0 )
+        bucket->record = trend_records(trend, level);
+
+    bucket_point(bucket, &point);
+    if ( pwrite(trend->fd[level], &point, sizeof(point), bucket->record*sizeof(trend_point_t)) != sizeof(point) ) {
+        perror("trend");
+        return -1;
+    }
+    return 0;
+}
+
+//Takes the last record of a level back as its open bucket, so that points
+//landing in the same bucket after a reopen update it instead of adding a
+//second one. Per value counts are not stored; a value is taken as present
+//in every point of the bucket if it has a mean at all.
+static void trend_load(trend_t* trend, int level) {
+    trend_bucket_t* bucket = &trend->open[level];
+    int64_t records = trend_records(trend, level);
+
+    bucket_reset(bucket, 0);
+    if ( records == 0 || pread(trend->fd[level], &bucket->point, sizeof(trend_point_t),
+                               (records-1)*sizeof(trend_point_t)) != sizeof(trend_point_t) ) {
+        bucket_reset(bucket, 0);
+        return;
+    }
+
+    for (int v=0;v<TREND_VALUES;v++) {
+        if ( isnan(bucket->point.mean[v]) || bucket->point.count == 0 )
+            continue;
+        bucket->count[v] = bucket->point.count;
+        bucket->sum[v]   = (double)bucket->point.mean[v]*bucket->point.count;
+    }
+    bucket->record = records-1;
+}
+
+static int64_t trend_time(trend_t* trend, int level, int64_t index) {
+    int64_t time_us = 0;
+
+    if ( pread(trend->fd[level], &time_us, sizeof(time_us), index*sizeof(trend_point_t)) != sizeof(time_us) )
+        return INT64_MAX;
+    return time_us;
+}
+
+//First record at or after time_us; records are appended in time order
+static int64_t trend_search(trend_t* trend, int level, int64_t count, int64_t time_us) {
+    int64_t lo = 0, hi = count;
+
+    while ( lo < hi ) {
+        int64_t mid = lo+(hi-lo)/2;
+        if ( trend_time(trend, level, mid) < time_us )
+            lo = mid+1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+void trend_init(trend_t* trend) {
+    memset(trend, 0, sizeof(*trend));
+    pthread_mutex_init(&trend->lock, NULL);
+    for (int l=0;l<TREND_LEVELS;l++) {
+        trend->fd[l] = -1;
+        bucket_reset(&trend->open[l], 0);
+    }
+}
+
+//One file per level next to path, appended to if it exists. A record cut
+//short by a crash is dropped, the last whole one of each coarser level is
+//taken back as its open bucket.
+int trend_open(trend_t* trend, const char* path) {
+    char name[4096];
+
+    trend_close(trend);
+
+    pthread_mutex_lock(&trend->lock);
+    for (int l=0;l<TREND_LEVELS;l++) {
+        struct stat st;
+
+        snprintf(name, sizeof(name), "%s%s", path, trend_suffix[l]);
+        trend->fd[l] = open(name, O_RDWR | O_CREAT, 0644);
+        if ( trend->fd[l] < 0 ) {
+            perror(name);
+            pthread_mutex_unlock(&trend->lock);
+            trend_close(trend);
+            return -1;
+        }
+        if ( fstat(trend->fd[l], &st) == 0 && st.st_size % sizeof(trend_point_t) )
+            if ( ftruncate(trend->fd[l], st.st_size - st.st_size % sizeof(trend_point_t)) )
+                perror(name);
+        if ( l > 0 )
+            trend_load(trend, l);
+        else
+            bucket_reset(&trend->open[l], 0);
+    }
+    trend->points = 0;
+    pthread_mutex_unlock(&trend->lock);
+
+    return 0;
+}
+
+void trend_measure(const uint8_t* data, int num_samples, int num_channels, int slot,
+                   double volts_per_div, double offset, double sample_rate, float values[3]) {
+    autoset_meas_t meas;
+    uint64_t sum = 0;
+
+    if ( num_samples <= 0 ) {
+        values[TREND_VPP] = values[TREND_FREQUENCY] = values[TREND_MEAN] = NAN;
+        return;
+    }
+
+    autoset_measure(data, num_samples, num_channels, slot, &meas);
+    for (int i=0;i<num_samples;i++)
+        sum += data[i*num_channels+slot];
+
+    values[TREND_VPP]       = (meas.max-meas.min)*volts_per_div/SCALE_RAW_PER_DIV;
+    values[TREND_FREQUENCY] = meas.period > 0 ? sample_rate/meas.period : NAN;
+    values[TREND_MEAN]      = ((double)sum/num_samples-SCALE_RAW_CENTER)*volts_per_div/SCALE_RAW_PER_DIV - offset;
+}
+
+//Level 0 gets the point itself, every other level folds it into its open
+//bucket and writes that out once a point lands in a later one
+int trend_append(trend_t* trend, int64_t time_us, const float values[TREND_VALUES]) {
+    trend_bucket_t single;
+    int status = 0;
+
+    pthread_mutex_lock(&trend->lock);
+    if ( trend->fd[0] < 0 ) {
+        pthread_mutex_unlock(&trend->lock);
+        return -1;
+    }
+
+    bucket_reset(&single, time_us);
+    bucket_add(&single, values);
+    status |= trend_write(trend, 0, &single);
+
+    for (int l=1;l<TREND_LEVELS;l++) {
+        trend_bucket_t* bucket = &trend->open[l];
+        int64_t start = time_us - time_us % trend_bucket_us[l];
+
+        if ( bucket->point.count && bucket->point.time_us != start )
+            status |= trend_write(trend, l, bucket);
+        if ( bucket->point.count == 0 || bucket->point.time_us != start )
+            bucket_reset(bucket, start);
+        bucket_add(bucket, values);
+    }
+    trend->points++;
+    pthread_mutex_unlock(&trend->lock);
+
+    return status;
+}
+
+//Points of the finest level that has at most max of them between from_us
+//and to_us, its open bucket included. The coarsest level is thinned out
+//if even it has too many.
+size_t trend_query(trend_t* trend, int64_t from_us, int64_t to_us, size_t max, trend_point_t* out, int* level) {
+    size_t count = 0;
+
+    pthread_mutex_lock(&trend->lock);
+    if ( trend->fd[0] < 0 || max == 0 ) {
+        pthread_mutex_unlock(&trend->lock);
+        return 0;
+    }
+
+    for (int l=0;l<TREND_LEVELS;l++) {
+        trend_bucket_t* bucket = &trend->open[l];
+        int64_t records = l && bucket->record >= 0 ? bucket->record : trend_records(trend, l); //the open bucket is added below
+        int64_t since = l ? from_us-trend_bucket_us[l]+1 : from_us; //buckets reaching into the range
+        int64_t first = trend_search(trend, l, records, since);
+        int64_t last  = trend_search(trend, l, records, to_us+1);
+        bool open = l > 0 && bucket->point.count && bucket->point.time_us >= since && bucket->point.time_us <= to_us;
+        int64_t stride = 1;
+
+        if ( (size_t)(last-first)+open > max && l < TREND_LEVELS-1 )
+            continue;
+
+        if ( (size_t)(last-first)+open > max )
+            stride = (last-first+max-1)/max;
+
+        if ( stride == 1 ) {
+            ssize_t length = (last-first)*sizeof(trend_point_t);
+            if ( length > 0 && pread(trend->fd[l], out, length, first*sizeof(trend_point_t)) == length )
+                count = last-first;
+        } else {
+            for (int64_t i=first;i<last && count<max;i+=stride)
+                if ( pread(trend->fd[l], &out[count], sizeof(trend_point_t), i*sizeof(trend_point_t)) == sizeof(trend_point_t) )
+                    count++;
+        }
+
+        if ( open && count < max )
+            bucket_point(bucket, &out[count++]);
+
+        *level = l;
+        break;
+    }
+    pthread_mutex_unlock(&trend->lock);
+
+    return count;
+}
+
+//Writes out the open buckets, so a run cut short still has its last minute
+//and hour
+void trend_close(trend_t* trend) {
+    pthread_mutex_lock(&trend->lock);
+    for (int l=0;l<TREND_LEVELS;l++) {
+        if ( trend->fd[l] < 0 )
+            continue;
+        if ( l > 0 && trend->open[l].point.count )
+            trend_write(trend, l, &trend->open[l]);
+        close(trend->fd[l]);
+        trend->fd[l] = -1;
+    }
+    pthread_mutex_unlock(&trend->lock);
+}
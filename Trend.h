@@ -0,0 +1,70 @@
+/*
+    Hantek 2D72 handheld oscillosope tool for linux
+    Copyright (C) 2021 Luca Oliva
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _TREND_H
+#define _TREND_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <pthread.h>
+
+//Level 0 keeps every frame, the others one point per bucket
+#define TREND_LEVELS                    4
+#define TREND_BUCKETS_US                { 0, 1000000LL, 60000000LL, 3600000000LL }
+#define TREND_SUFFIXES                  { ".raw", ".1s", ".1m", ".1h" }
+
+//Vpp, frequency and mean of each channel; NAN when not measured
+#define TREND_VALUES                    6
+#define TREND_VPP                       0
+#define TREND_FREQUENCY                 1
+#define TREND_MEAN                      2
+
+//One record of a level file, a single frame on level 0
+typedef struct {
+        int64_t         time_us;        //bucket start, wall clock
+        uint32_t        count;
+        uint32_t        reserved;
+        float           min[TREND_VALUES];
+        float           max[TREND_VALUES];
+        float           mean[TREND_VALUES];
+} trend_point_t;
+
+typedef struct {
+        trend_point_t   point;
+        double          sum[TREND_VALUES];
+        uint32_t        count[TREND_VALUES];
+        int64_t         record;         //index in the level file once written, -1 before
+} trend_bucket_t;
+
+typedef struct {
+        pthread_mutex_t lock;
+        int             fd[TREND_LEVELS];
+        trend_bucket_t  open[TREND_LEVELS];
+        uint64_t        points;
+} trend_t;
+
+void   trend_init(trend_t* trend);
+int    trend_open(trend_t* trend, const char* path);
+void   trend_measure(const uint8_t* data, int num_samples, int num_channels, int slot,
+                     double volts_per_div, double offset, double sample_rate, float values[3]);
+int    trend_append(trend_t* trend, int64_t time_us, const float values[TREND_VALUES]);
+size_t trend_query(trend_t* trend, int64_t from_us, int64_t to_us, size_t max, trend_point_t* out, int* level);
+void   trend_close(trend_t* trend);
+
+#endif //_TREND_H
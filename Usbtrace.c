@@ -0,0 +1,138 @@
+/*
+    Hantek 2D72 handheld oscillosope tool for linux
+    Copyright (C) 2021 Luca Oliva
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+#include <time.h>
+#include <inttypes.h>
+
+#include "Usbtrace.h"
+
+#define USBTRACE_IN                     0x80
+
+static int64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec*1000000 + ts.tv_nsec/1000;
+}
+
+int usbtrace_open(usbtrace_t* trace, const char* path, int mode, bool fast) {
+    char magic[sizeof(USBTRACE_MAGIC)-1];
+
+    trace->mode       = USBTRACE_OFF;
+    trace->fast       = fast;
+    trace->transfers  = 0;
+    trace->mismatches = 0;
+
+    trace->file = fopen(path, mode == USBTRACE_RECORD ? "wb" : "rb");
+    if ( trace->file == NULL ) {
+        perror(path);
+        return -1;
+    }
+
+    if ( mode == USBTRACE_RECORD ) {
+        setvbuf(trace->file, NULL, _IOFBF, 1 << 20);
+        fwrite(USBTRACE_MAGIC, 1, sizeof(magic), trace->file);
+    } else if ( fread(magic, 1, sizeof(magic), trace->file) != sizeof(magic) || memcmp(magic, USBTRACE_MAGIC, sizeof(magic)) ) {
+        fprintf(stderr, "%s: not a USB trace\n", path);
+        fclose(trace->file);
+        trace->file = NULL;
+        return -1;
+    }
+
+    pthread_mutex_init(&trace->lock, NULL);
+    trace->start_us = now_us();
+    trace->mode     = mode;
+
+    return 0;
+}
+
+//length is what was sent for OUT, what arrived for IN
+void usbtrace_record(usbtrace_t* trace, uint8_t endpoint, const void* data, int length, int result) {
+    usbtrace_record_t record;
+
+    record.time_us  = now_us()-trace->start_us;
+    record.length   = length > 0 ? length : 0;
+    record.result   = result;
+    record.endpoint = endpoint;
+    record.reserved = 0;
+
+    pthread_mutex_lock(&trace->lock);
+    if ( fwrite(&record, sizeof(record), 1, trace->file) != 1 ||
+         fwrite(data, 1, record.length, trace->file) != record.length )
+        perror("usbtrace");
+    trace->transfers++;
+    pthread_mutex_unlock(&trace->lock);
+}
+
+//Serves the next recorded transfer, at the time it happened unless fast.
+//An OUT command that differs from the recorded one is only counted; a
+//transfer in the other direction, or the end of the trace, is an error.
+int usbtrace_replay(usbtrace_t* trace, uint8_t endpoint, void* data, int length, int* actual, int* result) {
+    usbtrace_record_t record;
+    int status = 0;
+
+    pthread_mutex_lock(&trace->lock);
+
+    if ( fread(&record, sizeof(record), 1, trace->file) != 1 || record.length > USBTRACE_MAX_PAYLOAD ||
+         fread(trace->payload, 1, record.length, trace->file) != record.length ) {
+        pthread_mutex_unlock(&trace->lock);
+        return -1;
+    }
+
+    if ( (record.endpoint & USBTRACE_IN) != (endpoint & USBTRACE_IN) ) {
+        fprintf(stderr, "[%" PRIu64 "] Replay diverged: endpoint %02x, trace has %02x.\n",
+                trace->transfers, endpoint, record.endpoint);
+        trace->mismatches++;
+        status = -1;
+    } else if ( endpoint & USBTRACE_IN ) {
+        *actual = record.length < (uint32_t)length ? (int)record.length : length;
+        memcpy(data, trace->payload, *actual);
+        *result = record.result;
+    } else {
+        if ( record.length != (uint32_t)length || memcmp(data, trace->payload, length) )
+            trace->mismatches++;
+        *actual = length;
+        *result = record.result;
+    }
+    trace->transfers++;
+
+    if ( !trace->fast && status == 0 ) {
+        int64_t wait = record.time_us-(now_us()-trace->start_us);
+        if ( wait > 0 ) {
+            struct timespec ts = { wait/1000000, (wait%1000000)*1000 };
+            nanosleep(&ts, NULL);
+        }
+    }
+
+    pthread_mutex_unlock(&trace->lock);
+    return status;
+}
+
+void usbtrace_close(usbtrace_t* trace) {
+    if ( trace->file == NULL )
+        return;
+
+    if ( trace->mode == USBTRACE_REPLAY )
+        fprintf(stderr, "Replayed %" PRIu64 " transfers, %" PRIu64 " commands differed.\n", trace->transfers, trace->mismatches);
+    if ( fclose(trace->file) )
+        perror("usbtrace");
+
+    trace->file = NULL;
+    trace->mode = USBTRACE_OFF;
+    pthread_mutex_destroy(&trace->lock);
+}
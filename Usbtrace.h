@@ -0,0 +1,65 @@
+/*
+    Hantek 2D72 handheld oscillosope tool for linux
+    Copyright (C) 2021 Luca Oliva
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _USBTRACE_H
+#define _USBTRACE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <pthread.h>
+
+#define USBTRACE_MAGIC                  "HTKUSB1\n"
+#define USBTRACE_MAX_PAYLOAD            (1 << 16)
+
+enum {
+    USBTRACE_OFF,
+    USBTRACE_RECORD,
+    USBTRACE_REPLAY
+};
+
+//One bulk transfer: the command bytes sent on an OUT endpoint, or the
+//bytes received on an IN endpoint, and what the transfer returned
+typedef struct __attribute__((packed)) {
+        int64_t         time_us;        //since the start of the session
+        uint32_t        length;         //payload bytes that follow
+        int16_t         result;
+        uint8_t         endpoint;
+        uint8_t         reserved;
+} usbtrace_record_t;
+
+//Transfers are recorded and replayed in the order they happened, whatever
+//thread makes them. fast replays without the recorded delays.
+typedef struct {
+        int             mode;
+        bool            fast;
+        FILE*           file;
+        int64_t         start_us;
+        pthread_mutex_t lock;
+
+        uint64_t        transfers;
+        uint64_t        mismatches;
+        uint8_t         payload[USBTRACE_MAX_PAYLOAD];
+} usbtrace_t;
+
+int  usbtrace_open(usbtrace_t* trace, const char* path, int mode, bool fast);
+void usbtrace_record(usbtrace_t* trace, uint8_t endpoint, const void* data, int length, int result);
+int  usbtrace_replay(usbtrace_t* trace, uint8_t endpoint, void* data, int length, int* actual, int* result);
+void usbtrace_close(usbtrace_t* trace);
+
+#endif //_USBTRACE_H
@@ -0,0 +1,241 @@
+/*
+    Hantek 2D72 handheld oscillosope tool for linux
+    Copyright (C) 2021 Luca Oliva
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "Xcorr.h"
+
+static void plan_free(xcorr_plan_t* plan) {
+    free(plan->bitrev);
+    free(plan->twiddle);
+    memset(plan, 0, sizeof(*plan));
+}
+
+static int plan_init(xcorr_plan_t* plan, int n) {
+    int bits = 0;
+
+    plan_free(plan);
+    plan->bitrev  = malloc(n*sizeof(int));
+    plan->twiddle = malloc(n/2*sizeof(double complex));
+    if ( plan->bitrev == NULL || plan->twiddle == NULL ) {
+        plan_free(plan);
+        return -1;
+    }
+
+    while ( (1 << bits) < n )
+        bits++;
+    for (int i=0;i<n;i++) {
+        int r = 0;
+        for (int b=0;b<bits;b++)
+            r |= ((i >> b) & 1) << (bits-1-b);
+        plan->bitrev[i] = r;
+    }
+    for (int k=0;k<n/2;k++)
+        plan->twiddle[k] = cexp(-2*M_PI*I*k/n);
+
+    plan->n = n;
+    return 0;
+}
+
+//In place, iterative; the inverse is left unscaled
+static void fft(const xcorr_plan_t* plan, double complex* data, bool inverse) {
+    int n = plan->n;
+
+    for (int i=0;i<n;i++) {
+        int r = plan->bitrev[i];
+        if ( r > i ) {
+            double complex t = data[i];
+            data[i] = data[r];
+            data[r] = t;
+        }
+    }
+
+    for (int size=2;size<=n;size*=2) {
+        int half = size/2, stride = n/size;
+
+        for (int start=0;start<n;start+=size) {
+            for (int k=0;k<half;k++) {
+                double complex w = plan->twiddle[k*stride];
+                double complex t, u;
+
+                if ( inverse )
+                    w = conj(w);
+                u = data[start+k];
+                t = w*data[start+k+half];
+                data[start+k]      = u+t;
+                data[start+k+half] = u-t;
+            }
+        }
+    }
+}
+
+void xcorr_init(xcorr_t* xcorr) {
+    memset(xcorr, 0, sizeof(*xcorr));
+    pthread_mutex_init(&xcorr->lock, NULL);
+}
+
+void xcorr_free(xcorr_t* xcorr) {
+    plan_free(&xcorr->plan);
+    free(xcorr->work);
+    free(xcorr->sxy);
+    free(xcorr->sxx);
+    free(xcorr->syy);
+    xcorr->work = xcorr->sxy = NULL;
+    xcorr->sxx  = xcorr->syy = NULL;
+    xcorr->num_samples = 0;
+}
+
+//Drops the averaged spectra, for when the signals or the settings change
+void xcorr_reset(xcorr_t* xcorr) {
+    pthread_mutex_lock(&xcorr->lock);
+    memset(&xcorr->result, 0, sizeof(xcorr->result));
+    pthread_mutex_unlock(&xcorr->lock);
+}
+
+static int xcorr_resize(xcorr_t* xcorr, int num_samples) {
+    int n = 1;
+
+    //Zero padded to twice the frame, so the correlation does not wrap
+    while ( n < 2*num_samples )
+        n *= 2;
+
+    xcorr_free(xcorr);
+    if ( plan_init(&xcorr->plan, n) )
+        return -1;
+    xcorr->work = malloc(n*sizeof(double complex));
+    xcorr->sxy  = malloc((n/2+1)*sizeof(double complex));
+    xcorr->sxx  = malloc((n/2+1)*sizeof(double));
+    xcorr->syy  = malloc((n/2+1)*sizeof(double));
+    if ( xcorr->work == NULL || xcorr->sxy == NULL || xcorr->sxx == NULL || xcorr->syy == NULL ) {
+        xcorr_free(xcorr);
+        return -1;
+    }
+
+    xcorr->num_samples   = num_samples;
+    xcorr->result.frames = 0;
+    return 0;
+}
+
+//Both channels go through one complex FFT, CH1 as the real part and CH2 as
+//the imaginary part, and are told apart by symmetry. The cross spectrum
+//gives the correlation back through one inverse FFT; the peak is refined
+//with a parabola through its neighbours. A new sample rate makes the
+//averaged spectra meaningless, so they restart.
+int xcorr_push(xcorr_t* xcorr, const uint8_t* frame, int num_samples, double sample_rate) {
+    double complex* z = xcorr->work;
+    double mean_x = 0, mean_y = 0, energy_x = 0, energy_y = 0;
+    double best = -INFINITY;
+    double alpha;
+    int n, max_lag, peak = 0, strongest = 1;
+
+    if ( num_samples < 4 )
+        return -1;
+
+    pthread_mutex_lock(&xcorr->lock);
+    if ( num_samples != xcorr->num_samples && xcorr_resize(xcorr, num_samples) ) {
+        pthread_mutex_unlock(&xcorr->lock);
+        return -1;
+    }
+    if ( sample_rate != xcorr->result.sample_rate ) {
+        xcorr->result.frames      = 0;
+        xcorr->result.sample_rate = sample_rate;
+    }
+    z = xcorr->work;
+    n = xcorr->plan.n;
+
+    for (int i=0;i<num_samples;i++) {
+        mean_x += frame[2*i];
+        mean_y += frame[2*i+1];
+    }
+    mean_x /= num_samples;
+    mean_y /= num_samples;
+
+    for (int i=0;i<num_samples;i++) {
+        double x = frame[2*i]-mean_x, y = frame[2*i+1]-mean_y;
+        z[i] = x + I*y;
+        energy_x += x*x;
+        energy_y += y*y;
+    }
+    for (int i=num_samples;i<n;i++)
+        z[i] = 0;
+
+    fft(&xcorr->plan, z, false);
+
+    //X[k] = (Z[k]+conj(Z[n-k]))/2, Y[k] = (Z[k]-conj(Z[n-k]))/2i; the cross
+    //spectrum conj(X)Y is Hermitian, so the correlation comes back real
+    alpha = 1.0/(xcorr->result.frames < XCORR_AVERAGE ? xcorr->result.frames+1 : XCORR_AVERAGE);
+    for (int k=0;k<=n/2;k++) {
+        double complex a = z[k], b = conj(z[(n-k) & (n-1)]);
+        double complex x = (a+b)/2, y = (a-b)/(2*I);
+        double complex s = conj(x)*y;
+
+        xcorr->sxy[k] = k && xcorr->result.frames ? (1-alpha)*xcorr->sxy[k] + alpha*s : s;
+        xcorr->sxx[k] = k && xcorr->result.frames ? (1-alpha)*xcorr->sxx[k] + alpha*creal(conj(x)*x) : creal(conj(x)*x);
+        xcorr->syy[k] = k && xcorr->result.frames ? (1-alpha)*xcorr->syy[k] + alpha*creal(conj(y)*y) : creal(conj(y)*y);
+
+        z[k] = s;
+        if ( k && k < n/2 )
+            z[n-k] = conj(s);
+    }
+    fft(&xcorr->plan, z, true);
+
+    //r(lag) sits at z[lag], negative lags wrap to the end; far lags overlap
+    //too little of the frame to count. The search keeps the overlap taper so
+    //a periodic signal locks to its nearest peak, the refinement divides it
+    //out so a broad peak is not pulled toward 0.
+    max_lag = num_samples/2;
+    for (int lag=-max_lag;lag<=max_lag;lag++) {
+        double r = creal(z[lag & (n-1)]);
+        if ( r > best ) {
+            best = r;
+            peak = lag;
+        }
+    }
+
+    xcorr->result.lag = peak;
+    if ( peak > -max_lag && peak < max_lag ) {
+        double r0 = creal(z[(peak-1) & (n-1)])/(num_samples-abs(peak-1));
+        double r1 = creal(z[peak & (n-1)])/(num_samples-abs(peak));
+        double r2 = creal(z[(peak+1) & (n-1)])/(num_samples-abs(peak+1));
+        double d  = r0-2*r1+r2;
+        if ( d < 0 )
+            xcorr->result.lag = peak + 0.5*(r0-r2)/d;
+    }
+    xcorr->result.peak = energy_x > 0 && energy_y > 0 ? best/n/sqrt(energy_x*energy_y) : 0;
+
+    for (int k=2;k<n/2;k++)
+        if ( cabs(xcorr->sxy[k]) > cabs(xcorr->sxy[strongest]) )
+            strongest = k;
+
+    xcorr->result.frames++;
+    xcorr->result.frequency = (double)strongest/n;
+    xcorr->result.phase_deg = carg(xcorr->sxy[strongest])*180/M_PI;
+    xcorr->result.coherence = xcorr->sxx[strongest] > 0 && xcorr->syy[strongest] > 0 ?
+                              pow(cabs(xcorr->sxy[strongest]), 2)/(xcorr->sxx[strongest]*xcorr->syy[strongest]) : 0;
+    pthread_mutex_unlock(&xcorr->lock);
+
+    return 0;
+}
+
+void xcorr_get(xcorr_t* xcorr, xcorr_result_t* result) {
+    pthread_mutex_lock(&xcorr->lock);
+    *result = xcorr->result;
+    pthread_mutex_unlock(&xcorr->lock);
+}
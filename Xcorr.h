@@ -0,0 +1,66 @@
+/*
+    Hantek 2D72 handheld oscillosope tool for linux
+    Copyright (C) 2021 Luca Oliva
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _XCORR_H
+#define _XCORR_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <complex.h>
+#include <pthread.h>
+
+#define XCORR_AVERAGE                   16 //frames the spectra are averaged over
+
+//Radix-2 FFT of size n, kept as long as the frame size does not change
+typedef struct {
+        int             n;
+        int*            bitrev;
+        double complex* twiddle;
+} xcorr_plan_t;
+
+//Lag in samples, positive when CH2 comes after CH1; phase of CH2 against
+//CH1 at the strongest common frequency, given as a fraction of the sample
+//rate; coherence from the averaged spectra at that frequency.
+typedef struct {
+        double          sample_rate;    //of the frames averaged, in Hz
+        double          lag;
+        double          peak;           //normalized correlation at the lag
+        double          frequency;
+        double          phase_deg;
+        double          coherence;
+        int             frames;
+} xcorr_result_t;
+
+typedef struct {
+        pthread_mutex_t lock;
+        xcorr_plan_t    plan;
+        int             num_samples;
+        double complex* work;
+        double complex* sxy;
+        double*         sxx;
+        double*         syy;
+        xcorr_result_t  result;
+} xcorr_t;
+
+void xcorr_init(xcorr_t* xcorr);
+void xcorr_free(xcorr_t* xcorr);
+void xcorr_reset(xcorr_t* xcorr);
+int  xcorr_push(xcorr_t* xcorr, const uint8_t* frame, int num_samples, double sample_rate);
+void xcorr_get(xcorr_t* xcorr, xcorr_result_t* result);
+
+#endif //_XCORR_H
@@ -0,0 +1,98 @@
+/*
+    Hantek 2D72 handheld oscillosope tool for linux
+    Copyright (C) 2021 Luca Oliva
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+#include <math.h>
+
+#include "Xy.h"
+
+#define XY_MIN_GAIN                     1e-20
+
+void xy_init(xy_t* xy) {
+    pthread_mutex_init(&xy->lock, NULL);
+    xy->persistence = 0;
+    xy_clear(xy);
+}
+
+void xy_clear(xy_t* xy) {
+    pthread_mutex_lock(&xy->lock);
+    memset(xy->bins, 0, sizeof(xy->bins));
+    xy->gain    = 1;
+    xy->last_us = 0;
+    xy->frames  = 0;
+    pthread_mutex_unlock(&xy->lock);
+}
+
+void xy_set_persistence(xy_t* xy, double seconds) {
+    pthread_mutex_lock(&xy->lock);
+    xy->persistence = seconds;
+    pthread_mutex_unlock(&xy->lock);
+}
+
+//Interleaved CH1, CH2 pairs
+void xy_push(xy_t* xy, const uint8_t* frame, int num_samples, int64_t time_us) {
+    float weight;
+
+    pthread_mutex_lock(&xy->lock);
+    if ( xy->persistence <= 0 ) {
+        memset(xy->bins, 0, sizeof(xy->bins));
+        xy->gain = 1;
+    } else if ( xy->frames ) {
+        xy->gain *= exp(-(time_us-xy->last_us)/(xy->persistence*1e6));
+        if ( xy->gain < XY_MIN_GAIN ) {
+            float* bins = &xy->bins[0][0];
+            for (int i=0;i<XY_SIZE*XY_SIZE;i++)
+                bins[i] *= xy->gain;
+            xy->gain = 1;
+        }
+    }
+    xy->last_us = time_us;
+    xy->frames++;
+
+    weight = 1/xy->gain;
+    for (int i=0;i<num_samples;i++)
+        xy->bins[XY_SIZE-1-frame[2*i+1]][frame[2*i]] += weight;
+    pthread_mutex_unlock(&xy->lock);
+}
+
+//Log scaled density, dark blue to yellow like the eye diagram; empty bins
+//are left transparent so the grid shows through
+void xy_render(xy_t* xy, uint32_t* pixels, int stride) {
+    float max = 0;
+    double scale;
+
+    pthread_mutex_lock(&xy->lock);
+    for (int r=0;r<XY_SIZE;r++)
+        for (int c=0;c<XY_SIZE;c++)
+            if ( xy->bins[r][c] > max )
+                max = xy->bins[r][c];
+    scale = max > 0 ? 1/log1p(max*xy->gain) : 0;
+
+    for (int r=0;r<XY_SIZE;r++) {
+        uint32_t* row = pixels + r*stride;
+        for (int c=0;c<XY_SIZE;c++) {
+            double count = xy->bins[r][c]*xy->gain;
+            double level = fmin(1, log1p(count)*scale);
+            int red   = 255*level;
+            int green = 255*level*level;
+            int blue  = 255*(1-level);
+            row[c] = count > 0 ? 0xFF000000 | red << 16 | green << 8 | blue : 0;
+        }
+    }
+    pthread_mutex_unlock(&xy->lock);
+}
@@ -0,0 +1,47 @@
+/*
+    Hantek 2D72 handheld oscillosope tool for linux
+    Copyright (C) 2021 Luca Oliva
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef _XY_H
+#define _XY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+//One bin per raw code pair, CH1 across and CH2 up
+#define XY_SIZE                         256
+
+//Hits fade with a time constant of persistence seconds, 0 keeps only the
+//last frame. Bins hold hits divided by gain, so fading a frame only
+//changes gain and the bins are rescaled once it gets too small.
+typedef struct {
+        pthread_mutex_t lock;
+        double          persistence;
+        double          gain;
+        int64_t         last_us;
+        uint64_t        frames;
+        float           bins[XY_SIZE][XY_SIZE];
+} xy_t;
+
+void xy_init(xy_t* xy);
+void xy_clear(xy_t* xy);
+void xy_set_persistence(xy_t* xy, double seconds);
+void xy_push(xy_t* xy, const uint8_t* frame, int num_samples, int64_t time_us);
+void xy_render(xy_t* xy, uint32_t* pixels, int stride);
+
+#endif //_XY_H